@@ -0,0 +1,514 @@
+// -----------------------------------------------------------------------------
+//  Accelerate.h
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+// -----------------------------------------------------------------------------
+//  Portable stand-in for the parts of Apple's Accelerate framework used by
+//  pkmMatrix, for building on Linux (see the Makefile, which puts compat/ on
+//  the include path on non-Apple systems only).
+//
+//  BLAS comes from <cblas.h> (e.g. OpenBLAS) and LAPACK from the Fortran
+//  symbols of any LAPACK; vDSP and vForce are plain loops with a unit stride
+//  fast path for the compiler to vectorize, and vImageScale_PlanarF is
+//  bilinear rather than Lanczos.  Results agree with Accelerate up to the
+//  order of floating point summation.
+// -----------------------------------------------------------------------------
+
+#include <cblas.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned long       vDSP_Length;
+typedef long                vDSP_Stride;
+
+typedef int                 __CLPK_integer;
+typedef float               __CLPK_real;
+typedef double              __CLPK_doublereal;
+
+// -----------------------------------------------------------------------------
+//  vDSP: element-wise arithmetic.  As in Accelerate, vsub and vdiv take the
+//  subtrahend / divisor first
+// -----------------------------------------------------------------------------
+inline void vDSP_vadd(const float *A, vDSP_Stride IA, const float *B, vDSP_Stride IB, float *C, vDSP_Stride IC, vDSP_Length N)
+{
+    if (IA == 1 && IB == 1 && IC == 1) {
+        for (vDSP_Length i = 0; i < N; i++) C[i] = A[i] + B[i];
+    }
+    else {
+        for (vDSP_Length i = 0; i < N; i++) C[i * IC] = A[i * IA] + B[i * IB];
+    }
+}
+
+inline void vDSP_vsub(const float *B, vDSP_Stride IB, const float *A, vDSP_Stride IA, float *C, vDSP_Stride IC, vDSP_Length N)
+{
+    if (IA == 1 && IB == 1 && IC == 1) {
+        for (vDSP_Length i = 0; i < N; i++) C[i] = A[i] - B[i];
+    }
+    else {
+        for (vDSP_Length i = 0; i < N; i++) C[i * IC] = A[i * IA] - B[i * IB];
+    }
+}
+
+inline void vDSP_vmul(const float *A, vDSP_Stride IA, const float *B, vDSP_Stride IB, float *C, vDSP_Stride IC, vDSP_Length N)
+{
+    if (IA == 1 && IB == 1 && IC == 1) {
+        for (vDSP_Length i = 0; i < N; i++) C[i] = A[i] * B[i];
+    }
+    else {
+        for (vDSP_Length i = 0; i < N; i++) C[i * IC] = A[i * IA] * B[i * IB];
+    }
+}
+
+inline void vDSP_vdiv(const float *B, vDSP_Stride IB, const float *A, vDSP_Stride IA, float *C, vDSP_Stride IC, vDSP_Length N)
+{
+    if (IA == 1 && IB == 1 && IC == 1) {
+        for (vDSP_Length i = 0; i < N; i++) C[i] = A[i] / B[i];
+    }
+    else {
+        for (vDSP_Length i = 0; i < N; i++) C[i * IC] = A[i * IA] / B[i * IB];
+    }
+}
+
+inline void vDSP_vsadd(const float *A, vDSP_Stride IA, const float *B, float *C, vDSP_Stride IC, vDSP_Length N)
+{
+    const float b = *B;
+    if (IA == 1 && IC == 1) {
+        for (vDSP_Length i = 0; i < N; i++) C[i] = A[i] + b;
+    }
+    else {
+        for (vDSP_Length i = 0; i < N; i++) C[i * IC] = A[i * IA] + b;
+    }
+}
+
+inline void vDSP_vsmul(const float *A, vDSP_Stride IA, const float *B, float *C, vDSP_Stride IC, vDSP_Length N)
+{
+    const float b = *B;
+    if (IA == 1 && IC == 1) {
+        for (vDSP_Length i = 0; i < N; i++) C[i] = A[i] * b;
+    }
+    else {
+        for (vDSP_Length i = 0; i < N; i++) C[i * IC] = A[i * IA] * b;
+    }
+}
+
+inline void vDSP_vsdiv(const float *A, vDSP_Stride IA, const float *B, float *C, vDSP_Stride IC, vDSP_Length N)
+{
+    const float b = *B;
+    if (IA == 1 && IC == 1) {
+        for (vDSP_Length i = 0; i < N; i++) C[i] = A[i] / b;
+    }
+    else {
+        for (vDSP_Length i = 0; i < N; i++) C[i * IC] = A[i * IA] / b;
+    }
+}
+
+inline void vDSP_svdiv(const float *A, const float *B, vDSP_Stride IB, float *C, vDSP_Stride IC, vDSP_Length N)
+{
+    const float a = *A;
+    for (vDSP_Length i = 0; i < N; i++) C[i * IC] = a / B[i * IB];
+}
+
+// D = A * B + C for scalars B and C
+inline void vDSP_vsmsa(const float *A, vDSP_Stride IA, const float *B, const float *C, float *D, vDSP_Stride ID, vDSP_Length N)
+{
+    const float b = *B, c = *C;
+    if (IA == 1 && ID == 1) {
+        for (vDSP_Length i = 0; i < N; i++) D[i] = A[i] * b + c;
+    }
+    else {
+        for (vDSP_Length i = 0; i < N; i++) D[i * ID] = A[i * IA] * b + c;
+    }
+}
+
+inline void vDSP_vsq(const float *A, vDSP_Stride IA, float *C, vDSP_Stride IC, vDSP_Length N)
+{
+    if (IA == 1 && IC == 1) {
+        for (vDSP_Length i = 0; i < N; i++) C[i] = A[i] * A[i];
+    }
+    else {
+        for (vDSP_Length i = 0; i < N; i++) C[i * IC] = A[i * IA] * A[i * IA];
+    }
+}
+
+inline void vDSP_vabs(const float *A, vDSP_Stride IA, float *C, vDSP_Stride IC, vDSP_Length N)
+{
+    if (IA == 1 && IC == 1) {
+        for (vDSP_Length i = 0; i < N; i++) C[i] = fabsf(A[i]);
+    }
+    else {
+        for (vDSP_Length i = 0; i < N; i++) C[i * IC] = fabsf(A[i * IA]);
+    }
+}
+
+inline void vDSP_vneg(const float *A, vDSP_Stride IA, float *C, vDSP_Stride IC, vDSP_Length N)
+{
+    for (vDSP_Length i = 0; i < N; i++) C[i * IC] = -A[i * IA];
+}
+
+inline void vDSP_vclip(const float *A, vDSP_Stride IA, const float *B, const float *C, float *D, vDSP_Stride ID, vDSP_Length N)
+{
+    const float low = *B, high = *C;
+    for (vDSP_Length i = 0; i < N; i++) {
+        float v = A[i * IA];
+        D[i * ID] = v < low ? low : (v > high ? high : v);
+    }
+}
+
+inline void vDSP_vclr(float *C, vDSP_Stride IC, vDSP_Length N)
+{
+    for (vDSP_Length i = 0; i < N; i++) C[i * IC] = 0.0f;
+}
+
+inline void vDSP_vfill(const float *A, float *C, vDSP_Stride IC, vDSP_Length N)
+{
+    const float a = *A;
+    for (vDSP_Length i = 0; i < N; i++) C[i * IC] = a;
+}
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+//  vDSP: conversions
+// -----------------------------------------------------------------------------
+// float to int8, rounding toward zero
+inline void vDSP_vfix8(const float *A, vDSP_Stride IA, char *C, vDSP_Stride IC, vDSP_Length N)
+{
+    for (vDSP_Length i = 0; i < N; i++) C[i * IC] = (char)A[i * IA];
+}
+
+inline void vDSP_vspdp(const float *A, vDSP_Stride IA, double *C, vDSP_Stride IC, vDSP_Length N)
+{
+    for (vDSP_Length i = 0; i < N; i++) C[i * IC] = A[i * IA];
+}
+
+inline void vDSP_vdpsp(const double *A, vDSP_Stride IA, float *C, vDSP_Stride IC, vDSP_Length N)
+{
+    for (vDSP_Length i = 0; i < N; i++) C[i * IC] = (float)A[i * IA];
+}
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+//  vDSP: reductions.  The index returned by maxvi / minvi is of the element
+//  in A, i.e. a multiple of the stride
+// -----------------------------------------------------------------------------
+inline void vDSP_sve(const float *A, vDSP_Stride IA, float *C, vDSP_Length N)
+{
+    float sum = 0.0f;
+    for (vDSP_Length i = 0; i < N; i++) sum += A[i * IA];
+    *C = sum;
+}
+
+inline void vDSP_svesq(const float *A, vDSP_Stride IA, float *C, vDSP_Length N)
+{
+    float sum = 0.0f;
+    for (vDSP_Length i = 0; i < N; i++) sum += A[i * IA] * A[i * IA];
+    *C = sum;
+}
+
+inline void vDSP_dotpr(const float *A, vDSP_Stride IA, const float *B, vDSP_Stride IB, float *C, vDSP_Length N)
+{
+    float sum = 0.0f;
+    for (vDSP_Length i = 0; i < N; i++) sum += A[i * IA] * B[i * IB];
+    *C = sum;
+}
+
+inline void vDSP_meanv(const float *A, vDSP_Stride IA, float *C, vDSP_Length N)
+{
+    vDSP_sve(A, IA, C, N);
+    *C = N ? *C / N : 0.0f;
+}
+
+inline void vDSP_meamgv(const float *A, vDSP_Stride IA, float *C, vDSP_Length N)
+{
+    float sum = 0.0f;
+    for (vDSP_Length i = 0; i < N; i++) sum += fabsf(A[i * IA]);
+    *C = N ? sum / N : 0.0f;
+}
+
+inline void vDSP_rmsqv(const float *A, vDSP_Stride IA, float *C, vDSP_Length N)
+{
+    vDSP_svesq(A, IA, C, N);
+    *C = N ? sqrtf(*C / N) : 0.0f;
+}
+
+inline void vDSP_maxv(const float *A, vDSP_Stride IA, float *C, vDSP_Length N)
+{
+    float m = -INFINITY;
+    for (vDSP_Length i = 0; i < N; i++) m = A[i * IA] > m ? A[i * IA] : m;
+    *C = m;
+}
+
+inline void vDSP_minv(const float *A, vDSP_Stride IA, float *C, vDSP_Length N)
+{
+    float m = INFINITY;
+    for (vDSP_Length i = 0; i < N; i++) m = A[i * IA] < m ? A[i * IA] : m;
+    *C = m;
+}
+
+inline void vDSP_maxvi(const float *A, vDSP_Stride IA, float *C, vDSP_Length *I, vDSP_Length N)
+{
+    float m = -INFINITY;
+    vDSP_Length index = 0;
+    for (vDSP_Length i = 0; i < N; i++) {
+        if (A[i * IA] > m) {
+            m = A[i * IA];
+            index = i * IA;
+        }
+    }
+    *C = m;
+    *I = index;
+}
+
+inline void vDSP_minvi(const float *A, vDSP_Stride IA, float *C, vDSP_Length *I, vDSP_Length N)
+{
+    float m = INFINITY;
+    vDSP_Length index = 0;
+    for (vDSP_Length i = 0; i < N; i++) {
+        if (A[i * IA] < m) {
+            m = A[i * IA];
+            index = i * IA;
+        }
+    }
+    *C = m;
+    *I = index;
+}
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+//  vDSP: interpolation and matrices
+// -----------------------------------------------------------------------------
+// C[i] = A[j] + frac(B[i]) * (A[j + 1] - A[j]) with j = floor(B[i])
+inline void vDSP_vlint(const float *A, const float *B, vDSP_Stride IB, float *C, vDSP_Stride IC, vDSP_Length N, vDSP_Length M)
+{
+    (void)M;
+    for (vDSP_Length i = 0; i < N; i++) {
+        float b = B[i * IB];
+        vDSP_Length j = (vDSP_Length)b;
+        float alpha = b - (float)j;
+        C[i * IC] = A[j] + alpha * (A[j + 1] - A[j]);
+    }
+}
+
+// C (M x N) = A^T, A being N x M
+inline void vDSP_mtrans(const float *A, vDSP_Stride IA, float *C, vDSP_Stride IC, vDSP_Length M, vDSP_Length N)
+{
+    for (vDSP_Length m = 0; m < M; m++) {
+        for (vDSP_Length n = 0; n < N; n++) {
+            C[(m * N + n) * IC] = A[(n * M + m) * IA];
+        }
+    }
+}
+
+// C (M x N) = A (M x P) * B (P x N)
+inline void vDSP_mmul(const float *A, vDSP_Stride IA, const float *B, vDSP_Stride IB, float *C, vDSP_Stride IC, vDSP_Length M, vDSP_Length N, vDSP_Length P)
+{
+    if (IA == 1 && IB == 1 && IC == 1) {
+        cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, (int)M, (int)N, (int)P,
+                    1.0f, A, (int)P, B, (int)N, 0.0f, C, (int)N);
+        return;
+    }
+    for (vDSP_Length m = 0; m < M; m++) {
+        for (vDSP_Length n = 0; n < N; n++) {
+            float sum = 0.0f;
+            for (vDSP_Length p = 0; p < P; p++) {
+                sum += A[(m * P + p) * IA] * B[(p * N + n) * IB];
+            }
+            C[(m * N + n) * IC] = sum;
+        }
+    }
+}
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+//  vForce: y[i] = f(x[i]) for i in [0, *n)
+// -----------------------------------------------------------------------------
+inline void vvsqrtf(float *y, const float *x, const int *n)  { for (int i = 0; i < *n; i++) y[i] = sqrtf(x[i]); }
+inline void vvsinf(float *y, const float *x, const int *n)   { for (int i = 0; i < *n; i++) y[i] = sinf(x[i]); }
+inline void vvcosf(float *y, const float *x, const int *n)   { for (int i = 0; i < *n; i++) y[i] = cosf(x[i]); }
+inline void vvlogf(float *y, const float *x, const int *n)   { for (int i = 0; i < *n; i++) y[i] = logf(x[i]); }
+inline void vvlog10f(float *y, const float *x, const int *n) { for (int i = 0; i < *n; i++) y[i] = log10f(x[i]); }
+inline void vvexpf(float *y, const float *x, const int *n)   { for (int i = 0; i < *n; i++) y[i] = expf(x[i]); }
+inline void vvfloorf(float *y, const float *x, const int *n) { for (int i = 0; i < *n; i++) y[i] = floorf(x[i]); }
+inline void vvceilf(float *y, const float *x, const int *n)  { for (int i = 0; i < *n; i++) y[i] = ceilf(x[i]); }
+
+// z[i] = x[i] ^ y[i]
+inline void vvpowf(float *z, const float *y, const float *x, const int *n)
+{
+    for (int i = 0; i < *n; i++) z[i] = powf(x[i], y[i]);
+}
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+//  vImage: planar float rescaling
+// -----------------------------------------------------------------------------
+typedef unsigned long       vImagePixelCount;
+typedef long                vImage_Error;
+typedef uint32_t            vImage_Flags;
+
+typedef struct
+{
+    void                *data;
+    vImagePixelCount    height;
+    vImagePixelCount    width;
+    size_t              rowBytes;
+} vImage_Buffer;
+
+enum
+{
+    kvImageNoFlags                      = 0,
+    kvImageNoError                      = 0,
+    kvImageRoiLargerThanInputBuffer     = -21766,
+    kvImageInvalidKernelSize            = -21767,
+    kvImageInvalidEdgeStyle             = -21768,
+    kvImageInvalidOffset_X              = -21769,
+    kvImageInvalidOffset_Y              = -21770,
+    kvImageMemoryAllocationError        = -21771,
+    kvImageNullPointerArgument          = -21772,
+    kvImageInvalidParameter             = -21773,
+    kvImageBufferSizeMismatch           = -21774,
+    kvImageUnknownFlagsBit              = -21775
+};
+
+// bilinear, sampling at pixel centres with the edges clamped
+inline vImage_Error vImageScale_PlanarF(const vImage_Buffer *src, const vImage_Buffer *dest, void *tempBuffer, vImage_Flags flags)
+{
+    (void)tempBuffer;
+    (void)flags;
+    if (src == NULL || dest == NULL || src->data == NULL || dest->data == NULL) {
+        return kvImageNullPointerArgument;
+    }
+    if (src->width == 0 || src->height == 0) {
+        return kvImageInvalidParameter;
+    }
+    const float sy = (float)src->height / (float)dest->height;
+    const float sx = (float)src->width / (float)dest->width;
+    for (vImagePixelCount r = 0; r < dest->height; r++) {
+        float y = ((float)r + 0.5f) * sy - 0.5f;
+        y = y < 0.0f ? 0.0f : (y > (float)(src->height - 1) ? (float)(src->height - 1) : y);
+        vImagePixelCount y0 = (vImagePixelCount)y, y1 = y0 + 1 < src->height ? y0 + 1 : y0;
+        float fy = y - (float)y0;
+        const float *row0 = (const float *)((const char *)src->data + y0 * src->rowBytes);
+        const float *row1 = (const float *)((const char *)src->data + y1 * src->rowBytes);
+        float *out = (float *)((char *)dest->data + r * dest->rowBytes);
+        for (vImagePixelCount c = 0; c < dest->width; c++) {
+            float x = ((float)c + 0.5f) * sx - 0.5f;
+            x = x < 0.0f ? 0.0f : (x > (float)(src->width - 1) ? (float)(src->width - 1) : x);
+            vImagePixelCount x0 = (vImagePixelCount)x, x1 = x0 + 1 < src->width ? x0 + 1 : x0;
+            float fx = x - (float)x0;
+            float top = row0[x0] + fx * (row0[x1] - row0[x0]);
+            float bottom = row1[x0] + fx * (row1[x1] - row1[x0]);
+            out[c] = top + fy * (bottom - top);
+        }
+    }
+    return kvImageNoError;
+}
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+//  LAPACK, declared as in Accelerate's clapack.h
+// -----------------------------------------------------------------------------
+extern "C"
+{
+    int sgesdd_(char *jobz, __CLPK_integer *m, __CLPK_integer *n, __CLPK_real *a, __CLPK_integer *lda,
+                __CLPK_real *s, __CLPK_real *u, __CLPK_integer *ldu, __CLPK_real *vt, __CLPK_integer *ldvt,
+                __CLPK_real *work, __CLPK_integer *lwork, __CLPK_integer *iwork, __CLPK_integer *info);
+    int sgetrf_(__CLPK_integer *m, __CLPK_integer *n, __CLPK_real *a, __CLPK_integer *lda,
+                __CLPK_integer *ipiv, __CLPK_integer *info);
+    int sgetri_(__CLPK_integer *n, __CLPK_real *a, __CLPK_integer *lda, __CLPK_integer *ipiv,
+                __CLPK_real *work, __CLPK_integer *lwork, __CLPK_integer *info);
+    int sgesv_(__CLPK_integer *n, __CLPK_integer *nrhs, __CLPK_real *a, __CLPK_integer *lda,
+               __CLPK_integer *ipiv, __CLPK_real *b, __CLPK_integer *ldb, __CLPK_integer *info);
+    int sposv_(char *uplo, __CLPK_integer *n, __CLPK_integer *nrhs, __CLPK_real *a, __CLPK_integer *lda,
+               __CLPK_real *b, __CLPK_integer *ldb, __CLPK_integer *info);
+    int spotrf_(char *uplo, __CLPK_integer *n, __CLPK_real *a, __CLPK_integer *lda, __CLPK_integer *info);
+    int dpotrf_(char *uplo, __CLPK_integer *n, __CLPK_doublereal *a, __CLPK_integer *lda, __CLPK_integer *info);
+    int strtri_(char *uplo, char *diag, __CLPK_integer *n, __CLPK_real *a, __CLPK_integer *lda,
+                __CLPK_integer *info);
+    int sgeqrf_(__CLPK_integer *m, __CLPK_integer *n, __CLPK_real *a, __CLPK_integer *lda,
+                __CLPK_real *tau, __CLPK_real *work, __CLPK_integer *lwork, __CLPK_integer *info);
+    int sorgqr_(__CLPK_integer *m, __CLPK_integer *n, __CLPK_integer *k, __CLPK_real *a, __CLPK_integer *lda,
+                __CLPK_real *tau, __CLPK_real *work, __CLPK_integer *lwork, __CLPK_integer *info);
+    int ssyevr_(char *jobz, char *range, char *uplo, __CLPK_integer *n, __CLPK_real *a, __CLPK_integer *lda,
+                __CLPK_real *vl, __CLPK_real *vu, __CLPK_integer *il, __CLPK_integer *iu, __CLPK_real *abstol,
+                __CLPK_integer *m, __CLPK_real *w, __CLPK_real *z, __CLPK_integer *ldz, __CLPK_integer *isuppz,
+                __CLPK_real *work, __CLPK_integer *lwork, __CLPK_integer *iwork, __CLPK_integer *liwork,
+                __CLPK_integer *info);
+}
+// -----------------------------------------------------------------------------
@@ -0,0 +1,365 @@
+// -----------------------------------------------------------------------------
+//  pkmApproximateNearestNeighbors.cpp
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+
+#include "pkmApproximateNearestNeighbors.h"
+#include "pkmKMeans.h"
+#include "pkmParallel.h"
+#include <algorithm>
+#include <random>
+
+// training rows per centroid, as a cap on the k-means training samples
+static const size_t PQ_TRAINING_ROWS_PER_CENTROID = 64;
+static const int    PQ_KMEANS_ITERATIONS = 25;
+static const size_t PQ_MAX_CENTROIDS = 256;
+
+// -------------------------------------------------------------------------
+// up to 'n' distinct rows of X, chosen at random
+static Mat sampleRows(const Mat &X, size_t n, unsigned int seed)
+{
+    if (n >= X.rows) {
+        return X;
+    }
+    std::vector<size_t> order(X.rows);
+    for (size_t i = 0; i < X.rows; i++) {
+        order[i] = i;
+    }
+    std::mt19937 rng(seed);
+    for (size_t i = 0; i < n; i++) {
+        std::swap(order[i], order[i + rng() % (X.rows - i)]);
+    }
+    std::sort(order.begin(), order.begin() + n);
+    
+    Mat sample(n, X.cols);
+    for (size_t i = 0; i < n; i++) {
+        std::copy(X.data + order[i] * X.cols, X.data + (order[i] + 1) * X.cols, sample.data + i * X.cols);
+    }
+    return sample;
+}
+
+// -------------------------------------------------------------------------
+pkmApproximateNearestNeighbors::pkmApproximateNearestNeighbors()
+{
+    dimensions = numSubquantizers = subDimensions = numCentroids = 0;
+    numProbes = 8;
+    numVectors = 0;
+    bTrained = false;
+}
+
+// -------------------------------------------------------------------------
+void pkmApproximateNearestNeighbors::train(const Mat &X, size_t numLists, size_t numSub)
+{
+    bTrained = false;
+    if (X.data == NULL || X.rows == 0 || numSub == 0 || X.cols % numSub != 0) {
+        printf("[ERROR]: pkmApproximateNearestNeighbors::train() %lu dimensions are not a multiple of %lu sub-quantizers\n",
+               X.cols, numSub);
+        return;
+    }
+    
+    dimensions = X.cols;
+    numSubquantizers = numSub;
+    subDimensions = dimensions / numSub;
+    numVectors = 0;
+    
+    // coarse quantizer
+    numLists = std::max<size_t>(1, std::min(numLists, (size_t)X.rows));
+    pkmKMeans coarse((int)numLists);
+    coarse.setMaxIterations(PQ_KMEANS_ITERATIONS);
+    coarse.train(sampleRows(X, numLists * PQ_TRAINING_ROWS_PER_CENTROID, 1));
+    coarseCentroids = coarse.getCenters();
+    numLists = coarseCentroids.rows;
+    
+    // sub-quantizers on the residuals of a sample
+    Mat sample = sampleRows(X, PQ_MAX_CENTROIDS * PQ_TRAINING_ROWS_PER_CENTROID, 2);
+    std::vector<int> lists;
+    coarse.predict(sample, lists);
+    for (size_t i = 0; i < sample.rows; i++) {
+        const float *c = coarseCentroids.data + lists[i] * dimensions;
+        float *x = sample.data + i * dimensions;
+        for (size_t d = 0; d < dimensions; d++) {
+            x[d] -= c[d];
+        }
+    }
+    
+    numCentroids = std::min(PQ_MAX_CENTROIDS, (size_t)sample.rows);
+    codebooks = Mat(numSubquantizers * numCentroids, subDimensions);
+    Mat subvectors(sample.rows, subDimensions);
+    for (size_t m = 0; m < numSubquantizers; m++)
+    {
+        for (size_t i = 0; i < sample.rows; i++) {
+            const float *x = sample.data + i * dimensions + m * subDimensions;
+            std::copy(x, x + subDimensions, subvectors.data + i * subDimensions);
+        }
+        pkmKMeans sub((int)numCentroids);
+        sub.setMaxIterations(PQ_KMEANS_ITERATIONS);
+        sub.setSeed(m + 3);
+        sub.train(subvectors);
+        const Mat &centers = sub.getCenters();
+        std::copy(centers.data, centers.data + numCentroids * subDimensions,
+                  codebooks.data + m * numCentroids * subDimensions);
+    }
+    
+    listCodes.assign(numLists, std::vector<uint8_t>());
+    listIds.assign(numLists, std::vector<uint32_t>());
+    bTrained = true;
+}
+
+// -------------------------------------------------------------------------
+void pkmApproximateNearestNeighbors::encode(const Mat &X, const std::vector<int> &lists, std::vector<uint8_t> &codes) const
+{
+    const size_t N = X.rows;
+    codes.resize(N * numSubquantizers);
+    
+    // residual sub-vectors, one sub-quantizer at a time, assigned with the
+    // GEMM based nearest center search of pkmKMeans
+    Mat subvectors(N, subDimensions);
+    std::vector<int> nearest;
+    for (size_t m = 0; m < numSubquantizers; m++)
+    {
+        for (size_t i = 0; i < N; i++) {
+            const float *x = X.data + i * dimensions + m * subDimensions;
+            const float *c = coarseCentroids.data + lists[i] * dimensions + m * subDimensions;
+            float *s = subvectors.data + i * subDimensions;
+            for (size_t d = 0; d < subDimensions; d++) {
+                s[d] = x[d] - c[d];
+            }
+        }
+        pkmKMeans sub;
+        sub.setCenters(Mat(numCentroids, subDimensions, codebooks.data + m * numCentroids * subDimensions, true));
+        sub.predict(subvectors, nearest);
+        for (size_t i = 0; i < N; i++) {
+            codes[i * numSubquantizers + m] = (uint8_t)nearest[i];
+        }
+    }
+}
+
+// -------------------------------------------------------------------------
+void pkmApproximateNearestNeighbors::add(const Mat &X)
+{
+    if (!bTrained || X.cols != dimensions) {
+        printf("[ERROR]: pkmApproximateNearestNeighbors::add() index is not trained for %lu dimensions\n", X.cols);
+        return;
+    }
+    
+    pkmKMeans coarse;
+    coarse.setCenters(coarseCentroids);
+    std::vector<int> lists;
+    coarse.predict(X, lists);
+    
+    std::vector<uint8_t> codes;
+    encode(X, lists, codes);
+    
+    for (size_t i = 0; i < X.rows; i++) {
+        std::vector<uint8_t> &list = listCodes[lists[i]];
+        list.insert(list.end(), codes.begin() + i * numSubquantizers, codes.begin() + (i + 1) * numSubquantizers);
+        listIds[lists[i]].push_back((uint32_t)(numVectors + i));
+    }
+    numVectors += X.rows;
+}
+
+// -------------------------------------------------------------------------
+void pkmApproximateNearestNeighbors::build(const Mat &X, size_t numLists, size_t numSub)
+{
+    train(X, numLists, numSub);
+    if (bTrained) {
+        add(X);
+    }
+}
+
+// -------------------------------------------------------------------------
+void pkmApproximateNearestNeighbors::knn(const float *query, size_t k, std::vector<size_t> &indices, std::vector<float> &distances) const
+{
+    indices.clear();
+    distances.clear();
+    if (!bTrained || numVectors == 0) {
+        return;
+    }
+    k = std::max<size_t>(1, k);
+    
+    // nearest lists
+    const size_t numLists = coarseCentroids.rows;
+    const size_t probes = std::min(numProbes, numLists);
+    std::vector<std::pair<float, size_t> > coarse(numLists);
+    for (size_t c = 0; c < numLists; c++) {
+        coarse[c] = std::make_pair(pkm::math::squaredL2Distance(query, coarseCentroids.data + c * dimensions, dimensions), c);
+    }
+    std::partial_sort(coarse.begin(), coarse.begin() + probes, coarse.end());
+    
+    std::vector<float> residual(dimensions), table(numSubquantizers * numCentroids);
+    std::vector<float> best;
+    std::vector<size_t> bestIds;
+    best.reserve(k + 1);
+    bestIds.reserve(k + 1);
+    float worst = HUGE_VALF;
+    
+    for (size_t p = 0; p < probes; p++)
+    {
+        size_t list = coarse[p].second;
+        const std::vector<uint8_t> &codes = listCodes[list];
+        const std::vector<uint32_t> &ids = listIds[list];
+        if (ids.empty()) {
+            continue;
+        }
+        
+        // distance from each residual sub-vector to every sub-centroid
+        const float *c = coarseCentroids.data + list * dimensions;
+        for (size_t d = 0; d < dimensions; d++) {
+            residual[d] = query[d] - c[d];
+        }
+        for (size_t m = 0; m < numSubquantizers; m++) {
+            const float *r = &residual[m * subDimensions];
+            const float *centroid = codebooks.data + m * numCentroids * subDimensions;
+            float *t = &table[m * numCentroids];
+            for (size_t j = 0; j < numCentroids; j++) {
+                t[j] = pkm::math::squaredL2Distance(r, centroid + j * subDimensions, subDimensions);
+            }
+        }
+        
+        // score every code with one lookup per sub-quantizer; four partial
+        // sums keep the lookups independent
+        const size_t M = numSubquantizers;
+        const float *T = &table[0];
+        const uint8_t *code = &codes[0];
+        for (size_t i = 0; i < ids.size(); i++, code += M)
+        {
+            float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+            const float *t = T;
+            size_t m = 0;
+            for (; m + 4 <= M; m += 4, t += 4 * numCentroids) {
+                s0 += t[code[m]];
+                s1 += t[numCentroids + code[m + 1]];
+                s2 += t[2 * numCentroids + code[m + 2]];
+                s3 += t[3 * numCentroids + code[m + 3]];
+            }
+            for (; m < M; m++, t += numCentroids) {
+                s0 += t[code[m]];
+            }
+            float d = (s0 + s1) + (s2 + s3);
+            if (d >= worst) {
+                continue;
+            }
+            
+            // sorted insertion into the k best
+            size_t pos = best.size();
+            if (pos == k) {
+                pos--;
+            }
+            else {
+                best.push_back(d);
+                bestIds.push_back(0);
+            }
+            while (pos > 0 && best[pos - 1] > d) {
+                best[pos] = best[pos - 1];
+                bestIds[pos] = bestIds[pos - 1];
+                pos--;
+            }
+            best[pos] = d;
+            bestIds[pos] = ids[i];
+            if (best.size() == k) {
+                worst = best.back();
+            }
+        }
+    }
+    
+    indices.assign(bestIds.begin(), bestIds.end());
+    distances.resize(best.size());
+    for (size_t i = 0; i < best.size(); i++) {
+        distances[i] = sqrtf(best[i]);
+    }
+}
+
+// -------------------------------------------------------------------------
+void pkmApproximateNearestNeighbors::knn(const Mat &queries, size_t k, std::vector<size_t> &indices, Mat &distances) const
+{
+    if (queries.cols != dimensions) {
+        printf("[ERROR]: pkmApproximateNearestNeighbors::knn() queries have %lu dimensions, index has %lu\n", queries.cols, dimensions);
+        return;
+    }
+    k = std::max<size_t>(1, k);
+    indices.assign(queries.rows * k, (size_t)-1);
+    distances = Mat(queries.rows, k, HUGE_VALF);
+    
+    parallelFor(0, queries.rows, 16, [&](size_t q0, size_t q1) {
+        std::vector<size_t> rowIndices;
+        std::vector<float> rowDistances;
+        for (size_t q = q0; q < q1; q++) {
+            knn(queries.data + q * queries.cols, k, rowIndices, rowDistances);
+            std::copy(rowIndices.begin(), rowIndices.end(), indices.begin() + q * k);
+            std::copy(rowDistances.begin(), rowDistances.end(), distances.data + q * k);
+        }
+    });
+}
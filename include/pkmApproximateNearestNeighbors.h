@@ -0,0 +1,162 @@
+// -----------------------------------------------------------------------------
+//  pkmApproximateNearestNeighbors.h
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "pkmMatrix.h"
+#include <vector>
+#include <stdint.h>
+
+using namespace pkm;
+
+// -----------------------------------------------------------------------------
+//  Approximate L2 nearest neighbour search with an inverted file of product
+//  quantized residuals (IVF+PQ, Jegou et al. 2011).
+//
+//  A coarse k-means splits the rows into 'numLists' lists.  Each row is
+//  stored as the index of its list plus the residual from the list's
+//  centroid, cut into 'numSubquantizers' sub-vectors that are each replaced
+//  by the byte index of the nearest of 256 sub-centroids: a 64 dimensional
+//  float row (256 bytes) stored with 16 sub-quantizers costs 16 bytes plus
+//  its id.  A query visits the 'numProbes' nearest lists, builds a table of
+//  distances from its residual to every sub-centroid, and scores each code
+//  with 'numSubquantizers' table lookups.
+// -----------------------------------------------------------------------------
+class pkmApproximateNearestNeighbors
+{
+public:
+    // -------------------------------------------------------------------------
+    pkmApproximateNearestNeighbors();
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  Learn the coarse and sub-quantizer codebooks from (a sample of) X.
+    //  The number of dimensions must be a multiple of 'numSubquantizers'.
+    // -------------------------------------------------------------------------
+    void train(const Mat &X, size_t numLists, size_t numSubquantizers);
+    
+    // encode and add the rows of X; their ids follow on from size()
+    void add(const Mat &X);
+    
+    // train() and add() on the same rows
+    void build(const Mat &X, size_t numLists, size_t numSubquantizers);
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  The (up to) k approximately nearest rows, nearest first, with their
+    //  approximate L2 distances.  More probes give better recall for more time.
+    // -------------------------------------------------------------------------
+    void knn(const float *query, size_t k, std::vector<size_t> &indices, std::vector<float> &distances) const;
+    
+    // k nearest for every row of 'queries', in parallel: queries.rows x k
+    void knn(const Mat &queries, size_t k, std::vector<size_t> &indices, Mat &distances) const;
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    void    setNumProbes(size_t n)      { numProbes = std::max<size_t>(1, n); }
+    size_t  getNumProbes() const        { return numProbes; }
+    size_t  size() const                { return numVectors; }
+    bool    isTrained() const           { return bTrained; }
+    // bytes stored per row, including its id
+    size_t  getCodeSize() const         { return numSubquantizers + sizeof(uint32_t); }
+    // -------------------------------------------------------------------------
+    
+protected:
+    // -------------------------------------------------------------------------
+    // sub-quantizer codes of the residuals of X from their list centroids
+    void    encode(const Mat &X, const std::vector<int> &lists, std::vector<uint8_t> &codes) const;
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    size_t  dimensions;
+    size_t  numSubquantizers;
+    size_t  subDimensions;
+    size_t  numCentroids;               // sub-centroids per sub-quantizer (<= 256)
+    size_t  numProbes;
+    size_t  numVectors;
+    bool    bTrained;
+    
+    Mat     coarseCentroids;            // numLists x dimensions
+    Mat     codebooks;                  // (numSubquantizers * numCentroids) x subDimensions
+    
+    // per list, the codes (numSubquantizers bytes per row) and row ids
+    std::vector<std::vector<uint8_t> >  listCodes;
+    std::vector<std::vector<uint32_t> > listIds;
+    // -------------------------------------------------------------------------
+};
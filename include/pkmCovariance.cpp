@@ -0,0 +1,242 @@
+// -----------------------------------------------------------------------------
+//  pkmCovariance.cpp
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+
+#include "pkmCovariance.h"
+#include "pkmParallel.h"
+
+using namespace pkm;
+
+// rows centered and accumulated per SYRK
+static const size_t COVARIANCE_BLOCK_ROWS = 256;
+
+// upper bound on the partial accumulators of accumulateCovariance()
+static const size_t COVARIANCE_MAX_PARTIALS = 16;
+
+// -------------------------------------------------------------------------
+CovarianceAccumulator::CovarianceAccumulator(size_t d)
+{
+    reset(d);
+}
+
+// -------------------------------------------------------------------------
+void CovarianceAccumulator::reset(size_t d)
+{
+    dimensions = d;
+    weight = 0;
+    mean.assign(d, 0.0);
+    scatter.assign(d * d, 0.0);
+}
+
+// -------------------------------------------------------------------------
+void CovarianceAccumulator::mergeStatistics(double otherWeight, const double *otherMean, const double *otherScatter)
+{
+    const size_t D = dimensions;
+    double total = weight + otherWeight;
+    if (otherWeight <= 0) {
+        return;
+    }
+    
+    // M = M_a + M_b + (w_a w_b / w) delta delta^T
+    double scale = weight * otherWeight / total;
+    std::vector<double> delta(D);
+    for (size_t i = 0; i < D; i++) {
+        delta[i] = otherMean[i] - mean[i];
+    }
+    for (size_t i = 0; i < D; i++) {
+        double *s = &scatter[i * D];
+        const double *o = otherScatter + i * D;
+        double di = scale * delta[i];
+        for (size_t j = i; j < D; j++) {
+            s[j] += o[j] + di * delta[j];
+        }
+    }
+    for (size_t i = 0; i < D; i++) {
+        mean[i] += delta[i] * otherWeight / total;
+    }
+    weight = total;
+}
+
+// -------------------------------------------------------------------------
+void CovarianceAccumulator::merge(const CovarianceAccumulator &other)
+{
+    if (other.dimensions != dimensions) {
+        printf("[ERROR]: CovarianceAccumulator::merge() %lu dimensions cannot merge with %lu\n", other.dimensions, dimensions);
+        return;
+    }
+    mergeStatistics(other.weight, other.mean.data(), other.scatter.data());
+}
+
+// -------------------------------------------------------------------------
+void CovarianceAccumulator::add(const Mat &X, size_t r0, size_t r1, const float *weights, size_t weightStride)
+{
+    const size_t D = dimensions;
+    if (X.cols != D) {
+        printf("[ERROR]: CovarianceAccumulator::add() rows have %lu dimensions, expected %lu\n", X.cols, D);
+        return;
+    }
+    
+    Mat centered(COVARIANCE_BLOCK_ROWS, D);
+    Mat blockScatter(D, D);
+    std::vector<double> blockMean(D), blockScatterd(D * D, 0.0);
+    std::vector<float> blockMeanf(D);
+    
+    for (size_t b0 = r0; b0 < r1; b0 += COVARIANCE_BLOCK_ROWS)
+    {
+        size_t b1 = std::min(r1, b0 + COVARIANCE_BLOCK_ROWS);
+        
+        // block weight and mean
+        double blockWeight = 0;
+        std::fill(blockMean.begin(), blockMean.end(), 0.0);
+        for (size_t r = b0; r < b1; r++) {
+            double w = weights ? weights[r * weightStride] : 1.0;
+            const float *x = X.data + r * D;
+            for (size_t d = 0; d < D; d++) {
+                blockMean[d] += w * x[d];
+            }
+            blockWeight += w;
+        }
+        if (blockWeight <= 0) {
+            continue;
+        }
+        for (size_t d = 0; d < D; d++) {
+            blockMean[d] /= blockWeight;
+            blockMeanf[d] = (float)blockMean[d];
+        }
+        
+        // sqrt(w) (x - block mean), then the block scatter with one SYRK
+        for (size_t r = b0; r < b1; r++) {
+            float w = weights ? sqrtf(std::max(0.0f, weights[r * weightStride])) : 1.0f;
+            const float *x = X.data + r * D;
+            float *c = centered.data + (r - b0) * D;
+            for (size_t d = 0; d < D; d++) {
+                c[d] = w * (x[d] - blockMeanf[d]);
+            }
+        }
+        cblas_ssyrk(CblasRowMajor, CblasUpper, CblasTrans, D, b1 - b0,
+                    1.0f, centered.data, D, 0.0f, blockScatter.data, D);
+        for (size_t i = 0; i < D; i++) {
+            for (size_t j = i; j < D; j++) {
+                blockScatterd[i * D + j] = blockScatter.data[i * D + j];
+            }
+        }
+        
+        mergeStatistics(blockWeight, blockMean.data(), blockScatterd.data());
+    }
+}
+
+// -------------------------------------------------------------------------
+void CovarianceAccumulator::covariance(Mat &C, double ddof) const
+{
+    const size_t D = dimensions;
+    if (C.rows != D || C.cols != D || !C.bAllocated) {
+        C = Mat(D, D);
+    }
+    double denominator = weight - ddof;
+    double scale = denominator > 0 ? 1.0 / denominator : 0.0;
+    for (size_t i = 0; i < D; i++) {
+        for (size_t j = i; j < D; j++) {
+            float c = (float)(scatter[i * D + j] * scale);
+            C.data[i * D + j] = c;
+            C.data[j * D + i] = c;
+        }
+    }
+}
+
+// -------------------------------------------------------------------------
+void pkm::accumulateCovariance(const Mat &X, CovarianceAccumulator &statistics,
+                               const float *weights, size_t weightStride)
+{
+    const size_t N = X.rows, D = X.cols;
+    statistics.reset(D);
+    if (X.data == NULL || N == 0) {
+        return;
+    }
+    
+    const size_t numBlocks = std::min(COVARIANCE_MAX_PARTIALS, (N + COVARIANCE_BLOCK_ROWS - 1) / COVARIANCE_BLOCK_ROWS);
+    const size_t blockRows = (N + numBlocks - 1) / numBlocks;
+    std::vector<CovarianceAccumulator> partials(numBlocks, CovarianceAccumulator(D));
+    
+    parallelFor(0, numBlocks, 1, [&](size_t b0, size_t b1) {
+        for (size_t b = b0; b < b1; b++) {
+            partials[b].add(X, b * blockRows, std::min(N, (b + 1) * blockRows), weights, weightStride);
+        }
+    });
+    for (size_t b = 0; b < numBlocks; b++) {
+        statistics.merge(partials[b]);
+    }
+}
@@ -0,0 +1,135 @@
+// -----------------------------------------------------------------------------
+//  pkmCovariance.h
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "pkmMatrix.h"
+#include <vector>
+
+namespace pkm
+{
+    // -------------------------------------------------------------------------
+    //  Mergeable covariance statistics of (optionally weighted) rows: the
+    //  total weight, the mean and the scatter sum w (x - mean)(x - mean)^T.
+    //
+    //  add() centers each block of rows on the block's own mean and
+    //  accumulates the scatter with SYRK (the upper triangle only, half the
+    //  FLOPs of a GEMM); blocks and accumulators are combined with the
+    //  pairwise update of Chan et al., so partial sums from separate threads
+    //  or separate passes over streaming data can be merged exactly.
+    // -------------------------------------------------------------------------
+    class CovarianceAccumulator
+    {
+    public:
+        CovarianceAccumulator(size_t dimensions = 0);
+        
+        void reset(size_t dimensions);
+        
+        // rows [r0, r1) of X, weighted by weights[r * weightStride] when given
+        void add(const Mat &X, size_t r0, size_t r1, const float *weights = NULL, size_t weightStride = 1);
+        
+        void merge(const CovarianceAccumulator &other);
+        
+        // scatter / (weight - ddof) as a full symmetric D x D matrix, zero
+        // when there is not enough weight
+        void covariance(Mat &C, double ddof = 1.0) const;
+        
+        size_t                          getDimensions() const   { return dimensions; }
+        double                          getWeight() const       { return weight; }
+        const std::vector<double> &     getMean() const         { return mean; }
+        // upper triangle of the D x D scatter, row-major
+        const std::vector<double> &     getScatter() const      { return scatter; }
+        
+    protected:
+        void mergeStatistics(double otherWeight, const double *otherMean, const double *otherScatter);
+        
+        size_t              dimensions;
+        double              weight;
+        std::vector<double> mean;
+        std::vector<double> scatter;
+    };
+    
+    // -------------------------------------------------------------------------
+    //  Statistics of all rows of X, accumulated over row blocks in parallel
+    //  and merged in order (the blocks depend only on the size of X, so the
+    //  result does not depend on the number of threads)
+    // -------------------------------------------------------------------------
+    void accumulateCovariance(const Mat &X, CovarianceAccumulator &statistics,
+                              const float *weights = NULL, size_t weightStride = 1);
+};
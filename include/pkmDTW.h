@@ -81,11 +81,21 @@ negotiate a licence. Contact details are: parag@pkmital.com
 #pragma once
 
 #include "pkmMatrix.h"
+#include "pkmMatT.h"
+#include "pkmRunningStatistics.h"
 
+// openFrameworks resolves the save() and load() files in its data folder;
+// define WITHOUT_OF to build without it, relative to the working directory
+#ifndef WITHOUT_OF
 #define WITH_OF
+#endif
 
 #ifdef WITH_OF
 #include "ofMain.h"
+#else
+#include <iostream>
+#include <vector>
+using namespace std;
 #endif
 
 using namespace pkm;
@@ -99,8 +109,10 @@ public:
     {
         bSetQuery = false;
         bHaveCandidates = false;
+        numCandidates = 0;
         bUseZNormalize = false;
         bUseCosineDistance = true;
+        bHalfPrecision = false;
         
         range = 1.0;
 
@@ -120,17 +132,52 @@ public:
     }
     // -------------------------------------------------------------------------
     
+    // -------------------------------------------------------------------------
+    //  Store the candidate database in 16-bit halves, at half the memory of
+    //  floats (about 3 significant digits per feature).  Each candidate is
+    //  decoded to float when it is compared.  Call before addToDatabase() or
+    //  load().
+    // -------------------------------------------------------------------------
+    void setHalfPrecisionDatabase(bool bHalf)
+    {
+        if (numCandidates > 0) {
+            cout << "[ERROR::pkmDTW]: Set the database precision before adding candidates!" << endl;
+            return;
+        }
+        bHalfPrecision = bHalf;
+    }
+    // -------------------------------------------------------------------------
+    
     // -------------------------------------------------------------------------
     //  Add elements to the database of possible candidates
     //
     //  'candidate': size is frames x dimensions
+    //
+    //  With z-normalization, the database is normalized by load(), and the
+    //  mean and standard deviation it used stay fixed until the next load():
+    //  candidates added afterwards are normalized with them, as is every
+    //  query, so all sides share one set of parameters.  Before the first
+    //  load() neither candidates nor queries are normalized.
     // -------------------------------------------------------------------------
     void addToDatabase(Mat &el)
     {
+        PKM_INSTRUMENT_LABEL("pkmDTW::addToDatabase");
+        Mat normalized;
+        if (isZNormalized()) {
+            normalized = el;
+            normalized.zNormalizeEachCol(meanValues, stdValues);
+        }
+        const Mat &stored = isZNormalized() ? normalized : el;
+        
         vector<float> lut_el;
-        lut_el.push_back(candidates.rows);
-        candidates.push_back(el);
-        lut_el.push_back(candidates.rows - lut_el[0]);
+        lut_el.push_back(getDatabaseRows());
+        if (bHalfPrecision) {
+            candidatesHalf.push_back(stored);
+        }
+        else {
+            candidates.push_back(stored);
+        }
+        lut_el.push_back(getDatabaseRows() - lut_el[0]);
         candidates_lut.push_back(lut_el);
         
         numCandidates++;
@@ -150,17 +197,19 @@ public:
             cout << "[ERROR::pkmDTW]: Add sequences to the database first using pkmDTW::addToDatabase(el)!" << endl;
             return;
         }
+        PKM_INSTRUMENT_LABEL("pkmDTW::getNearestCandidate");
         
         // establish the query
         setQuery(q);
         
         subscript = 0;
+        Mat decoded;
         // search all candidates linearly
         for (int i = 0; i < numCandidates; i++)
         {
             vector<int> pathI, pathJ;
             Mat differenceMatrix, dtwDistance;
-            Mat thisCandidate = candidates.rowRange(candidates_lut.row(i)[0], candidates_lut.row(i)[0] + candidates_lut.row(i)[1], false);
+            Mat thisCandidate = getCandidate(i, decoded);
             
             differenceMatrix = computeDifferenceMatrix(thisCandidate);
             float thisDistance = dtw(differenceMatrix, dtwDistance, pathI, pathJ);
@@ -204,13 +253,15 @@ public:
             cout << "[ERROR::pkmDTW]: Add sequences to the database first using pkmDTW::addToDatabase(el)!" << endl;
             return;
         }
+        PKM_INSTRUMENT_LABEL("pkmDTW::getNearestCandidateEuclidean");
         subscript = 0;
         Mat query = q;
         Mat distanceMatrix = Mat(q.rows, q.cols);
+        Mat decoded;
         // search all candidates linearly
         for (int i = 0; i < numCandidates; i++)
         {
-            Mat thisCandidate = candidates.rowRange(candidates_lut.row(i)[0], candidates_lut.row(i)[0] + candidates_lut.row(i)[1], false);
+            Mat thisCandidate = getCandidate(i, decoded);
             query.subtract(thisCandidate, distanceMatrix);
             distanceMatrix.abs();
             Mat distance2 = distanceMatrix.sum(false);
@@ -225,17 +276,55 @@ public:
         bestSoFar = INFINITY;
     }
     // -------------------------------------------------------------------------
+    
+    
+    // -------------------------------------------------------------------------
+    //  The single database frame closest to 'q' (1 x dimensions): 'distance'
+    //  is the squared L2 distance, 'subscript' the candidate and 'frame' the
+    //  frame within it
+    // -------------------------------------------------------------------------
+    void getNearestFrame(const float *q,
+                         float &distance,
+                         int &subscript,
+                         int &frame)
+    {
+        if (!bHaveCandidates) {
+            cout << "[ERROR::pkmDTW]: Add sequences to the database first using pkmDTW::addToDatabase(el)!" << endl;
+            return;
+        }
+        PKM_INSTRUMENT_LABEL("pkmDTW::getNearestFrame");
+        size_t idx;
+        if (bHalfPrecision) {
+            candidatesHalf.getIndexOfClosestRowL2(q, distance, idx);
+        }
+        else {
+            candidates.getIndexOfClosestRowL2(Mat(1, candidates.cols, q), distance, idx);
+        }
+        
+        // candidates are stored in order, so find the last one starting at or before idx
+        subscript = 0;
+        while (subscript + 1 < numCandidates && candidates_lut.row(subscript + 1)[0] <= idx) {
+            subscript++;
+        }
+        frame = (int)(idx - candidates_lut.row(subscript)[0]);
+    }
+    // -------------------------------------------------------------------------
   
     
     
     // -------------------------------------------------------------------------
     void save()
     {
+        Mat decoded;
+        if (bHalfPrecision) {
+            decoded = candidatesHalf.toMat();
+        }
+        Mat &database = bHalfPrecision ? decoded : candidates;
 #ifdef WITH_OF
-        candidates.save(ofToDataPath("dtw.txt"));
+        database.save(ofToDataPath("dtw.txt"));
         candidates_lut.save(ofToDataPath("dtw_lut.txt"));
 #else
-        candidates.save("dtw.txt");
+        database.save("dtw.txt");
         candidates_lut.save("dtw_lut.txt");
 #endif        
     }
@@ -254,13 +343,22 @@ public:
         
         if(bUseZNormalize)
         {
-            meanValues = candidates.mean();
-            stdValues = candidates.stddev();
+            // the database and the queries are normalized with these, which
+            // keep EPSILON from zNormalizeEachCol() for constant features
+            statistics.reset(candidates.cols);
+            statistics.push(candidates);
+            statistics.getMeanAndStdDev(meanValues, stdValues);
+            stdValues.add(EPSILON);
             
             meanValues.print();
             stdValues.print();
             
-            candidates.zNormalizeEachCol();
+            candidates.zNormalizeEachCol(meanValues, stdValues);
+        }
+        
+        if (bHalfPrecision) {
+            candidatesHalf = MatH(candidates);
+            candidates = Mat();
         }
         
         numCandidates = candidates_lut.rows;
@@ -273,6 +371,39 @@ public:
     
 protected:
     
+    // -------------------------------------------------------------------------
+    size_t getDatabaseRows() const
+    {
+        return bHalfPrecision ? candidatesHalf.rows : candidates.rows;
+    }
+    
+    // frames x dimensions of candidate i: a view of the float database, or
+    // the half precision rows decoded into 'decoded'
+    Mat getCandidate(int i, Mat &decoded)
+    {
+        size_t r0 = candidates_lut.row(i)[0], n = candidates_lut.row(i)[1];
+        if (!bHalfPrecision) {
+            return candidates.rowRange(r0, r0 + n, false);
+        }
+        const size_t cols = candidatesHalf.cols;
+        if (decoded.rows * decoded.cols < n * cols) {
+            decoded = Mat(n, cols);
+        }
+        candidatesHalf.getRows(r0, r0 + n, decoded.data);
+        return Mat(n, cols, decoded.data, false);
+    }
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  true once load() has z-normalized the database, after which candidates
+    //  and queries are normalized with meanValues and stdValues
+    // -------------------------------------------------------------------------
+    bool isZNormalized() const
+    {
+        return bUseZNormalize && meanValues.cols > 0;
+    }
+    // -------------------------------------------------------------------------
+    
     // -------------------------------------------------------------------------
     // Establish the query to compare against all candidates
     //
@@ -282,19 +413,16 @@ protected:
     // -------------------------------------------------------------------------
     void setQuery(const Mat &q)
     {
+        PKM_INSTRUMENT_LABEL("pkmDTW::setQuery");
         query = q;
-        if(bUseZNormalize)
+        if(isZNormalized())
         {
-            for (int i = 0; i < query.rows; i++) {
-                Mat thisRow = query.rowRange(i,i+1,false);
-                thisRow.subtract(meanValues);
-                thisRow.divide(stdValues);
-            }
+            query.zNormalizeEachCol(meanValues, stdValues);
         }
         queryTransposed = query;
         queryTransposed.setTranspose();
         
-        Mat temp = q;
+        Mat temp = query;
         temp.sqr();
         queryNormalization = temp.sum(false);
         queryNormalization.sqrt();
@@ -314,6 +442,7 @@ protected:
     // -------------------------------------------------------------------------
     Mat computeDifferenceMatrix(Mat &candidate)
     {
+        PKM_INSTRUMENT_LABEL("pkmDTW::computeDifferenceMatrix");
         Mat differenceMatrix;
         if (bSetQuery) {
             if(bUseCosineDistance)
@@ -366,6 +495,7 @@ protected:
              vector<int> &pathI,
              vector<int> &pathJ)
     {
+        PKM_INSTRUMENT_LABEL("pkmDTW::dtw");
         // calculate the dtw distance matrix
         int subscriptRange = differenceMatrix.cols * range;
         Mat traceBack(differenceMatrix.rows, differenceMatrix.cols);
@@ -437,6 +567,7 @@ protected:
         }
         
         // calculate path
+        PKM_INSTRUMENT_LABEL("pkmDTW::traceback");
         i--;
         j--;
         while(i >= 0 && j >= 0) 
@@ -523,8 +654,10 @@ private:
     Mat             query, queryTransposed, queryNormalization;
     
     Mat             candidates;
+    MatH            candidatesHalf; // candidates when bHalfPrecision
     Mat             candidates_lut; // idx = segment; 0 = row in candidates, 1 = num rows for segment
     Mat             meanValues, stdValues;
+    pkmRunningStatistics statistics;
     int             numCandidates;
     
     Mat             queryLB;
@@ -532,6 +665,6 @@ private:
     // -------------------------------------------------------------------------
     
     // -------------------------------------------------------------------------
-    bool            bUseZNormalize, bSetQuery, bHaveCandidates, bUseCosineDistance;
+    bool            bUseZNormalize, bSetQuery, bHaveCandidates, bUseCosineDistance, bHalfPrecision;
     // -------------------------------------------------------------------------
 };
\ No newline at end of file
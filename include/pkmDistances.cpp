@@ -0,0 +1,290 @@
+// -----------------------------------------------------------------------------
+//  pkmDistances.cpp
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+
+#include "pkmDistances.h"
+#include "pkmParallel.h"
+
+using namespace pkm;
+
+// rows of A per tile, and rows of B per tile in pairwiseTopK and for L1
+static const size_t DISTANCE_TILE_ROWS = 64;
+static const size_t DISTANCE_TILE_COLS = 512;
+
+// -------------------------------------------------------------------------
+//  Prepared copy of B for the GEMM metrics: L2 rows shifted by their mean,
+//  with squared norms; cosine rows as they are, with norms
+// -------------------------------------------------------------------------
+struct PreparedRows
+{
+    Mat                 rows;
+    std::vector<float>  norms;
+    std::vector<float>  shift;
+};
+
+static void prepare(const Mat &B, int metric, PreparedRows &prepared)
+{
+    const size_t M = B.rows, D = B.cols;
+    prepared.norms.resize(M);
+    prepared.shift.assign(D, 0.0f);
+    
+    if (metric == METRIC_L2 || metric == METRIC_SQUARED_L2) {
+        std::vector<double> mean(D, 0.0);
+        for (size_t j = 0; j < M; j++) {
+            for (size_t d = 0; d < D; d++) {
+                mean[d] += B.data[j * D + d];
+            }
+        }
+        for (size_t d = 0; d < D; d++) {
+            prepared.shift[d] = mean[d] / (double)M;
+        }
+    }
+    
+    prepared.rows = Mat(M, D);
+    for (size_t j = 0; j < M; j++) {
+        float *b = prepared.rows.data + j * D;
+        for (size_t d = 0; d < D; d++) {
+            b[d] = B.data[j * D + d] - prepared.shift[d];
+        }
+        vDSP_svesq(b, 1, &prepared.norms[j], D);
+        if (metric == METRIC_COSINE) {
+            prepared.norms[j] = sqrtf(prepared.norms[j]);
+        }
+    }
+}
+
+// -------------------------------------------------------------------------
+//  Distances from 'n' rows of A starting at row 'a0' to the B rows
+//  [b0, b0 + m) into 'out' (n x m, leading dimension 'ld').  'scratch' holds
+//  the shifted A tile for the GEMM metrics.
+// -------------------------------------------------------------------------
+static void distanceTile(const Mat &A, size_t a0, size_t n, const Mat &B, const PreparedRows &prepared,
+                         size_t b0, size_t m, int metric, float *out, size_t ld, std::vector<float> &scratch)
+{
+    const size_t D = A.cols;
+    
+    if (metric == METRIC_L1) {
+        for (size_t i = 0; i < n; i++) {
+            const float *a = A.data + (a0 + i) * D;
+            for (size_t j = 0; j < m; j++) {
+                out[i * ld + j] = pkm::math::l1Distance(a, B.data + (b0 + j) * D, D);
+            }
+        }
+        return;
+    }
+    
+    scratch.resize(n * (D + 1));
+    float *tile = &scratch[0], *norms = &scratch[n * D];
+    for (size_t i = 0; i < n; i++) {
+        const float *a = A.data + (a0 + i) * D;
+        float *t = tile + i * D;
+        for (size_t d = 0; d < D; d++) {
+            t[d] = a[d] - prepared.shift[d];
+        }
+        vDSP_svesq(t, 1, &norms[i], D);
+    }
+    
+    if (metric == METRIC_COSINE) {
+        cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, (int)n, (int)m, (int)D,
+                    1.0f, tile, (int)D, prepared.rows.data + b0 * D, (int)D, 0.0f, out, (int)ld);
+        for (size_t i = 0; i < n; i++) {
+            float na = sqrtf(norms[i]);
+            for (size_t j = 0; j < m; j++) {
+                float denominator = na * prepared.norms[b0 + j];
+                out[i * ld + j] = denominator > 0 ? 1.0f - out[i * ld + j] / denominator : 1.0f;
+            }
+        }
+        return;
+    }
+    
+    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, (int)n, (int)m, (int)D,
+                -2.0f, tile, (int)D, prepared.rows.data + b0 * D, (int)D, 0.0f, out, (int)ld);
+    for (size_t i = 0; i < n; i++) {
+        float *o = out + i * ld;
+        const float *nb = &prepared.norms[b0];
+        for (size_t j = 0; j < m; j++) {
+            o[j] = std::max(o[j] + norms[i] + nb[j], 0.0f);
+        }
+        if (metric == METRIC_L2) {
+            for (size_t j = 0; j < m; j++) {
+                o[j] = sqrtf(o[j]);
+            }
+        }
+    }
+}
+
+// -------------------------------------------------------------------------
+void pkm::pairwiseDistances(const Mat &A, const Mat &B, Mat &distances, int metric)
+{
+    if (A.cols != B.cols) {
+        printf("[ERROR]: pairwiseDistances() rows have %lu and %lu dimensions\n", A.cols, B.cols);
+        return;
+    }
+    const size_t N = A.rows, M = B.rows;
+    if (distances.rows != N || distances.cols != M) {
+        distances = Mat(N, M);
+    }
+    if (N == 0 || M == 0) {
+        return;
+    }
+    
+    PreparedRows prepared;
+    if (metric != METRIC_L1) {
+        prepare(B, metric, prepared);
+    }
+    
+    const size_t numTiles = (N + DISTANCE_TILE_ROWS - 1) / DISTANCE_TILE_ROWS;
+    parallelFor(0, numTiles, 1, [&](size_t t0, size_t t1) {
+        std::vector<float> scratch;
+        for (size_t t = t0; t < t1; t++) {
+            size_t a0 = t * DISTANCE_TILE_ROWS;
+            size_t n = std::min(DISTANCE_TILE_ROWS, N - a0);
+            // L1 walks B in tiles that stay in cache across the A rows
+            size_t step = (metric == METRIC_L1) ? DISTANCE_TILE_COLS : M;
+            for (size_t b0 = 0; b0 < M; b0 += step) {
+                size_t m = std::min(step, M - b0);
+                distanceTile(A, a0, n, B, prepared, b0, m, metric, distances.data + a0 * M + b0, M, scratch);
+            }
+        }
+    });
+}
+
+// -------------------------------------------------------------------------
+Mat pkm::pairwiseDistances(const Mat &A, const Mat &B, int metric)
+{
+    Mat distances;
+    pairwiseDistances(A, B, distances, metric);
+    return distances;
+}
+
+// -------------------------------------------------------------------------
+void pkm::pairwiseTopK(const Mat &A, const Mat &B, size_t k, std::vector<size_t> &indices,
+                       Mat &distances, int metric)
+{
+    if (A.cols != B.cols) {
+        printf("[ERROR]: pairwiseTopK() rows have %lu and %lu dimensions\n", A.cols, B.cols);
+        return;
+    }
+    const size_t N = A.rows, M = B.rows;
+    k = std::max<size_t>(1, k);
+    indices.assign(N * k, (size_t)-1);
+    distances = Mat(N, k, HUGE_VALF);
+    if (N == 0 || M == 0) {
+        return;
+    }
+    
+    PreparedRows prepared;
+    if (metric != METRIC_L1) {
+        prepare(B, metric, prepared);
+    }
+    
+    const size_t numTiles = (N + DISTANCE_TILE_ROWS - 1) / DISTANCE_TILE_ROWS;
+    parallelFor(0, numTiles, 1, [&](size_t t0, size_t t1) {
+        std::vector<float> scratch, tile(DISTANCE_TILE_ROWS * DISTANCE_TILE_COLS);
+        for (size_t t = t0; t < t1; t++)
+        {
+            size_t a0 = t * DISTANCE_TILE_ROWS;
+            size_t n = std::min(DISTANCE_TILE_ROWS, N - a0);
+            for (size_t b0 = 0; b0 < M; b0 += DISTANCE_TILE_COLS)
+            {
+                size_t m = std::min(DISTANCE_TILE_COLS, M - b0);
+                distanceTile(A, a0, n, B, prepared, b0, m, metric, &tile[0], DISTANCE_TILE_COLS, scratch);
+                
+                // sorted insertion into each row's k best so far
+                for (size_t i = 0; i < n; i++) {
+                    float *bestDistances = distances.data + (a0 + i) * k;
+                    size_t *bestIndices = &indices[(a0 + i) * k];
+                    const float *row = &tile[i * DISTANCE_TILE_COLS];
+                    for (size_t j = 0; j < m; j++) {
+                        float d = row[j];
+                        if (d >= bestDistances[k - 1]) {
+                            continue;
+                        }
+                        size_t pos = k - 1;
+                        while (pos > 0 && bestDistances[pos - 1] > d) {
+                            bestDistances[pos] = bestDistances[pos - 1];
+                            bestIndices[pos] = bestIndices[pos - 1];
+                            pos--;
+                        }
+                        bestDistances[pos] = d;
+                        bestIndices[pos] = b0 + j;
+                    }
+                }
+            }
+        }
+    });
+}
@@ -81,13 +81,22 @@ negotiate a licence. Contact details are: parag@pkmital.com
 #pragma once
 
 #include "pkmMatrix.h"
+#include "pkmRunningStatistics.h"
 #include "GestureVariationFollower.h"
 #include <Eigen/Core>
 
+// openFrameworks resolves the save() and load() files in its data folder;
+// define WITHOUT_OF to build without it, relative to the working directory
+#ifndef WITHOUT_OF
 #define WITH_OF
+#endif
 
 #ifdef WITH_OF
 #include "ofMain.h"
+#else
+#include <iostream>
+#include <vector>
+using namespace std;
 #endif
 
 using namespace pkm;
@@ -121,12 +130,15 @@ public:
     // -------------------------------------------------------------------------
     void addToDatabase(Mat &el)
     {
+        PKM_INSTRUMENT_LABEL("pkmGVF::addToDatabase");
         vector<float> lut_el;
         lut_el.push_back(allFeatures.rows);
         allFeatures.push_back(el);
         lut_el.push_back(allFeatures.rows - lut_el[0]);
         lut.push_back(lut_el);
         
+        statistics.push(el);
+        
         numCandidates++;
         bHaveCandidates = true;
     }
@@ -136,12 +148,21 @@ public:
     // -------------------------------------------------------------------------
     void normalizeDatabase()
     {
-        meanFeature = allFeatures.mean();
-        stdFeature = allFeatures.stddev();
+        PKM_INSTRUMENT_LABEL("pkmGVF::normalizeDatabase");
+        // statistics are kept current by addToDatabase() and load(), so
+        // there is no need to rescan allFeatures here; the database is
+        // normalized with the same mean and std dev as normalizeQuery(),
+        // with zNormalizeEachCol()'s EPSILON for constant features
+        statistics.getMeanAndStdDev(meanFeature, stdFeature);
+        stdFeature.add(EPSILON);
         
-        allFeatures.zNormalizeEachCol();
+        allFeatures.zNormalizeEachCol(meanFeature, stdFeature);
         
+#ifdef WITH_OF
         allFeatures.save(ofToDataPath("all-features-normalized.txt"));
+#else
+        allFeatures.save("all-features-normalized.txt");
+#endif
     }
     // -------------------------------------------------------------------------
     
@@ -155,6 +176,7 @@ public:
     // -------------------------------------------------------------------------
     void buildDatabase()
     {
+        PKM_INSTRUMENT_LABEL("pkmGVF::buildDatabase");
         
         for(int i = 0; i < numCandidates; i++)
         {
@@ -187,7 +209,11 @@ public:
         
         gvf->spreadParticles(meanPVRS, rangePVRS);
         
+#ifdef WITH_OF
         gvf->saveTemplates(ofToDataPath("gvf-database.txt"));
+#else
+        gvf->saveTemplates("gvf-database.txt");
+#endif
     }
     // -------------------------------------------------------------------------
     
@@ -203,6 +229,7 @@ public:
             cout << "[ERROR::pkmGVF]: Add sequences to the database first using pkmDTW::addToDatabase(el)!" << endl;
             return;
         }
+        PKM_INSTRUMENT_LABEL("pkmGVF::getNearestCandidate");
         
         normalizeQuery(q);
         
@@ -219,7 +246,10 @@ public:
 //        
 //        gvf->spreadParticles(meanPVRS, rangePVRS);
 
-        gvf->infer(query);
+        {
+            PKM_INSTRUMENT_OP("GestureVariationFollower::infer", 0, 0);
+            gvf->infer(query);
+        }
         int c;
         float i;
         gvf->getEstimatedStatus(c, i);
@@ -241,6 +271,7 @@ public:
             cout << "[ERROR::pkmGVF]: Add sequences to the database first using pkmDTW::addToDatabase(el)!" << endl;
             return;
         }
+        PKM_INSTRUMENT_LABEL("pkmGVF::getNearestCandidate");
         
         Mat qmat(1,numFeatures,q,false);
         normalizeQuery(qmat);
@@ -258,7 +289,10 @@ public:
         //
         //        gvf->spreadParticles(meanPVRS, rangePVRS);
         
-        gvf->infer(query);
+        {
+            PKM_INSTRUMENT_OP("GestureVariationFollower::infer", 0, 0);
+            gvf->infer(query);
+        }
         float i;
         gvf->getEstimatedStatus(subscript, i);
         cout << "gvf | " << subscript << " " << roundf(i*lut.row(subscript)[1]) << "/" << lut.row(subscript)[1] << endl;
@@ -269,8 +303,13 @@ public:
     // -------------------------------------------------------------------------
     void save()
     {
+#ifdef WITH_OF
         allFeatures.save(ofToDataPath("all-features.txt"));
         lut.save(ofToDataPath("all-features-lut.txt"));
+#else
+        allFeatures.save("all-features.txt");
+        lut.save("all-features-lut.txt");
+#endif
     }
     // -------------------------------------------------------------------------
     
@@ -278,8 +317,16 @@ public:
     // -------------------------------------------------------------------------
     void load()
     {
+#ifdef WITH_OF
         allFeatures.load(ofToDataPath("all-features.txt"));
         lut.load(ofToDataPath("all-features-lut.txt"));
+#else
+        allFeatures.load("all-features.txt");
+        lut.load("all-features-lut.txt");
+#endif
+        
+        statistics.reset(allFeatures.cols);
+        statistics.push(allFeatures);
         
         numCandidates = lut.rows;
         
@@ -304,6 +351,7 @@ private:
     Mat allFeatures;
     
     Mat meanFeature, stdFeature;
+    pkmRunningStatistics statistics;
         
     GestureVariationFollower *gvf;
     int numCandidates;
@@ -0,0 +1,837 @@
+// -----------------------------------------------------------------------------
+//  pkmGaussianMixtureEM.cpp
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+
+#include "pkmGaussianMixtureEM.h"
+#include "pkmCovariance.h"
+#include "pkmKMeans.h"
+#include "pkmParallel.h"
+#include <float.h>
+#include <random>
+
+// observations per E-step block, small enough that the scratch for a full
+// covariance model (one GEMM per block) stays in cache
+static const size_t EM_BLOCK_ROWS = 256;
+static const double EM_LOG_2PI = 1.8378770664093453;
+
+// -------------------------------------------------------------------------
+pkmGaussianMixtureEM::pkmGaussianMixtureEM(int nComponents, int type)
+{
+    numComponents = nComponents;
+    covType = type;
+    dimensions = 0;
+    maxIterations = 100;
+    numIterations = 0;
+    tolerance = 1e-3;
+    regularization = 1e-6;
+    seed = 5489u;
+    logLikelihood = -HUGE_VAL;
+    bTrained = false;
+    numBatches = 0;
+    stepDecay = 0.7f;
+}
+
+// -------------------------------------------------------------------------
+double pkmGaussianMixtureEM::train(const Mat &X)
+{
+    if (X.data == NULL || X.rows == 0 || X.cols == 0 || numComponents < 1) {
+        printf("[ERROR]: pkmGaussianMixtureEM::train() needs data and at least 1 component\n");
+        return -HUGE_VAL;
+    }
+    
+    Mat seeds;
+    seedMeans(X, numComponents, seeds);
+    refineMeans(X, seeds);
+    return train(X, seeds);
+}
+
+// -------------------------------------------------------------------------
+double pkmGaussianMixtureEM::train(const Mat &X, const Mat &initialMeans)
+{
+    bTrained = false;
+    numBatches = 0;
+    
+    if (X.data == NULL || X.rows == 0 || X.cols == 0 ||
+        initialMeans.data == NULL || initialMeans.rows == 0 || initialMeans.cols != X.cols) {
+        printf("[ERROR]: pkmGaussianMixtureEM::train() initial means (%lu x %lu) do not match the data (%lu x %lu)\n",
+               initialMeans.rows, initialMeans.cols, X.rows, X.cols);
+        return -HUGE_VAL;
+    }
+    
+    const size_t N = X.rows;
+    numComponents = (int)initialMeans.rows;
+    dimensions = (int)X.cols;
+    const size_t K = numComponents;
+    
+    // start with an M-step from the hard assignment to the initial means
+    std::vector<int> labels;
+    pkmKMeans kmeans;
+    kmeans.setCenters(initialMeans);
+    kmeans.predict(X, labels);
+    
+    Mat resp(N, K, true);
+    for (size_t n = 0; n < N; n++) {
+        resp.data[n * K + labels[n]] = 1.0f;
+    }
+    maximization(X, resp);
+    
+    Mat logResp, rowLikelihoods;
+    double previous = -HUGE_VAL;
+    bool bConverged = false;
+    
+    for (numIterations = 0; numIterations < maxIterations; numIterations++)
+    {
+        logLikelihood = expectation(X, logResp, rowLikelihoods);
+        
+        if (fabs(logLikelihood - previous) / (double)N < tolerance) {
+            bConverged = true;
+            break;
+        }
+        previous = logLikelihood;
+        
+        pkm::vectorExp(resp.data, logResp.data, N * K);
+        maximization(X, resp);
+    }
+    
+    // the last M-step has not been scored yet
+    if (!bConverged) {
+        logLikelihood = expectation(X, logResp, rowLikelihoods);
+    }
+    
+    bTrained = true;
+    return logLikelihood;
+}
+
+// -------------------------------------------------------------------------
+double pkmGaussianMixtureEM::partialFit(const Mat &X)
+{
+    if (X.data == NULL || X.rows == 0 || X.cols == 0) {
+        return 0;
+    }
+    
+    const size_t N = X.rows;
+    Mat logResp, rowLikelihoods, resp;
+    std::vector<double> s0, s1, s2;
+    double batchLikelihood;
+    
+    if (numBatches == 0 || !bTrained || X.cols != (size_t)dimensions)
+    {
+        // start from a batch fit of the first batch
+        if (N < (size_t)numComponents) {
+            printf("[ERROR]: pkmGaussianMixtureEM::partialFit() first batch has %lu rows for %d components\n", N, numComponents);
+            return -HUGE_VAL;
+        }
+        train(X);
+        batchLikelihood = expectation(X, logResp, rowLikelihoods);
+        resp = Mat(N, numComponents);
+        pkm::vectorExp(resp.data, logResp.data, N * numComponents);
+        batchStatistics(X, resp, statWeights, statSums, statSquares);
+        numBatches = 1;
+    }
+    else
+    {
+        batchLikelihood = expectation(X, logResp, rowLikelihoods);
+        resp = Mat(N, numComponents);
+        pkm::vectorExp(resp.data, logResp.data, N * numComponents);
+        batchStatistics(X, resp, s0, s1, s2);
+        
+        double eta = pow((double)numBatches + 1.0, -(double)stepDecay);
+        for (size_t i = 0; i < s0.size(); i++) {
+            statWeights[i] += eta * (s0[i] - statWeights[i]);
+        }
+        for (size_t i = 0; i < s1.size(); i++) {
+            statSums[i] += eta * (s1[i] - statSums[i]);
+        }
+        for (size_t i = 0; i < s2.size(); i++) {
+            statSquares[i] += eta * (s2[i] - statSquares[i]);
+        }
+        numBatches++;
+    }
+    
+    updateFromStatistics();
+    logLikelihood = batchLikelihood;
+    return batchLikelihood;
+}
+
+// -------------------------------------------------------------------------
+double pkmGaussianMixtureEM::trainMiniBatch(const Mat &X, size_t batchSize, int epochs)
+{
+    batchSize = std::max<size_t>(batchSize, numComponents);
+    double total = 0;
+    for (int epoch = 0; epoch < epochs; epoch++)
+    {
+        total = 0;
+        size_t r0 = 0;
+        while (r0 < X.rows)
+        {
+            size_t r1 = std::min(r0 + batchSize, (size_t)X.rows);
+            total += partialFit(Mat(r1 - r0, X.cols, X.data + r0 * X.cols, false));
+            r0 = r1;
+        }
+    }
+    return total;
+}
+
+// -------------------------------------------------------------------------
+size_t pkmGaussianMixtureEM::trainStream(FILE *fp, size_t batchSize)
+{
+    unsigned long rows = 0, cols = 0;
+    if (fp == NULL || fscanf(fp, "%lu %lu\n", &rows, &cols) != 2 || cols == 0) {
+        printf("[ERROR]: pkmGaussianMixtureEM::trainStream() could not read the \"rows cols\" header\n");
+        return 0;
+    }
+    
+    batchSize = std::max<size_t>(batchSize, numComponents);
+    Mat batch(batchSize, cols);
+    size_t numRead = 0;
+    while (numRead < rows)
+    {
+        size_t n = 0;
+        bool bEOF = false;
+        for (; n < batchSize && numRead + n < rows && !bEOF; n++) {
+            for (size_t j = 0; j < cols; j++) {
+                if (fscanf(fp, "%f, ", &batch.data[n * cols + j]) != 1) {
+                    bEOF = true;
+                    break;
+                }
+            }
+        }
+        if (bEOF) {
+            n--;
+        }
+        if (n == 0) {
+            break;
+        }
+        partialFit(batch.rowRange(0, n, false));
+        numRead += n;
+        if (bEOF) {
+            break;
+        }
+    }
+    return numRead;
+}
+
+// -------------------------------------------------------------------------
+void pkmGaussianMixtureEM::weightedLogDensities(const Mat &X, Mat &logProb) const
+{
+    const size_t N = X.rows, K = numComponents;
+    if (X.cols != (size_t)dimensions) {
+        printf("[ERROR]: pkmGaussianMixtureEM::weightedLogDensities() expected %d dimensions, got %lu\n", dimensions, X.cols);
+        return;
+    }
+    if (logProb.rows != N || logProb.cols != K) {
+        logProb = Mat(N, K);
+    }
+    
+    const size_t numBlocks = (N + EM_BLOCK_ROWS - 1) / EM_BLOCK_ROWS;
+    parallelFor(0, numBlocks, 1, [&](size_t b0, size_t b1) {
+        std::vector<float> scratch;
+        for (size_t b = b0; b < b1; b++) {
+            size_t r0 = b * EM_BLOCK_ROWS;
+            size_t n = std::min(EM_BLOCK_ROWS, N - r0);
+            estimateBlock(X.data + r0 * dimensions, n, logProb.data + r0 * K, scratch);
+        }
+    });
+}
+
+// -------------------------------------------------------------------------
+double pkmGaussianMixtureEM::expectation(const Mat &X, Mat &logResp, Mat &rowLikelihoods) const
+{
+    const size_t N = X.rows, K = numComponents;
+    if (X.cols != (size_t)dimensions) {
+        printf("[ERROR]: pkmGaussianMixtureEM::expectation() expected %d dimensions, got %lu\n", dimensions, X.cols);
+        return -HUGE_VAL;
+    }
+    if (logResp.rows != N || logResp.cols != K) {
+        logResp = Mat(N, K);
+    }
+    if (rowLikelihoods.rows != N || rowLikelihoods.cols != 1) {
+        rowLikelihoods = Mat(N, 1);
+    }
+    
+    // partial sums per block, added in order so the result does not depend
+    // on the number of threads
+    const size_t numBlocks = (N + EM_BLOCK_ROWS - 1) / EM_BLOCK_ROWS;
+    std::vector<double> partial(numBlocks, 0.0);
+    
+    parallelFor(0, numBlocks, 1, [&](size_t b0, size_t b1) {
+        std::vector<float> scratch;
+        for (size_t b = b0; b < b1; b++) {
+            size_t r0 = b * EM_BLOCK_ROWS;
+            size_t n = std::min(EM_BLOCK_ROWS, N - r0);
+            float *lp = logResp.data + r0 * K;
+            estimateBlock(X.data + r0 * dimensions, n, lp, scratch);
+            
+            double sum = 0;
+            for (size_t i = 0; i < n; i++, lp += K) {
+                float lse = pkm::vectorLogSumExp(lp, K);
+                rowLikelihoods.data[r0 + i] = lse;
+                for (size_t k = 0; k < K; k++) {
+                    lp[k] -= lse;
+                }
+                sum += lse;
+            }
+            partial[b] = sum;
+        }
+    });
+    
+    double total = 0;
+    for (size_t b = 0; b < numBlocks; b++) {
+        total += partial[b];
+    }
+    return total;
+}
+
+// -------------------------------------------------------------------------
+void pkmGaussianMixtureEM::predict(const Mat &X, std::vector<int> &labels) const
+{
+    const size_t N = X.rows, K = numComponents;
+    if (X.cols != (size_t)dimensions) {
+        printf("[ERROR]: pkmGaussianMixtureEM::predict() expected %d dimensions, got %lu\n", dimensions, X.cols);
+        return;
+    }
+    labels.resize(N);
+    
+    // the posterior argmax is the argmax of log(w_k) + log N(x | k), so no
+    // normalization is needed
+    const size_t numBlocks = (N + EM_BLOCK_ROWS - 1) / EM_BLOCK_ROWS;
+    parallelFor(0, numBlocks, 1, [&](size_t b0, size_t b1) {
+        std::vector<float> scratch, logProb(EM_BLOCK_ROWS * K);
+        for (size_t b = b0; b < b1; b++) {
+            size_t r0 = b * EM_BLOCK_ROWS;
+            size_t n = std::min(EM_BLOCK_ROWS, N - r0);
+            estimateBlock(X.data + r0 * dimensions, n, &logProb[0], scratch);
+            for (size_t i = 0; i < n; i++) {
+                const float *lp = &logProb[i * K];
+                labels[r0 + i] = (int)(std::max_element(lp, lp + K) - lp);
+            }
+        }
+    });
+}
+
+// -------------------------------------------------------------------------
+void pkmGaussianMixtureEM::maximization(const Mat &X, const Mat &resp)
+{
+    const size_t N = X.rows, D = X.cols, K = resp.cols;
+    if (resp.rows != N || K == 0) {
+        printf("[ERROR]: pkmGaussianMixtureEM::maximization() responsibilities (%lu x %lu) do not match the data (%lu x %lu)\n",
+               resp.rows, resp.cols, N, D);
+        return;
+    }
+    numComponents = (int)K;
+    dimensions = (int)D;
+    
+    // effective number of observations per component
+    Mat Nk(1, K, true);
+    {
+        Mat ones(N, 1, 1.0f);
+        cblas_sgemv(CblasRowMajor, CblasTrans, (int)N, (int)K, 1.0f, resp.data, (int)K,
+                    ones.data, 1, 0.0f, Nk.data, 1);
+    }
+    weights = Mat(1, K);
+    for (size_t k = 0; k < K; k++) {
+        Nk.data[k] += 10.0f * FLT_EPSILON;
+        weights.data[k] = Nk.data[k] / (float)N;
+    }
+    
+    // means = resp^T X / Nk
+    means = Mat(K, D);
+    cblas_sgemm(CblasRowMajor, CblasTrans, CblasNoTrans, (int)K, (int)D, (int)N,
+                1.0f, resp.data, (int)K, X.data, (int)D, 0.0f, means.data, (int)D);
+    for (size_t k = 0; k < K; k++) {
+        float scale = 1.0f / Nk.data[k];
+        vDSP_vsmul(means.data + k * D, 1, &scale, means.data + k * D, 1, D);
+    }
+    
+    if (covType == COV_GENERIC)
+    {
+        // Sigma_k = sum_n r_nk (x_n - mu_k)(x_n - mu_k)^T / Nk, centered and
+        // accumulated with SYRK over row blocks in parallel
+        covariances = Mat(K, D * D);
+        CovarianceAccumulator statistics;
+        Mat Ck;
+        for (size_t k = 0; k < K; k++)
+        {
+            accumulateCovariance(X, statistics, resp.data + k, K);
+            statistics.covariance(Ck, 0.0);
+            float *C = covariances.data + k * D * D;
+            cblas_scopy((int)(D * D), Ck.data, 1, C, 1);
+            for (size_t i = 0; i < D; i++) {
+                C[i * D + i] += regularization;
+            }
+        }
+    }
+    else
+    {
+        // sigma^2 = sum_n r_nk (x_n - mu_k)^2 / Nk, about the mean rather
+        // than E[x^2] - mu^2, which cancels badly in float
+        Mat variances(K, D);
+        Mat weighted(N, D);
+        Mat ones(N, 1, 1.0f);
+        for (size_t k = 0; k < K; k++)
+        {
+            const float *mu = means.data + k * D;
+            parallelFor(0, N, parallelRowGrain(D), [&](size_t r0, size_t r1) {
+                for (size_t n = r0; n < r1; n++) {
+                    float r = resp.data[n * K + k];
+                    const float *x = X.data + n * D;
+                    float *y = weighted.data + n * D;
+                    for (size_t d = 0; d < D; d++) {
+                        float v = x[d] - mu[d];
+                        y[d] = r * v * v;
+                    }
+                }
+            });
+            float *var = variances.data + k * D;
+            cblas_sgemv(CblasRowMajor, CblasTrans, (int)N, (int)D, 1.0f / Nk.data[k], weighted.data, (int)D,
+                        ones.data, 1, 0.0f, var, 1);
+            for (size_t d = 0; d < D; d++) {
+                var[d] += regularization;
+            }
+        }
+        
+        if (covType == COV_DIAGONAL) {
+            covariances = variances;
+        }
+        else {
+            covariances = Mat(K, 1);
+            for (size_t k = 0; k < K; k++) {
+                float sum = 0;
+                vDSP_sve(variances.data + k * D, 1, &sum, D);
+                covariances.data[k] = sum / (float)D;
+            }
+        }
+    }
+    
+    if (!updatePrecisions()) {
+        printf("[ERROR]: pkmGaussianMixtureEM::maximization() covariance is not positive definite, try a larger regularization\n");
+    }
+}
+
+// -------------------------------------------------------------------------
+void pkmGaussianMixtureEM::batchStatistics(const Mat &X, const Mat &resp, std::vector<double> &s0,
+                                           std::vector<double> &s1, std::vector<double> &s2) const
+{
+    const size_t N = X.rows, D = dimensions, K = numComponents;
+    const size_t squares = (covType == COV_GENERIC) ? D * D : D;
+    s0.assign(K, 0.0);
+    s1.assign(K * D, 0.0);
+    s2.assign(K * squares, 0.0);
+    
+    // sums of r, r (x - mu) and r (x - mu)(x - mu)^T about the current mu
+    const size_t numBlocks = (N + EM_BLOCK_ROWS - 1) / EM_BLOCK_ROWS;
+    std::vector<std::vector<double> > partial(numBlocks);
+    parallelFor(0, numBlocks, 1, [&](size_t b0, size_t b1) {
+        std::vector<float> centered(EM_BLOCK_ROWS * D);
+        std::vector<float> outer(D * D);
+        for (size_t b = b0; b < b1; b++)
+        {
+            size_t r0 = b * EM_BLOCK_ROWS;
+            size_t n = std::min(EM_BLOCK_ROWS, N - r0);
+            std::vector<double> &acc = partial[b];
+            acc.assign(K * (1 + D + squares), 0.0);
+            
+            for (size_t k = 0; k < K; k++)
+            {
+                const float *mu = means.data + k * D;
+                double *a0 = &acc[k], *a1 = &acc[K + k * D], *a2 = &acc[K + K * D + k * squares];
+                for (size_t i = 0; i < n; i++) {
+                    const float *x = X.data + (r0 + i) * D;
+                    float r = resp.data[(r0 + i) * K + k];
+                    float w = sqrtf(r);
+                    float *c = &centered[i * D];
+                    *a0 += r;
+                    for (size_t d = 0; d < D; d++) {
+                        float v = x[d] - mu[d];
+                        a1[d] += r * v;
+                        c[d] = w * v;
+                    }
+                }
+                if (covType == COV_GENERIC) {
+                    cblas_ssyrk(CblasRowMajor, CblasUpper, CblasTrans, (int)D, (int)n,
+                                1.0f, &centered[0], (int)D, 0.0f, &outer[0], (int)D);
+                    for (size_t i = 0; i < D; i++) {
+                        for (size_t j = i; j < D; j++) {
+                            a2[i * D + j] += outer[i * D + j];
+                        }
+                    }
+                }
+                else {
+                    for (size_t i = 0; i < n; i++) {
+                        const float *c = &centered[i * D];
+                        for (size_t d = 0; d < D; d++) {
+                            a2[d] += c[d] * c[d];
+                        }
+                    }
+                }
+            }
+        }
+    });
+    
+    for (size_t b = 0; b < numBlocks; b++) {
+        const std::vector<double> &acc = partial[b];
+        for (size_t k = 0; k < K; k++) {
+            s0[k] += acc[k];
+        }
+        for (size_t i = 0; i < K * D; i++) {
+            s1[i] += acc[K + i];
+        }
+        for (size_t i = 0; i < K * squares; i++) {
+            s2[i] += acc[K + K * D + i];
+        }
+    }
+    
+    // back to raw moments about the origin, per observation:
+    // sum r x x^T = sum r c c^T + b mu^T + mu b^T + s0 mu mu^T, b = sum r c
+    const double invN = 1.0 / (double)N;
+    for (size_t k = 0; k < K; k++)
+    {
+        const float *mu = means.data + k * D;
+        double *b = &s1[k * D], *S = &s2[k * squares];
+        if (covType == COV_GENERIC) {
+            for (size_t i = 0; i < D; i++) {
+                for (size_t j = i; j < D; j++) {
+                    double v = S[i * D + j] + b[i] * mu[j] + mu[i] * b[j] + s0[k] * mu[i] * mu[j];
+                    S[i * D + j] = S[j * D + i] = v * invN;
+                }
+            }
+        }
+        else {
+            for (size_t d = 0; d < D; d++) {
+                S[d] = (S[d] + 2.0 * b[d] * mu[d] + s0[k] * mu[d] * mu[d]) * invN;
+            }
+        }
+        for (size_t d = 0; d < D; d++) {
+            b[d] = (b[d] + s0[k] * mu[d]) * invN;
+        }
+        s0[k] *= invN;
+    }
+}
+
+// -------------------------------------------------------------------------
+void pkmGaussianMixtureEM::updateFromStatistics()
+{
+    const size_t K = numComponents, D = dimensions;
+    
+    double total = 0;
+    for (size_t k = 0; k < K; k++) {
+        total += statWeights[k];
+    }
+    
+    weights = Mat(1, K);
+    means = Mat(K, D);
+    std::vector<double> mu(D);
+    for (size_t k = 0; k < K; k++)
+    {
+        // the statistics are raw moments, so nk must not be perturbed
+        double nk = std::max(statWeights[k], DBL_MIN);
+        weights.data[k] = statWeights[k] / total;
+        for (size_t d = 0; d < D; d++) {
+            mu[d] = statSums[k * D + d] / nk;
+            means.data[k * D + d] = mu[d];
+        }
+        
+        if (covType == COV_GENERIC) {
+            if (k == 0) {
+                covariances = Mat(K, D * D);
+            }
+            const double *S = &statSquares[k * D * D];
+            float *C = covariances.data + k * D * D;
+            for (size_t i = 0; i < D; i++) {
+                for (size_t j = 0; j < D; j++) {
+                    C[i * D + j] = S[i * D + j] / nk - mu[i] * mu[j];
+                }
+                C[i * D + i] = std::max(C[i * D + i], 0.0f) + regularization;
+            }
+        }
+        else {
+            const double *S = &statSquares[k * D];
+            if (k == 0) {
+                covariances = (covType == COV_DIAGONAL) ? Mat(K, D) : Mat(K, 1);
+            }
+            double sum = 0;
+            for (size_t d = 0; d < D; d++) {
+                double v = std::max(S[d] / nk - mu[d] * mu[d], 0.0) + regularization;
+                if (covType == COV_DIAGONAL) {
+                    covariances.data[k * D + d] = v;
+                }
+                sum += v;
+            }
+            if (covType == COV_SPHERICAL) {
+                covariances.data[k] = sum / (double)D;
+            }
+        }
+    }
+    
+    if (!updatePrecisions()) {
+        printf("[ERROR]: pkmGaussianMixtureEM::partialFit() covariance is not positive definite, try a larger regularization\n");
+    }
+}
+
+// -------------------------------------------------------------------------
+bool pkmGaussianMixtureEM::updatePrecisions()
+{
+    const size_t K = numComponents, D = dimensions;
+    bool bSuccess = true;
+    
+    logNormalizers = Mat(1, K);
+    
+    if (covType == COV_GENERIC)
+    {
+        precisionFactors = Mat(D, K * D, true);
+        precisionOffsets = Mat(1, K * D, true);
+        std::vector<float> A(D * D);
+        
+        for (size_t k = 0; k < K; k++)
+        {
+            float *C = covariances.data + k * D * D;
+            
+            // Sigma is symmetric, so the row-major data is also its
+            // column-major form: factor Sigma = U^T U, adding to the
+            // diagonal until it is positive definite
+            __CLPK_integer n = (__CLPK_integer)D, info = 0;
+            float extra = 0;
+            for (int attempt = 0; attempt < 8; attempt++) {
+                std::copy(C, C + D * D, A.begin());
+                for (size_t i = 0; i < D; i++) {
+                    A[i * D + i] += extra;
+                }
+                char uplo = 'U';
+                spotrf_(&uplo, &n, &A[0], &n, &info);
+                if (info == 0) {
+                    break;
+                }
+                extra = (extra == 0) ? std::max(regularization, 1e-6f) * 10.0f : extra * 10.0f;
+            }
+            if (info != 0) {
+                bSuccess = false;
+                logNormalizers.data[k] = -HUGE_VALF;
+                continue;
+            }
+            for (size_t i = 0; i < D && extra > 0; i++) {
+                C[i * D + i] += extra;
+            }
+            
+            double logDet = 0;
+            for (size_t i = 0; i < D; i++) {
+                logDet += 2.0 * log((double)A[i * D + i]);
+            }
+            logNormalizers.data[k] = log((double)weights.data[k]) - 0.5 * ((double)D * EM_LOG_2PI + logDet);
+            
+            // U^-1 (column-major, upper) is the row-major P = L^-T, with
+            // Sigma^-1 = P P^T; the strict lower half still holds Sigma
+            char uplo = 'U', diag = 'N';
+            strtri_(&uplo, &diag, &n, &A[0], &n, &info);
+            
+            const float *mu = means.data + k * D;
+            for (size_t r = 0; r < D; r++) {
+                float *P = precisionFactors.data + r * K * D + k * D;
+                for (size_t c = r; c < D; c++) {
+                    P[c] = A[r + c * D];
+                }
+            }
+            for (size_t c = 0; c < D; c++) {
+                float sum = 0;
+                for (size_t r = 0; r <= c; r++) {
+                    sum += mu[r] * precisionFactors.data[r * K * D + k * D + c];
+                }
+                precisionOffsets.data[k * D + c] = sum;
+            }
+        }
+    }
+    else
+    {
+        precisionFactors = Mat(K, D);
+        precisionOffsets = Mat();
+        
+        for (size_t k = 0; k < K; k++)
+        {
+            double logDet = 0;
+            for (size_t d = 0; d < D; d++) {
+                float var = (covType == COV_DIAGONAL) ? covariances.data[k * D + d] : covariances.data[k];
+                precisionFactors.data[k * D + d] = 1.0f / var;
+                logDet += log((double)var);
+            }
+            logNormalizers.data[k] = log((double)weights.data[k]) - 0.5 * ((double)D * EM_LOG_2PI + logDet);
+        }
+    }
+    
+    return bSuccess;
+}
+
+// -------------------------------------------------------------------------
+void pkmGaussianMixtureEM::estimateBlock(const float *x, size_t n, float *logProb, std::vector<float> &scratch) const
+{
+    const size_t K = numComponents, D = dimensions;
+    
+    if (covType == COV_GENERIC)
+    {
+        // y = x [P_1 ... P_K] for every component at once, then
+        // |y_k - mu_k P_k|^2 is the Mahalanobis distance
+        const size_t KD = K * D;
+        scratch.resize(n * KD);
+        cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, (int)n, (int)KD, (int)D,
+                    1.0f, x, (int)D, precisionFactors.data, (int)KD, 0.0f, &scratch[0], (int)KD);
+        
+        for (size_t i = 0; i < n; i++) {
+            const float *y = &scratch[i * KD];
+            for (size_t k = 0; k < K; k++) {
+                const float *yk = y + k * D, *ok = precisionOffsets.data + k * D;
+                float maha = 0;
+                for (size_t d = 0; d < D; d++) {
+                    float v = yk[d] - ok[d];
+                    maha += v * v;
+                }
+                logProb[i * K + k] = logNormalizers.data[k] - 0.5f * maha;
+            }
+        }
+    }
+    else
+    {
+        // sum((x - mu)^2 / sigma^2) on the block transposed to dimensions x n,
+        // so the inner loop runs over contiguous observations
+        scratch.resize(n * (D + 1));
+        float *xt = &scratch[0], *maha = &scratch[n * D];
+        vDSP_mtrans(x, 1, xt, 1, D, n);
+        for (size_t k = 0; k < K; k++) {
+            const float *mu = means.data + k * D, *prec = precisionFactors.data + k * D;
+            std::fill(maha, maha + n, 0.0f);
+            for (size_t d = 0; d < D; d++) {
+                const float *xd = xt + d * n;
+                float m = mu[d], p = prec[d];
+                for (size_t i = 0; i < n; i++) {
+                    float v = xd[i] - m;
+                    maha[i] += v * v * p;
+                }
+            }
+            for (size_t i = 0; i < n; i++) {
+                logProb[i * K + k] = logNormalizers.data[k] - 0.5f * maha[i];
+            }
+        }
+    }
+}
+
+// -------------------------------------------------------------------------
+void pkmGaussianMixtureEM::seedMeans(const Mat &X, size_t numSeeds, Mat &seeds) const
+{
+    pkmKMeans kmeans;
+    kmeans.setSeed(seed);
+    kmeans.seed(X, numSeeds, seeds);
+}
+
+// -------------------------------------------------------------------------
+void pkmGaussianMixtureEM::refineMeans(const Mat &X, Mat &means, int iterations) const
+{
+    pkmKMeans kmeans;
+    kmeans.setMaxIterations(iterations);
+    kmeans.train(X, means);
+    means = kmeans.getCenters();
+}
+
+// -------------------------------------------------------------------------
+Mat pkmGaussianMixtureEM::getCovariance(int k) const
+{
+    const size_t D = dimensions;
+    Mat C(D, D, true);
+    if (k < 0 || k >= numComponents || covariances.data == NULL) {
+        return C;
+    }
+    if (covType == COV_GENERIC) {
+        std::copy(covariances.data + k * D * D, covariances.data + (k + 1) * D * D, C.data);
+    }
+    else {
+        for (size_t d = 0; d < D; d++) {
+            C.data[d * D + d] = (covType == COV_DIAGONAL) ? covariances.data[k * D + d] : covariances.data[k];
+        }
+    }
+    return C;
+}
+
+// -------------------------------------------------------------------------
+int pkmGaussianMixtureEM::getNumParameters() const
+{
+    int K = numComponents, D = dimensions;
+    int covParams = (covType == COV_GENERIC) ? K * D * (D + 1) / 2 :
+                    (covType == COV_DIAGONAL) ? K * D : K;
+    return covParams + K * D + (K - 1);
+}
+
+// -------------------------------------------------------------------------
+double pkmGaussianMixtureEM::getBIC(size_t numObservations) const
+{
+    return -2.0 * logLikelihood + (double)getNumParameters() * log((double)numObservations);
+}
@@ -0,0 +1,272 @@
+// -----------------------------------------------------------------------------
+//  pkmGaussianMixtureEM.h
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "pkmMatrix.h"
+#include <vector>
+#include <stdio.h>
+
+using namespace pkm;
+
+// -----------------------------------------------------------------------------
+//  Expectation-Maximization for a Gaussian mixture on pkm::Mat, for any number
+//  of dimensions, with spherical, diagonal or full (generic) covariances.
+//
+//  Everything is computed in float log-space: the E-step evaluates
+//  log(w_k) + log N(x | mu_k, Sigma_k) for blocks of observations and
+//  normalizes with log-sum-exp, so that high dimensional data does not
+//  underflow.  Full covariances use a single GEMM per block against the
+//  (Cholesky factored) precisions of all components; spherical and diagonal
+//  ones accumulate the weighted squared distances over the transposed block,
+//  one contiguous pass per dimension.  Blocks are spread across threads.
+// -----------------------------------------------------------------------------
+class pkmGaussianMixtureEM
+{
+public:
+    // same values as pkmGaussianMixtureModel's covariance types
+    enum {COV_SPHERICAL, COV_DIAGONAL, COV_GENERIC};
+    
+    // -------------------------------------------------------------------------
+    pkmGaussianMixtureEM(int nComponents = 1, int covType = COV_GENERIC);
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    void setNumComponents(int k)                { numComponents = k; bTrained = false; }
+    void setCovarianceType(int type)            { covType = type; bTrained = false; }
+    
+    // added to the diagonal of every covariance, necessary for small data
+    void setRegularization(float r)             { regularization = r; }
+    
+    // stop after 'maxIter' iterations, or when the mean log-likelihood per
+    // observation changes by less than 'epsilon'
+    void setTermination(int maxIter, float epsilon)
+    {
+        maxIterations = maxIter;
+        tolerance = epsilon;
+    }
+    
+    // seed for the random k-means++ initialisation
+    void setSeed(unsigned long s)               { seed = s; }
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  Fit the mixture to 'X' (observations x dimensions), initialising the
+    //  means with k-means++ (or with 'initialMeans', components x dimensions).
+    //  Returns the total log-likelihood of X under the fitted model.
+    // -------------------------------------------------------------------------
+    double train(const Mat &X);
+    double train(const Mat &X, const Mat &initialMeans);
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  Online (stepwise) EM: each call runs an E-step on the batch and blends
+    //  its sufficient statistics into running ones with step size
+    //  (t + 1)^-decay, t being the number of batches seen, then re-estimates
+    //  the parameters.  Only the statistics are kept, so memory does not grow
+    //  with the data.  The first batch is fit with batch EM (train()) and
+    //  must have at least as many rows as components.  Returns the
+    //  log-likelihood of the batch under the parameters before the update.
+    // -------------------------------------------------------------------------
+    double partialFit(const Mat &X);
+    
+    // partialFit over consecutive 'batchSize' rows of X, 'epochs' times
+    double trainMiniBatch(const Mat &X, size_t batchSize, int epochs = 1);
+    
+    // partialFit over a file written by Mat::save ("rows cols" then the
+    // values), reading 'batchSize' rows at a time; returns the number of
+    // observations read
+    size_t trainStream(FILE *fp, size_t batchSize);
+    
+    // 0.5 < decay <= 1; smaller values forget old batches faster
+    void setStepDecay(float decay)              { stepDecay = decay; }
+    size_t getNumBatches() const                { return numBatches; }
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  k-means++ seeding of 'numSeeds' means from the rows of X (see
+    //  pkmKMeans).  The first k rows of the result are themselves a k-means++
+    //  seeding for k means, so one call can initialise a whole sweep over the
+    //  number of components.
+    // -------------------------------------------------------------------------
+    void seedMeans(const Mat &X, size_t numSeeds, Mat &seeds) const;
+    
+    // a few k-means iterations moving 'means' towards the data
+    void refineMeans(const Mat &X, Mat &means, int iterations = 10) const;
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  'logProb' (observations x components) is set to
+    //  log(w_k) + log N(x_n | mu_k, Sigma_k)
+    // -------------------------------------------------------------------------
+    void weightedLogDensities(const Mat &X, Mat &logProb) const;
+    
+    // -------------------------------------------------------------------------
+    //  E-step: 'logResp' (observations x components) is set to the log
+    //  posterior of each component, and 'logLikelihood' (observations x 1) to
+    //  the log-likelihood of each observation.  Returns their sum.
+    // -------------------------------------------------------------------------
+    double expectation(const Mat &X, Mat &logResp, Mat &logLikelihood) const;
+    
+    // index of the most probable component of each observation
+    void predict(const Mat &X, std::vector<int> &labels) const;
+    
+    // -------------------------------------------------------------------------
+    //  M-step from responsibilities 'resp' (observations x components, i.e.
+    //  exp(logResp)); updates the weights, means, covariances and the cached
+    //  precision factors
+    // -------------------------------------------------------------------------
+    void maximization(const Mat &X, const Mat &resp);
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    int         getNumComponents() const        { return numComponents; }
+    int         getDimensions() const           { return dimensions; }
+    int         getCovarianceType() const       { return covType; }
+    int         getNumIterations() const        { return numIterations; }
+    double      getLogLikelihood() const        { return logLikelihood; }
+    bool        isTrained() const               { return bTrained; }
+    
+    // 1 x components
+    const Mat & getWeights() const              { return weights; }
+    // components x dimensions
+    const Mat & getMeans() const                { return means; }
+    // dimensions x dimensions, for any covariance type
+    Mat         getCovariance(int k) const;
+    
+    // number of free parameters, and the Bayesian Information Criterion of
+    // the last fit (lower is better)
+    int         getNumParameters() const;
+    double      getBIC(size_t numObservations) const;
+    // -------------------------------------------------------------------------
+    
+protected:
+    // -------------------------------------------------------------------------
+    // factor the covariances into the precision terms used by the E-step;
+    // returns false if a covariance could not be factored even after
+    // increasing the regularization
+    bool        updatePrecisions();
+    
+    // sum_n r_nk, sum_n r_nk x_n and sum_n r_nk x_n x_n^T (only the diagonal
+    // unless COV_GENERIC) of the batch, in double and divided by the batch
+    // size; computed about the current means to avoid cancellation
+    void        batchStatistics(const Mat &X, const Mat &resp, std::vector<double> &s0,
+                                std::vector<double> &s1, std::vector<double> &s2) const;
+    
+    // weights, means and covariances from the running statistics
+    void        updateFromStatistics();
+    
+    // log(w_k) + log N(x | k) for 'n' contiguous observations starting at 'x'
+    void        estimateBlock(const float *x, size_t n, float *logProb, std::vector<float> &scratch) const;
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    int         numComponents;
+    int         dimensions;
+    int         covType;
+    int         maxIterations;
+    int         numIterations;
+    float       tolerance;
+    float       regularization;
+    unsigned long seed;
+    double      logLikelihood;
+    bool        bTrained;
+    
+    Mat         weights;            // 1 x K
+    Mat         means;              // K x D
+    
+    // COV_GENERIC: K x (D*D), COV_DIAGONAL: K x D, COV_SPHERICAL: K x 1
+    Mat         covariances;
+    
+    // log(w_k) - 0.5 * (D log(2 pi) + log|Sigma_k|), 1 x K
+    Mat         logNormalizers;
+    
+    // COV_GENERIC: the upper triangular P_k = L_k^-T (Sigma_k = L_k L_k^T)
+    // of every component side by side, D x (K*D), and mu_k P_k, 1 x (K*D),
+    // so that |(x - mu_k) P_k|^2 is the Mahalanobis distance.
+    // COV_DIAGONAL/SPHERICAL: 1 / sigma^2, K x D, and no offsets
+    Mat         precisionFactors;
+    Mat         precisionOffsets;
+    
+    // running sufficient statistics for partialFit
+    std::vector<double> statWeights, statSums, statSquares;
+    size_t      numBatches;
+    float       stepDecay;
+    // -------------------------------------------------------------------------
+};
@@ -0,0 +1,465 @@
+// -----------------------------------------------------------------------------
+//  pkmInstrument.h
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+// -----------------------------------------------------------------------------
+//  Opt-in instrumentation of pkm::Mat and the pipelines built on it.
+//
+//  Everything here compiles to nothing unless PKM_INSTRUMENT is defined for
+//  every translation unit (e.g. -DPKM_INSTRUMENT).  When it is, each
+//  instrumented operation adds its call, its nominal bytes (allocated,
+//  copied or streamed through), its estimated FLOPs and its elapsed time to
+//  counters owned by the calling thread, under the innermost label in scope:
+//
+//      {
+//          PKM_INSTRUMENT_LABEL("pkmDTW::dtw");
+//          ...         // Mat operations here are attributed to pkmDTW::dtw
+//      }
+//      pkm::instrument::report();      // or snapshot() for the records
+//
+//  Times are inclusive: an operation that calls others (push_back growing
+//  its storage, getInv copying before inverting) also counts their time, and
+//  a label's "total" is the time of its whole scope, nested labels included.
+//  Chunks of a parallelFor count under their caller's label, whichever thread
+//  runs them.
+//
+//  With PKM_TRACE defined, the same labels and operations are also recorded
+//  as timeline spans; see pkmTrace.h.
+// -----------------------------------------------------------------------------
+
+#include "pkmTrace.h"
+
+#define PKM_INSTRUMENT_CONCAT_(a, b) a##b
+#define PKM_INSTRUMENT_CONCAT(a, b) PKM_INSTRUMENT_CONCAT_(a, b)
+
+#ifdef PKM_INSTRUMENT
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdio.h>
+#include <stdint.h>
+
+namespace pkm
+{
+    namespace instrument
+    {
+        // operations and labels past these share a final "other" slot
+        static const int MAX_OPERATIONS = 96;
+        static const int MAX_LABELS = 32;
+        
+        struct Record
+        {
+            std::string label, operation;
+            uint64_t calls;
+            double bytes, flops, seconds;
+        };
+        
+        // only the owning thread adds to a Counter, so relaxed loads and
+        // stores suffice; snapshot() may read a count one update behind
+        struct Counter
+        {
+            std::atomic<uint64_t> calls, bytes, flops, nanoseconds;
+        };
+        
+        inline void accumulate(std::atomic<uint64_t> &counter, uint64_t value)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+        
+        // -------------------------------------------------------------------------
+        //  names of operations and labels, the live threads' counters, and the
+        //  totals of threads that have exited
+        // -------------------------------------------------------------------------
+        class Registry
+        {
+        public:
+            static Registry & get()
+            {
+                static Registry registry;
+                return registry;
+            }
+            
+            int operationId(const char *name)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                return id(operations, MAX_OPERATIONS, name);
+            }
+            
+            int labelId(const char *name)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                return id(labels, MAX_LABELS, name);
+            }
+            
+            void attach(Counter *counters)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                threads.push_back(counters);
+            }
+            
+            // a thread's counters are folded into the totals as it exits
+            void detach(Counter *counters)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                add(counters, retired);
+                threads.erase(std::remove(threads.begin(), threads.end(), counters), threads.end());
+            }
+            
+            std::vector<Record> snapshot()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::vector<uint64_t> totals(retired);
+                for (size_t t = 0; t < threads.size(); t++) {
+                    add(threads[t], totals);
+                }
+                std::vector<Record> records;
+                for (size_t l = 0; l < labels.size(); l++) {
+                    for (size_t o = 0; o < operations.size(); o++) {
+                        const uint64_t *total = &totals[4 * (l * MAX_OPERATIONS + o)];
+                        if (total[0] == 0) {
+                            continue;
+                        }
+                        Record record;
+                        record.label = labels[l];
+                        record.operation = operations[o];
+                        record.calls = total[0];
+                        record.bytes = (double)total[1];
+                        record.flops = (double)total[2];
+                        record.seconds = (double)total[3] * 1e-9;
+                        records.push_back(record);
+                    }
+                }
+                return records;
+            }
+            
+            // counts that threads add while the reset runs may survive it
+            void reset()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::fill(retired.begin(), retired.end(), 0);
+                for (size_t t = 0; t < threads.size(); t++) {
+                    for (int i = 0; i < MAX_LABELS * MAX_OPERATIONS; i++) {
+                        threads[t][i].calls.store(0, std::memory_order_relaxed);
+                        threads[t][i].bytes.store(0, std::memory_order_relaxed);
+                        threads[t][i].flops.store(0, std::memory_order_relaxed);
+                        threads[t][i].nanoseconds.store(0, std::memory_order_relaxed);
+                    }
+                }
+            }
+            
+        private:
+            Registry() : retired(4 * MAX_LABELS * MAX_OPERATIONS, 0)
+            {
+                // label 0 is the work outside any label, and operation 0 the
+                // whole time spent inside a label
+                labels.push_back("");
+                operations.push_back("total");
+            }
+            
+            static int id(std::vector<std::string> &names, int maxNames, const char *name)
+            {
+                for (size_t i = 0; i < names.size(); i++) {
+                    if (names[i] == name) {
+                        return (int)i;
+                    }
+                }
+                if ((int)names.size() == maxNames - 1) {
+                    names.push_back("other");
+                }
+                if ((int)names.size() == maxNames) {
+                    return maxNames - 1;
+                }
+                names.push_back(name);
+                return (int)names.size() - 1;
+            }
+            
+            static void add(const Counter *counters, std::vector<uint64_t> &totals)
+            {
+                for (int i = 0; i < MAX_LABELS * MAX_OPERATIONS; i++) {
+                    totals[4 * i + 0] += counters[i].calls.load(std::memory_order_relaxed);
+                    totals[4 * i + 1] += counters[i].bytes.load(std::memory_order_relaxed);
+                    totals[4 * i + 2] += counters[i].flops.load(std::memory_order_relaxed);
+                    totals[4 * i + 3] += counters[i].nanoseconds.load(std::memory_order_relaxed);
+                }
+            }
+            
+            std::mutex mutex;
+            std::vector<std::string> operations, labels;
+            std::vector<Counter *> threads;
+            std::vector<uint64_t> retired;
+        };
+        
+        // -------------------------------------------------------------------------
+        //  the calling thread's counters and current label
+        // -------------------------------------------------------------------------
+        class ThreadCounters
+        {
+        public:
+            static ThreadCounters & get()
+            {
+                static thread_local ThreadCounters counters;
+                return counters;
+            }
+            
+            void add(int operation, double bytes, double flops, uint64_t nanoseconds)
+            {
+                Counter &counter = counters[label * MAX_OPERATIONS + operation];
+                accumulate(counter.calls, 1);
+                accumulate(counter.bytes, (uint64_t)bytes);
+                accumulate(counter.flops, (uint64_t)flops);
+                accumulate(counter.nanoseconds, nanoseconds);
+            }
+            
+            int label;
+            
+        private:
+            ThreadCounters() : label(0), counters(new Counter[MAX_LABELS * MAX_OPERATIONS])
+            {
+                for (int i = 0; i < MAX_LABELS * MAX_OPERATIONS; i++) {
+                    counters[i].calls.store(0, std::memory_order_relaxed);
+                    counters[i].bytes.store(0, std::memory_order_relaxed);
+                    counters[i].flops.store(0, std::memory_order_relaxed);
+                    counters[i].nanoseconds.store(0, std::memory_order_relaxed);
+                }
+                Registry::get().attach(counters);
+            }
+            
+            ~ThreadCounters()
+            {
+                Registry::get().detach(counters);
+                delete [] counters;
+            }
+            
+            Counter *counters;
+        };
+        
+        inline int operationId(const char *name)
+        {
+            return Registry::get().operationId(name);
+        }
+        
+        inline int labelId(const char *name)
+        {
+            return Registry::get().labelId(name);
+        }
+        
+        inline int currentLabel()
+        {
+            return ThreadCounters::get().label;
+        }
+        
+        // an operation without timing, e.g. an allocation
+        inline void count(int operation, double bytes, double flops)
+        {
+            ThreadCounters::get().add(operation, bytes, flops, 0);
+        }
+        
+        // times an operation from construction to the end of its scope
+        class ScopedOperation
+        {
+        public:
+            ScopedOperation(int operation, double bytes, double flops)
+            : operation(operation), bytes(bytes), flops(flops), start(std::chrono::steady_clock::now())
+            {
+            }
+            
+            ~ScopedOperation()
+            {
+                uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                ThreadCounters::get().add(operation, bytes, flops, nanoseconds);
+            }
+            
+        private:
+            int operation;
+            double bytes, flops;
+            std::chrono::steady_clock::time_point start;
+        };
+        
+        // attributes the enclosed operations to a label, and the time of the
+        // whole scope to the label's "total"
+        class ScopedLabel
+        {
+        public:
+            explicit ScopedLabel(int label, bool bTimed = true)
+            : bTimed(bTimed)
+            {
+                ThreadCounters &counters = ThreadCounters::get();
+                previous = counters.label;
+                counters.label = label;
+                if (bTimed) {
+                    start = std::chrono::steady_clock::now();
+                }
+            }
+            
+            ~ScopedLabel()
+            {
+                ThreadCounters &counters = ThreadCounters::get();
+                if (bTimed) {
+                    uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                    counters.add(0, 0, 0, nanoseconds);
+                }
+                counters.label = previous;
+            }
+            
+        private:
+            int previous;
+            bool bTimed;
+            std::chrono::steady_clock::time_point start;
+        };
+        
+        // -------------------------------------------------------------------------
+        //  all counts so far, summed over threads: one record per label and
+        //  operation that has been called
+        // -------------------------------------------------------------------------
+        inline std::vector<Record> snapshot()
+        {
+            return Registry::get().snapshot();
+        }
+        
+        inline void reset()
+        {
+            Registry::get().reset();
+        }
+        
+        // a table of snapshot() per label, the most time consuming first
+        inline void report(FILE *fp = stdout)
+        {
+            std::vector<Record> records = snapshot();
+            std::stable_sort(records.begin(), records.end(), [](const Record &a, const Record &b) {
+                return a.label != b.label ? a.label < b.label : a.seconds > b.seconds;
+            });
+            fprintf(fp, "%-36s %-28s %10s %12s %12s %12s\n", "label", "operation", "calls", "MB", "MFLOP", "ms");
+            for (size_t i = 0; i < records.size(); i++) {
+                const Record &r = records[i];
+                fprintf(fp, "%-36s %-28s %10llu %12.2f %12.2f %12.3f\n", r.label.empty() ? "-" : r.label.c_str(),
+                        r.operation.c_str(), (unsigned long long)r.calls, r.bytes / 1e6, r.flops / 1e6, r.seconds * 1e3);
+            }
+        }
+    }
+}
+
+#define PKM_INSTRUMENT_COUNTED_OP(name, bytes, flops) \
+    static const int PKM_INSTRUMENT_CONCAT(pkmInstrumentOperation, __LINE__) = pkm::instrument::operationId(name); \
+    pkm::instrument::ScopedOperation PKM_INSTRUMENT_CONCAT(pkmInstrumentScope, __LINE__)(PKM_INSTRUMENT_CONCAT(pkmInstrumentOperation, __LINE__), (double)(bytes), (double)(flops))
+
+#define PKM_INSTRUMENT_COUNT(name, bytes, flops) \
+    do { \
+        static const int pkmInstrumentOperation = pkm::instrument::operationId(name); \
+        pkm::instrument::count(pkmInstrumentOperation, (double)(bytes), (double)(flops)); \
+    } while (0)
+
+#define PKM_INSTRUMENT_COUNTED_LABEL(name) \
+    static const int PKM_INSTRUMENT_CONCAT(pkmInstrumentLabelId, __LINE__) = pkm::instrument::labelId(name); \
+    pkm::instrument::ScopedLabel PKM_INSTRUMENT_CONCAT(pkmInstrumentLabel, __LINE__)(PKM_INSTRUMENT_CONCAT(pkmInstrumentLabelId, __LINE__))
+
+// the caller's label, for work handed to another thread
+#define PKM_INSTRUMENT_CAPTURE_LABEL(variable) const int variable = pkm::instrument::currentLabel()
+#define PKM_INSTRUMENT_RESTORE_LABEL(variable) pkm::instrument::ScopedLabel PKM_INSTRUMENT_CONCAT(pkmInstrumentLabel, __LINE__)(variable, false)
+
+#else
+
+#define PKM_INSTRUMENT_COUNTED_OP(name, bytes, flops)
+#define PKM_INSTRUMENT_COUNT(name, bytes, flops) do {} while (0)
+#define PKM_INSTRUMENT_COUNTED_LABEL(name)
+#define PKM_INSTRUMENT_CAPTURE_LABEL(variable)
+#define PKM_INSTRUMENT_RESTORE_LABEL(variable)
+
+#endif
+
+// -----------------------------------------------------------------------------
+//  PKM_INSTRUMENT_OP(name, bytes, flops) times the rest of the enclosing
+//  scope as one call of operation 'name' (a string literal) and traces it as
+//  a kernel span;
+//  PKM_INSTRUMENT_COUNT counts a call without timing it;
+//  PKM_INSTRUMENT_LABEL(name) attributes the rest of the scope to 'name',
+//  times it and traces it as a stage span.
+//  Names are registered once per call site.
+// -----------------------------------------------------------------------------
+#define PKM_INSTRUMENT_OP(name, bytes, flops) \
+    PKM_INSTRUMENT_COUNTED_OP(name, bytes, flops); \
+    PKM_TRACE_SPAN(name, pkm::trace::CATEGORY_KERNEL)
+
+#define PKM_INSTRUMENT_LABEL(name) \
+    PKM_INSTRUMENT_COUNTED_LABEL(name); \
+    PKM_TRACE_SPAN(name, pkm::trace::CATEGORY_STAGE)
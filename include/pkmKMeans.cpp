@@ -0,0 +1,492 @@
+// -----------------------------------------------------------------------------
+//  pkmKMeans.cpp
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+
+#include "pkmKMeans.h"
+#include "pkmParallel.h"
+#include <float.h>
+#include <random>
+
+// observations per GEMM block in assign()
+static const size_t KMEANS_BLOCK_ROWS = 256;
+
+// -------------------------------------------------------------------------
+static inline float squaredDistance(const float *a, const float *b, size_t D)
+{
+    float sum = 0;
+    for (size_t d = 0; d < D; d++) {
+        float v = a[d] - b[d];
+        sum += v * v;
+    }
+    return sum;
+}
+
+// -------------------------------------------------------------------------
+pkmKMeans::pkmKMeans(int k)
+{
+    numClusters = k;
+    maxIterations = 300;
+    numIterations = 0;
+    tolerance = 0;
+    seedValue = 5489u;
+    inertia = 0;
+}
+
+// -------------------------------------------------------------------------
+void pkmKMeans::setCenters(const Mat &c)
+{
+    centers = c;
+    numClusters = (int)c.rows;
+    centerCounts.assign(c.rows, 0.0);
+}
+
+// -------------------------------------------------------------------------
+void pkmKMeans::seed(const Mat &X, size_t numSeeds, Mat &seeds) const
+{
+    const size_t N = X.rows, D = X.cols;
+    const size_t K = std::min<size_t>(numSeeds, N);
+    std::mt19937 rng((unsigned int)seedValue);
+    
+    // each new seed is drawn with probability proportional to its squared
+    // distance from the nearest seed so far
+    seeds = Mat(K, D);
+    std::vector<double> distances(N);
+    size_t first = std::uniform_int_distribution<size_t>(0, N - 1)(rng);
+    std::copy(X.data + first * D, X.data + (first + 1) * D, seeds.data);
+    
+    for (size_t k = 1; k <= K; k++)
+    {
+        const float *c = seeds.data + (k - 1) * D;
+        parallelFor(0, N, parallelRowGrain(D), [&](size_t r0, size_t r1) {
+            for (size_t n = r0; n < r1; n++) {
+                double dist = squaredDistance(X.data + n * D, c, D);
+                distances[n] = (k == 1) ? dist : std::min(distances[n], dist);
+            }
+        });
+        if (k == K) {
+            break;
+        }
+        
+        double total = 0;
+        for (size_t n = 0; n < N; n++) {
+            total += distances[n];
+        }
+        size_t next = N - 1;
+        if (total > 0) {
+            double target = std::uniform_real_distribution<double>(0, total)(rng);
+            for (size_t n = 0; n < N; n++) {
+                target -= distances[n];
+                if (target <= 0) {
+                    next = n;
+                    break;
+                }
+            }
+        }
+        else {
+            next = std::uniform_int_distribution<size_t>(0, N - 1)(rng);
+        }
+        std::copy(X.data + next * D, X.data + (next + 1) * D, seeds.data + k * D);
+    }
+}
+
+// -------------------------------------------------------------------------
+void pkmKMeans::assign(const Mat &X, int *nearest, float *nearestDistance, float *secondDistance) const
+{
+    const size_t N = X.rows, D = X.cols, K = centers.rows;
+    
+    // |x - c|^2 = |x|^2 - 2 x.c + |c|^2 cancels badly in float away from the
+    // origin, so shift everything by the mean of the centers first
+    std::vector<float> ref(D, 0.0f);
+    for (size_t k = 0; k < K; k++) {
+        for (size_t d = 0; d < D; d++) {
+            ref[d] += centers.data[k * D + d] / (float)K;
+        }
+    }
+    Mat shifted(K, D);
+    std::vector<float> norms(K);
+    for (size_t k = 0; k < K; k++) {
+        for (size_t d = 0; d < D; d++) {
+            shifted.data[k * D + d] = centers.data[k * D + d] - ref[d];
+        }
+        vDSP_svesq(shifted.data + k * D, 1, &norms[k], D);
+    }
+    
+    const size_t numBlocks = (N + KMEANS_BLOCK_ROWS - 1) / KMEANS_BLOCK_ROWS;
+    parallelFor(0, numBlocks, 1, [&](size_t b0, size_t b1) {
+        std::vector<float> block(KMEANS_BLOCK_ROWS * D), dots(KMEANS_BLOCK_ROWS * K);
+        for (size_t b = b0; b < b1; b++)
+        {
+            size_t r0 = b * KMEANS_BLOCK_ROWS;
+            size_t n = std::min(KMEANS_BLOCK_ROWS, N - r0);
+            for (size_t i = 0; i < n; i++) {
+                const float *x = X.data + (r0 + i) * D;
+                float *y = &block[i * D];
+                for (size_t d = 0; d < D; d++) {
+                    y[d] = x[d] - ref[d];
+                }
+            }
+            cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, (int)n, (int)K, (int)D,
+                        -2.0f, &block[0], (int)D, shifted.data, (int)D, 0.0f, &dots[0], (int)K);
+            
+            for (size_t i = 0; i < n; i++)
+            {
+                float xx = 0;
+                vDSP_svesq(&block[i * D], 1, &xx, D);
+                const float *di = &dots[i * K];
+                float best = HUGE_VALF, second = HUGE_VALF;
+                int bestIndex = 0;
+                for (size_t k = 0; k < K; k++) {
+                    float dist = di[k] + norms[k];
+                    if (dist < best) {
+                        second = best;
+                        best = dist;
+                        bestIndex = (int)k;
+                    }
+                    else if (dist < second) {
+                        second = dist;
+                    }
+                }
+                nearest[r0 + i] = bestIndex;
+                if (nearestDistance) {
+                    nearestDistance[r0 + i] = sqrtf(std::max(best + xx, 0.0f));
+                }
+                if (secondDistance) {
+                    secondDistance[r0 + i] = sqrtf(std::max(second + xx, 0.0f));
+                }
+            }
+        }
+    });
+}
+
+// -------------------------------------------------------------------------
+void pkmKMeans::predict(const Mat &X, std::vector<int> &result) const
+{
+    if (X.cols != centers.cols || centers.rows == 0) {
+        printf("[ERROR]: pkmKMeans::predict() data has %lu dimensions, centers (%lu x %lu)\n", X.cols, centers.rows, centers.cols);
+        return;
+    }
+    result.resize(X.rows);
+    assign(X, &result[0], NULL, NULL);
+}
+
+// -------------------------------------------------------------------------
+double pkmKMeans::train(const Mat &X)
+{
+    if (X.data == NULL || X.rows == 0 || X.cols == 0 || numClusters < 1) {
+        printf("[ERROR]: pkmKMeans::train() needs data and at least 1 cluster\n");
+        return 0;
+    }
+    Mat seeds;
+    seed(X, numClusters, seeds);
+    return train(X, seeds);
+}
+
+// -------------------------------------------------------------------------
+double pkmKMeans::train(const Mat &X, const Mat &initialCenters)
+{
+    if (X.data == NULL || X.rows == 0 || initialCenters.rows == 0 || initialCenters.cols != X.cols) {
+        printf("[ERROR]: pkmKMeans::train() initial centers (%lu x %lu) do not match the data (%lu x %lu)\n",
+               initialCenters.rows, initialCenters.cols, X.rows, X.cols);
+        return 0;
+    }
+    
+    const size_t N = X.rows, D = X.cols, K = initialCenters.rows;
+    setCenters(initialCenters);
+    
+    // Hamerly: an upper bound on the distance to the assigned center and a
+    // lower bound on the distance to every other center
+    labels.resize(N);
+    std::vector<float> upper(N), lower(N);
+    assign(X, &labels[0], &upper[0], &lower[0]);
+    
+    const size_t numBlocks = (N + KMEANS_BLOCK_ROWS - 1) / KMEANS_BLOCK_ROWS;
+    std::vector<std::vector<double> > partialSums(numBlocks);
+    std::vector<size_t> partialChanged(numBlocks);
+    std::vector<double> sums(K * D);
+    std::vector<size_t> counts(K);
+    std::vector<float> shifts(K), halfSeparation(K);
+    Mat previous;
+    
+    for (numIterations = 0; numIterations < maxIterations; numIterations++)
+    {
+        // centers from the current assignment, summed per block so the
+        // result does not depend on the number of threads
+        parallelFor(0, numBlocks, 1, [&](size_t b0, size_t b1) {
+            for (size_t b = b0; b < b1; b++) {
+                std::vector<double> &acc = partialSums[b];
+                acc.assign(K * (D + 1), 0.0);
+                size_t r1 = std::min((b + 1) * KMEANS_BLOCK_ROWS, N);
+                for (size_t n = b * KMEANS_BLOCK_ROWS; n < r1; n++) {
+                    double *s = &acc[labels[n] * (D + 1)];
+                    const float *x = X.data + n * D;
+                    for (size_t d = 0; d < D; d++) {
+                        s[d] += x[d];
+                    }
+                    s[D] += 1.0;
+                }
+            }
+        });
+        std::fill(sums.begin(), sums.end(), 0.0);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (size_t b = 0; b < numBlocks; b++) {
+            for (size_t k = 0; k < K; k++) {
+                const double *s = &partialSums[b][k * (D + 1)];
+                for (size_t d = 0; d < D; d++) {
+                    sums[k * D + d] += s[d];
+                }
+                counts[k] += (size_t)s[D];
+            }
+        }
+        
+        previous = centers;
+        float maxShift = 0, secondShift = 0;
+        size_t maxIndex = 0;
+        for (size_t k = 0; k < K; k++)
+        {
+            // empty clusters keep their previous center
+            if (counts[k] > 0) {
+                for (size_t d = 0; d < D; d++) {
+                    centers.data[k * D + d] = sums[k * D + d] / (double)counts[k];
+                }
+            }
+            shifts[k] = sqrtf(squaredDistance(centers.data + k * D, previous.data + k * D, D));
+            if (shifts[k] > maxShift) {
+                secondShift = maxShift;
+                maxShift = shifts[k];
+                maxIndex = k;
+            }
+            else if (shifts[k] > secondShift) {
+                secondShift = shifts[k];
+            }
+        }
+        if (maxShift <= tolerance) {
+            break;
+        }
+        
+        // half the distance from each center to its nearest other center:
+        // a point closer than that to its center cannot be closer to another
+        for (size_t k = 0; k < K; k++) {
+            float nearest = HUGE_VALF;
+            for (size_t j = 0; j < K; j++) {
+                if (j != k) {
+                    nearest = std::min(nearest, squaredDistance(centers.data + k * D, centers.data + j * D, D));
+                }
+            }
+            halfSeparation[k] = 0.5f * sqrtf(nearest);
+        }
+        
+        parallelFor(0, numBlocks, 1, [&](size_t b0, size_t b1) {
+            for (size_t b = b0; b < b1; b++)
+            {
+                size_t changed = 0;
+                size_t r1 = std::min((b + 1) * KMEANS_BLOCK_ROWS, N);
+                for (size_t n = b * KMEANS_BLOCK_ROWS; n < r1; n++)
+                {
+                    int a = labels[n];
+                    upper[n] += shifts[a];
+                    lower[n] -= ((size_t)a == maxIndex) ? secondShift : maxShift;
+                    
+                    float bound = std::max(halfSeparation[a], lower[n]);
+                    if (upper[n] <= bound) {
+                        continue;
+                    }
+                    const float *x = X.data + n * D;
+                    upper[n] = sqrtf(squaredDistance(x, centers.data + a * D, D));
+                    if (upper[n] <= bound) {
+                        continue;
+                    }
+                    
+                    // bounds failed: check every center
+                    float best = HUGE_VALF, second = HUGE_VALF;
+                    int bestIndex = a;
+                    for (size_t k = 0; k < K; k++) {
+                        float dist = squaredDistance(x, centers.data + k * D, D);
+                        if (dist < best) {
+                            second = best;
+                            best = dist;
+                            bestIndex = (int)k;
+                        }
+                        else if (dist < second) {
+                            second = dist;
+                        }
+                    }
+                    if (bestIndex != a) {
+                        labels[n] = bestIndex;
+                        changed++;
+                    }
+                    upper[n] = sqrtf(best);
+                    lower[n] = sqrtf(second);
+                }
+                partialChanged[b] = changed;
+            }
+        });
+        
+        size_t changed = 0;
+        for (size_t b = 0; b < numBlocks; b++) {
+            changed += partialChanged[b];
+        }
+        if (changed == 0) {
+            numIterations++;
+            break;
+        }
+    }
+    
+    inertia = computeInertia(X);
+    return inertia;
+}
+
+// -------------------------------------------------------------------------
+void pkmKMeans::partialFit(const Mat &batch)
+{
+    if (batch.data == NULL || batch.rows == 0) {
+        return;
+    }
+    const size_t D = batch.cols;
+    if (centers.rows == 0 || centers.cols != D) {
+        Mat seeds;
+        seed(batch, numClusters, seeds);
+        setCenters(seeds);
+    }
+    
+    std::vector<int> batchLabels;
+    predict(batch, batchLabels);
+    
+    // each center moves towards its points with a per-center learning rate
+    // of 1 / (number of points it has seen)
+    for (size_t i = 0; i < batch.rows; i++) {
+        int k = batchLabels[i];
+        centerCounts[k] += 1.0;
+        float eta = 1.0 / centerCounts[k];
+        const float *x = batch.data + i * D;
+        float *c = centers.data + k * D;
+        for (size_t d = 0; d < D; d++) {
+            c[d] += eta * (x[d] - c[d]);
+        }
+    }
+}
+
+// -------------------------------------------------------------------------
+double pkmKMeans::trainMiniBatch(const Mat &X, size_t batchSize, int iterations)
+{
+    if (X.data == NULL || X.rows == 0 || X.cols == 0 || numClusters < 1) {
+        printf("[ERROR]: pkmKMeans::trainMiniBatch() needs data and at least 1 cluster\n");
+        return 0;
+    }
+    
+    const size_t N = X.rows, D = X.cols;
+    batchSize = std::min<size_t>(std::max<size_t>(batchSize, numClusters), N);
+    std::mt19937 rng((unsigned int)seedValue + 1);
+    std::uniform_int_distribution<size_t> pick(0, N - 1);
+    
+    centers = Mat();
+    Mat batch(batchSize, D);
+    for (numIterations = 0; numIterations < iterations; numIterations++) {
+        for (size_t i = 0; i < batchSize; i++) {
+            size_t n = pick(rng);
+            std::copy(X.data + n * D, X.data + (n + 1) * D, batch.data + i * D);
+        }
+        partialFit(batch);
+    }
+    
+    labels.resize(N);
+    assign(X, &labels[0], NULL, NULL);
+    inertia = computeInertia(X);
+    return inertia;
+}
+
+// -------------------------------------------------------------------------
+double pkmKMeans::computeInertia(const Mat &X) const
+{
+    const size_t N = X.rows, D = X.cols;
+    const size_t numBlocks = (N + KMEANS_BLOCK_ROWS - 1) / KMEANS_BLOCK_ROWS;
+    std::vector<double> partial(numBlocks, 0.0);
+    parallelFor(0, numBlocks, 1, [&](size_t b0, size_t b1) {
+        for (size_t b = b0; b < b1; b++) {
+            size_t r1 = std::min((b + 1) * KMEANS_BLOCK_ROWS, N);
+            double sum = 0;
+            for (size_t n = b * KMEANS_BLOCK_ROWS; n < r1; n++) {
+                sum += squaredDistance(X.data + n * D, centers.data + labels[n] * D, D);
+            }
+            partial[b] = sum;
+        }
+    });
+    double total = 0;
+    for (size_t b = 0; b < numBlocks; b++) {
+        total += partial[b];
+    }
+    return total;
+}
@@ -0,0 +1,173 @@
+// -----------------------------------------------------------------------------
+//  pkmKMeans.h
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "pkmMatrix.h"
+#include <vector>
+
+using namespace pkm;
+
+// -----------------------------------------------------------------------------
+//  k-means clustering of the rows of a pkm::Mat.
+//
+//  Seeding is k-means++.  train() runs Lloyd iterations with Hamerly's
+//  triangle inequality bounds, so after the first few iterations most
+//  observations skip the distance computation entirely; the first pass and
+//  predict() compute all distances with a GEMM per block of observations.
+//  trainMiniBatch()/partialFit() implement mini-batch k-means (Sculley 2010)
+//  for data too large for full passes.
+// -----------------------------------------------------------------------------
+class pkmKMeans
+{
+public:
+    // -------------------------------------------------------------------------
+    pkmKMeans(int k = 8);
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    void setNumClusters(int k)                  { numClusters = k; }
+    void setMaxIterations(int n)                { maxIterations = n; }
+    // stop once no center moves further than this
+    void setTolerance(float t)                  { tolerance = t; }
+    void setSeed(unsigned long s)               { seedValue = s; }
+    
+    // use 'c' (clusters x dimensions) as the centers, e.g. for predict()
+    void setCenters(const Mat &c);
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  k-means++ seeding of 'numSeeds' centers from the rows of X.  The first
+    //  k rows of the result are themselves a k-means++ seeding for k centers.
+    // -------------------------------------------------------------------------
+    void seed(const Mat &X, size_t numSeeds, Mat &seeds) const;
+    
+    // -------------------------------------------------------------------------
+    //  Cluster X (observations x dimensions), from a k-means++ seeding or
+    //  from 'initialCenters'.  Returns the inertia (sum of squared distances
+    //  to the assigned centers).
+    // -------------------------------------------------------------------------
+    double train(const Mat &X);
+    double train(const Mat &X, const Mat &initialCenters);
+    
+    // -------------------------------------------------------------------------
+    //  Mini-batch k-means: 'iterations' updates from batches of 'batchSize'
+    //  rows drawn at random from X.  partialFit() applies one batch, seeding
+    //  the centers from it if there are none yet.
+    // -------------------------------------------------------------------------
+    double trainMiniBatch(const Mat &X, size_t batchSize, int iterations = 100);
+    void partialFit(const Mat &batch);
+    
+    // -------------------------------------------------------------------------
+    //  Index of the nearest center for each row of X
+    // -------------------------------------------------------------------------
+    void predict(const Mat &X, std::vector<int> &labels) const;
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    const Mat &                 getCenters() const      { return centers; }
+    const std::vector<int> &    getLabels() const       { return labels; }
+    double                      getInertia() const      { return inertia; }
+    int                         getNumIterations() const{ return numIterations; }
+    int                         getNumClusters() const  { return numClusters; }
+    // -------------------------------------------------------------------------
+    
+protected:
+    // -------------------------------------------------------------------------
+    // nearest (and optionally second nearest) center and their distances for
+    // every row of X, using GEMM on data shifted by the mean of the centers
+    void        assign(const Mat &X, int *nearest, float *nearestDistance, float *secondDistance) const;
+    
+    // sum of squared distances of every row to its center in 'labels'
+    double      computeInertia(const Mat &X) const;
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    int                 numClusters;
+    int                 maxIterations;
+    int                 numIterations;
+    float               tolerance;
+    unsigned long       seedValue;
+    double              inertia;
+    
+    Mat                 centers;            // K x D
+    std::vector<int>    labels;             // of the last training data
+    std::vector<double> centerCounts;       // for mini-batch updates
+    // -------------------------------------------------------------------------
+};
@@ -0,0 +1,209 @@
+// -----------------------------------------------------------------------------
+//  pkmLapack.h
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include <Accelerate/Accelerate.h>
+#include <vector>
+#include <map>
+
+namespace pkm
+{
+    // -------------------------------------------------------------------------
+    //  Per-thread scratch space for the LAPACK wrappers of pkm::Mat.
+    //
+    //  Buffers live on the heap, grow to the largest request seen and are then
+    //  reused, so that repeated decompositions of the same shape allocate
+    //  nothing.  Optimal work sizes (the lwork = -1 queries) are cached per
+    //  routine and shape.  Each thread owns its workspace, so the wrappers can
+    //  be called from inside a parallelFor.
+    // -------------------------------------------------------------------------
+    class LapackWorkspace
+    {
+    public:
+        enum buffer_t
+        {
+            BUFFER_INPUT,           // copy of the input, which LAPACK overwrites
+            BUFFER_RHS,             // column-major right hand sides
+            BUFFER_WORK,            // lwork floats
+            BUFFER_SINGULAR_VALUES, // all min(m, n) singular values of a truncated svd
+            BUFFER_LEFT_VECTORS,    // all economy left singular vectors
+            BUFFER_RIGHT_VECTORS,   // all economy right singular vectors
+            BUFFER_REFLECTORS,      // Householder scalars of a QR factorization
+            BUFFER_RANGE,           // orthonormal basis of the randomized svd
+            BUFFER_EIGENVECTORS,    // column-major eigenvectors, ascending
+            NUM_BUFFERS
+        };
+        
+        enum routine_t
+        {
+            ROUTINE_GESDD,
+            ROUTINE_GETRI,
+            ROUTINE_SYEVR,
+            ROUTINE_GEQRF,
+            ROUTINE_ORGQR
+        };
+        
+        // the calling thread's workspace
+        static LapackWorkspace & get()
+        {
+            static thread_local LapackWorkspace workspace;
+            return workspace;
+        }
+        
+        __CLPK_real * floats(buffer_t buffer, size_t n)
+        {
+            std::vector<__CLPK_real> &b = floatBuffers[buffer];
+            if (b.size() < n) {
+                b.resize(n);
+            }
+            return b.data();
+        }
+        
+        __CLPK_integer * integers(size_t n)
+        {
+            if (integerBuffer.size() < n) {
+                integerBuffer.resize(n);
+            }
+            return integerBuffer.data();
+        }
+        
+        // the isuppz array of ssyevr (the support of each eigenvector)
+        __CLPK_integer * supports(size_t n)
+        {
+            if (supportBuffer.size() < n) {
+                supportBuffer.resize(n);
+            }
+            return supportBuffer.data();
+        }
+        
+        // cached optimal lwork for a routine, shape and job, or 0 if unknown
+        __CLPK_integer workSize(routine_t routine, size_t m, size_t n, char job) const
+        {
+            std::map<Key, __CLPK_integer>::const_iterator it = workSizes.find(Key(routine, m, n, job));
+            return it == workSizes.end() ? 0 : it->second;
+        }
+        
+        void setWorkSize(routine_t routine, size_t m, size_t n, char job, __CLPK_integer lwork)
+        {
+            workSizes[Key(routine, m, n, job)] = lwork;
+        }
+        
+        // heap bytes currently held by this thread's workspace
+        size_t bytes() const
+        {
+            size_t total = (integerBuffer.capacity() + supportBuffer.capacity()) * sizeof(__CLPK_integer);
+            for (int i = 0; i < NUM_BUFFERS; i++) {
+                total += floatBuffers[i].capacity() * sizeof(__CLPK_real);
+            }
+            return total;
+        }
+        
+        // release the buffers (the cached work sizes are kept)
+        void release()
+        {
+            for (int i = 0; i < NUM_BUFFERS; i++) {
+                std::vector<__CLPK_real>().swap(floatBuffers[i]);
+            }
+            std::vector<__CLPK_integer>().swap(integerBuffer);
+            std::vector<__CLPK_integer>().swap(supportBuffer);
+        }
+        
+    private:
+        struct Key
+        {
+            Key(routine_t r, size_t m, size_t n, char j) : routine(r), m(m), n(n), job(j) {}
+            bool operator<(const Key &rhs) const
+            {
+                if (routine != rhs.routine) return routine < rhs.routine;
+                if (m != rhs.m) return m < rhs.m;
+                if (n != rhs.n) return n < rhs.n;
+                return job < rhs.job;
+            }
+            routine_t routine;
+            size_t m, n;
+            char job;
+        };
+        
+        std::vector<__CLPK_real>        floatBuffers[NUM_BUFFERS];
+        std::vector<__CLPK_integer>     integerBuffer;
+        std::vector<__CLPK_integer>     supportBuffer;
+        std::map<Key, __CLPK_integer>   workSizes;
+    };
+};
@@ -0,0 +1,537 @@
+// -----------------------------------------------------------------------------
+//  pkmMatT.h
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "pkmMatrix.h"
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+// -----------------------------------------------------------------------------
+//  Row-major matrices with a choice of element type.
+//
+//  pkm::Mat stays the single precision workhorse; MatT<T> is for the two
+//  cases it cannot serve: storing large databases in 16 bits per element
+//  (pkm::half, IEEE binary16, or pkm::bfloat16, the top half of a float) and
+//  keeping precision-critical data in double without conversion passes.
+//  The 16-bit types are storage only: arithmetic converts blocks of rows to
+//  float and uses the float BLAS.  MatTraits<T> holds the per-type BLAS and
+//  LAPACK dispatch.
+//
+//  pkmDTW can keep its candidate database in a MatH (setHalfPrecisionDatabase),
+//  and pkmGaussianMixtureModel accepts MatD observations.
+// -----------------------------------------------------------------------------
+
+namespace pkm
+{
+    // -------------------------------------------------------------------------
+    //  16-bit storage types, converted with round to nearest even
+    // -------------------------------------------------------------------------
+    struct half
+    {
+        uint16_t bits;
+        
+        half() : bits(0) {}
+        half(float f) : bits(fromFloat(f)) {}
+        operator float() const { return toFloat(bits); }
+        
+        static uint16_t fromFloat(float f)
+        {
+            uint32_t x;
+            memcpy(&x, &f, sizeof(x));
+            uint32_t sign = (x >> 16) & 0x8000;
+            uint32_t mantissa = x & 0x007fffff;
+            int32_t exponent = (int32_t)((x >> 23) & 0xff);
+            
+            if (exponent == 0xff) {
+                return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 | (mantissa >> 13) : 0));
+            }
+            exponent += 15 - 127;
+            if (exponent >= 0x1f) {
+                return (uint16_t)(sign | 0x7c00);
+            }
+            if (exponent <= 0) {
+                // subnormal (or zero) half
+                if (exponent < -10) {
+                    return (uint16_t)sign;
+                }
+                mantissa |= 0x00800000;
+                uint32_t shift = (uint32_t)(14 - exponent);
+                uint32_t h = mantissa >> shift;
+                uint32_t remainder = mantissa & ((1u << shift) - 1);
+                uint32_t halfway = 1u << (shift - 1);
+                if (remainder > halfway || (remainder == halfway && (h & 1))) {
+                    h++;
+                }
+                return (uint16_t)(sign | h);
+            }
+            // a carry out of the mantissa correctly bumps the exponent
+            uint32_t h = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+            uint32_t remainder = mantissa & 0x1fff;
+            if (remainder > 0x1000 || (remainder == 0x1000 && (h & 1))) {
+                h++;
+            }
+            return (uint16_t)h;
+        }
+        
+        static float toFloat(uint16_t h)
+        {
+            uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+            uint32_t exponent = (h >> 10) & 0x1f;
+            uint32_t mantissa = h & 0x3ff;
+            uint32_t x;
+            if (exponent == 0) {
+                if (mantissa == 0) {
+                    x = sign;
+                }
+                else {
+                    // normalize a subnormal
+                    int32_t e = 1;
+                    while (!(mantissa & 0x400)) {
+                        mantissa <<= 1;
+                        e--;
+                    }
+                    x = sign | ((uint32_t)(e + 112) << 23) | ((mantissa & 0x3ff) << 13);
+                }
+            }
+            else if (exponent == 0x1f) {
+                x = sign | 0x7f800000 | (mantissa << 13);
+            }
+            else {
+                x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+            }
+            float f;
+            memcpy(&f, &x, sizeof(f));
+            return f;
+        }
+    };
+    
+    struct bfloat16
+    {
+        uint16_t bits;
+        
+        bfloat16() : bits(0) {}
+        bfloat16(float f) : bits(fromFloat(f)) {}
+        operator float() const { return toFloat(bits); }
+        
+        static uint16_t fromFloat(float f)
+        {
+            uint32_t x;
+            memcpy(&x, &f, sizeof(x));
+            if ((x & 0x7fffffff) > 0x7f800000) {
+                // keep NaNs quiet rather than rounding them to infinity
+                return (uint16_t)((x >> 16) | 0x40);
+            }
+            return (uint16_t)((x + 0x7fff + ((x >> 16) & 1)) >> 16);
+        }
+        
+        static float toFloat(uint16_t b)
+        {
+            uint32_t x = (uint32_t)b << 16;
+            float f;
+            memcpy(&f, &x, sizeof(f));
+            return f;
+        }
+    };
+    
+    // -------------------------------------------------------------------------
+    //  Bulk conversions, written as plain loops for the vectorizer
+    // -------------------------------------------------------------------------
+    template <typename S, typename D>
+    inline void convertElements(const S *src, D *dst, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = (D)src[i];
+        }
+    }
+    
+    template <>
+    inline void convertElements(const float *src, float *dst, size_t n)
+    {
+        memcpy(dst, src, n * sizeof(float));
+    }
+    
+    template <>
+    inline void convertElements(const float *src, half *dst, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) {
+            dst[i].bits = half::fromFloat(src[i]);
+        }
+    }
+    
+    template <>
+    inline void convertElements(const half *src, float *dst, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = half::toFloat(src[i].bits);
+        }
+    }
+    
+    template <>
+    inline void convertElements(const float *src, bfloat16 *dst, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) {
+            dst[i].bits = bfloat16::fromFloat(src[i]);
+        }
+    }
+    
+    template <>
+    inline void convertElements(const bfloat16 *src, float *dst, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = bfloat16::toFloat(src[i].bits);
+        }
+    }
+    
+    // -------------------------------------------------------------------------
+    //  Per element type BLAS/LAPACK dispatch.  compute_type is what the
+    //  arithmetic runs in; bNative is false for storage-only types, whose
+    //  rows are converted to compute_type in blocks.
+    // -------------------------------------------------------------------------
+    template <typename T> struct MatTraits;
+    
+    template <> struct MatTraits<float>
+    {
+        typedef float compute_type;
+        static const bool bNative = true;
+        
+        static void gemm(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, size_t M, size_t N, size_t K,
+                         float alpha, const float *A, size_t lda, const float *B, size_t ldb,
+                         float beta, float *C, size_t ldc)
+        {
+            cblas_sgemm(CblasRowMajor, transA, transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+        }
+        static float dot(size_t n, const float *x, const float *y)
+        {
+            return cblas_sdot(n, x, 1, y, 1);
+        }
+        static void axpy(size_t n, float alpha, const float *x, float *y)
+        {
+            cblas_saxpy(n, alpha, x, 1, y, 1);
+        }
+        static void scal(size_t n, float alpha, float *x)
+        {
+            cblas_sscal(n, alpha, x, 1);
+        }
+        static long potrf(size_t n, float *A)
+        {
+            __CLPK_integer N = n, info = 0;
+            char uplo = 'L';
+            spotrf_(&uplo, &N, A, &N, &info);
+            return info;
+        }
+    };
+    
+    template <> struct MatTraits<double>
+    {
+        typedef double compute_type;
+        static const bool bNative = true;
+        
+        static void gemm(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, size_t M, size_t N, size_t K,
+                         double alpha, const double *A, size_t lda, const double *B, size_t ldb,
+                         double beta, double *C, size_t ldc)
+        {
+            cblas_dgemm(CblasRowMajor, transA, transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+        }
+        static double dot(size_t n, const double *x, const double *y)
+        {
+            return cblas_ddot(n, x, 1, y, 1);
+        }
+        static void axpy(size_t n, double alpha, const double *x, double *y)
+        {
+            cblas_daxpy(n, alpha, x, 1, y, 1);
+        }
+        static void scal(size_t n, double alpha, double *x)
+        {
+            cblas_dscal(n, alpha, x, 1);
+        }
+        static long potrf(size_t n, double *A)
+        {
+            __CLPK_integer N = n, info = 0;
+            char uplo = 'L';
+            dpotrf_(&uplo, &N, A, &N, &info);
+            return info;
+        }
+    };
+    
+    template <> struct MatTraits<half>
+    {
+        typedef float compute_type;
+        static const bool bNative = false;
+    };
+    
+    template <> struct MatTraits<bfloat16>
+    {
+        typedef float compute_type;
+        static const bool bNative = false;
+    };
+    
+    // -------------------------------------------------------------------------
+    template <typename T>
+    class MatT
+    {
+    public:
+        typedef T                                       value_type;
+        typedef typename MatTraits<T>::compute_type     compute_type;
+        
+        // rows converted per block in the storage-only code paths
+        static const size_t BLOCK_ROWS = 256;
+        
+        // -------------------------------------------------------------------------
+        MatT() : rows(0), cols(0) {}
+        MatT(size_t r, size_t c) : rows(r), cols(c), storage(r * c) {}
+        MatT(size_t r, size_t c, compute_type value) : rows(r), cols(c), storage(r * c, T(value)) {}
+        
+        // from a float Mat, or from a MatT of another element type
+        explicit MatT(const Mat &m) : rows(m.rows), cols(m.cols), storage(m.rows * m.cols)
+        {
+            if (!storage.empty()) {
+                convertElements(m.data, &storage[0], storage.size());
+            }
+        }
+        
+        template <typename S>
+        explicit MatT(const MatT<S> &m) : rows(m.rows), cols(m.cols), storage(m.rows * m.cols)
+        {
+            for (size_t r = 0; r < rows; r++) {
+                m.getRow(r, buffer(cols));
+                convertElements(buffer(cols), row(r), cols);
+            }
+        }
+        // -------------------------------------------------------------------------
+        
+        // -------------------------------------------------------------------------
+        Mat toMat() const
+        {
+            Mat m(rows, cols);
+            for (size_t r = 0; r < rows; r++) {
+                getRow(r, m.data + r * cols);
+            }
+            return m;
+        }
+        
+        void resize(size_t r, size_t c)
+        {
+            rows = r;
+            cols = c;
+            storage.resize(r * c);
+        }
+        
+        size_t      size() const                            { return rows * cols; }
+        size_t      bytes() const                           { return rows * cols * sizeof(T); }
+        bool        isEmpty() const                         { return storage.empty(); }
+        
+        T *         data()                                  { return storage.empty() ? NULL : &storage[0]; }
+        const T *   data() const                            { return storage.empty() ? NULL : &storage[0]; }
+        T *         row(size_t r)                           { return &storage[r * cols]; }
+        const T *   row(size_t r) const                     { return &storage[r * cols]; }
+        
+        compute_type get(size_t r, size_t c) const          { return (compute_type)storage[r * cols + c]; }
+        void        set(size_t r, size_t c, compute_type v) { storage[r * cols + c] = T(v); }
+        
+        // row r as floats
+        void getRow(size_t r, float *out) const             { convertElements(row(r), out, cols); }
+        void setRow(size_t r, const float *in)              { convertElements(in, row(r), cols); }
+        
+        // rows [r0, r1) as floats, (r1 - r0) x cols
+        void getRows(size_t r0, size_t r1, float *out) const
+        {
+            if (r1 > r0) {
+                convertElements(row(r0), out, (r1 - r0) * cols);
+            }
+        }
+        
+        // append the rows of a float Mat (an empty MatT takes its columns)
+        void push_back(const Mat &m)
+        {
+            if (m.data == NULL || m.rows == 0) {
+                return;
+            }
+            if (rows == 0) {
+                cols = m.cols;
+            }
+            else if (m.cols != cols) {
+                printf("[ERROR]: MatT::push_back() requires %lu columns, m has %lu\n", cols, m.cols);
+                return;
+            }
+            storage.resize((rows + m.rows) * cols);
+            convertElements(m.data, &storage[rows * cols], m.rows * cols);
+            rows += m.rows;
+        }
+        // -------------------------------------------------------------------------
+        
+        // -------------------------------------------------------------------------
+        //  this (M x K) * B (K x N), computed in compute_type
+        // -------------------------------------------------------------------------
+        MatT GEMM(const MatT &B) const
+        {
+            MatT C(rows, B.cols);
+            if (cols != B.rows) {
+                printf("[ERROR]: MatT::GEMM() cannot multiply %lu x %lu by %lu x %lu\n", rows, cols, B.rows, B.cols);
+                return C;
+            }
+            gemm(*this, B, C, Dispatch<MatTraits<T>::bNative>());
+            return C;
+        }
+        
+        // -------------------------------------------------------------------------
+        //  In place Cholesky factor of a symmetric positive definite matrix:
+        //  afterwards the upper triangle holds U with this = U^T U (native
+        //  element types only).  Returns the LAPACK info, 0 on success.
+        // -------------------------------------------------------------------------
+        long cholesky()
+        {
+            long info = MatTraits<T>::potrf(rows, data());
+            for (size_t i = 0; info == 0 && i < rows; i++) {
+                for (size_t j = 0; j < i; j++) {
+                    storage[i * cols + j] = T(0);
+                }
+            }
+            return info;
+        }
+        
+        // -------------------------------------------------------------------------
+        //  Nearest row to a float query, as Mat::getIndexOfClosestRowL2 (the
+        //  squared distance): 16-bit rows are decoded a block at a time
+        // -------------------------------------------------------------------------
+        void getIndexOfClosestRowL2(const float *query, float &best_sum, size_t &best_idx) const
+        {
+            best_sum = HUGE_VALF;
+            best_idx = 0;
+            std::vector<float> block(BLOCK_ROWS * cols);
+            for (size_t r0 = 0; r0 < rows; r0 += BLOCK_ROWS)
+            {
+                size_t r1 = std::min(rows, r0 + BLOCK_ROWS);
+                convertElements(row(r0), &block[0], (r1 - r0) * cols);
+                for (size_t r = r0; r < r1; r++) {
+                    float l2 = pkm::math::squaredL2Distance(&block[(r - r0) * cols], query, cols);
+                    if (l2 < best_sum) {
+                        best_sum = l2;
+                        best_idx = r;
+                    }
+                }
+            }
+        }
+        // -------------------------------------------------------------------------
+        
+        size_t          rows;
+        size_t          cols;
+        
+    protected:
+        template <bool b> struct Dispatch {};
+        
+        static void gemm(const MatT &A, const MatT &B, MatT &C, Dispatch<true>)
+        {
+            MatTraits<T>::gemm(CblasNoTrans, CblasNoTrans, A.rows, B.cols, A.cols,
+                               1, A.data(), A.cols, B.data(), B.cols, 0, C.data(), C.cols);
+        }
+        
+        // storage-only types: B once and A a block of rows at a time in float
+        static void gemm(const MatT &A, const MatT &B, MatT &C, Dispatch<false>)
+        {
+            std::vector<float> b(B.size()), a(BLOCK_ROWS * A.cols), c(BLOCK_ROWS * B.cols);
+            convertElements(B.data(), &b[0], B.size());
+            for (size_t r0 = 0; r0 < A.rows; r0 += BLOCK_ROWS)
+            {
+                size_t r1 = std::min(A.rows, r0 + BLOCK_ROWS);
+                convertElements(A.row(r0), &a[0], (r1 - r0) * A.cols);
+                MatTraits<float>::gemm(CblasNoTrans, CblasNoTrans, r1 - r0, B.cols, A.cols,
+                                       1.0f, &a[0], A.cols, &b[0], B.cols, 0.0f, &c[0], B.cols);
+                convertElements(&c[0], C.row(r0), (r1 - r0) * B.cols);
+            }
+        }
+        
+        // per thread scratch for conversions between element types
+        static float * buffer(size_t n)
+        {
+            static thread_local std::vector<float> scratch;
+            if (scratch.size() < n) {
+                scratch.resize(n);
+            }
+            return &scratch[0];
+        }
+        
+        std::vector<T>  storage;
+    };
+    
+    typedef MatT<double>    MatD;
+    typedef MatT<half>      MatH;
+    typedef MatT<bfloat16>  MatBF16;
+};
@@ -0,0 +1,474 @@
+// -----------------------------------------------------------------------------
+//  pkmMath.h
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#include <algorithm>
+
+// -----------------------------------------------------------------------------
+//  Vectorizable single precision transcendental kernels.
+//
+//  Each array kernel is a branch-free loop over Cephes-style minimax
+//  polynomials, written so that the compiler can turn it into SIMD code
+//  (SSE4/AVX/NEON) on any platform, i.e. without relying on Accelerate's
+//  vForce.  Measured maximum errors against a double precision reference
+//  (see src/benchmarkMath.cpp):
+//
+//      exp     [-87.3, 88.7]           <= 1 ulp
+//      log     floats > 0              <= 1 ulp
+//      pow     exp(p * log(x))         <= 1 + |p * log(x)| ulp
+//      sin/cos [-pi, pi]               <= 1.5 ulp
+//              |x| <= 8192             <= 8e-8 absolute
+//              |x| > 8192              sinf / cosf
+//      sqrt    hardware sqrt           correctly rounded
+//
+//  Outside these domains: exp saturates to 0 / +inf, log returns -inf for 0
+//  and NaN for negative input, and sin and cos hand infinities and NaN to
+//  sinf and cosf as well (the array forms keep the branch-free loop for
+//  blocks that need neither).
+//  The array kernels may be called in place (dst == src).
+// -----------------------------------------------------------------------------
+
+namespace pkm
+{
+    namespace math
+    {
+        // ---------------------------------------------------------------------
+        inline float asFloat(uint32_t i)
+        {
+            float f;
+            memcpy(&f, &i, sizeof(float));
+            return f;
+        }
+        
+        inline uint32_t asInt(float f)
+        {
+            uint32_t i;
+            memcpy(&i, &f, sizeof(float));
+            return i;
+        }
+        // ---------------------------------------------------------------------
+        
+        // ---------------------------------------------------------------------
+        inline float exp(float x)
+        {
+            const float maxArg = 88.72283905206835f;
+            const float minArg = -87.33654475055310f;
+            
+            float xc = x > maxArg ? maxArg : (x < minArg ? minArg : x);
+            
+            // x = n * ln(2) + r, |r| <= ln(2) / 2.  n is rounded with the
+            // 1.5 * 2^23 trick rather than floorf and a float to int
+            // conversion, which keeps the loop vectorizable under strict
+            // floating point semantics
+            const float shifter = 12582912.0f;
+            float t = xc * 1.44269504088896341f + shifter;
+            int32_t n = (int32_t)(asInt(t) - asInt(shifter));
+            float fn = t - shifter;
+            float r = xc - fn * 0.693359375f;
+            r = r - fn * -2.12194440e-4f;
+            
+            float z = r * r;
+            float p = 1.9875691500E-4f;
+            p = p * r + 1.3981999507E-3f;
+            p = p * r + 8.3334519073E-3f;
+            p = p * r + 4.1665795894E-2f;
+            p = p * r + 1.6666665459E-1f;
+            p = p * r + 5.0000001201E-1f;
+            p = p * z + r + 1.0f;
+            
+            // scale by 2^n in two steps so that n = 128 does not overflow the exponent
+            int32_t n1 = n >> 1;
+            float y = p * asFloat((uint32_t)(n1 + 127) << 23) * asFloat((uint32_t)(n - n1 + 127) << 23);
+            
+            y = x > maxArg ? HUGE_VALF : y;
+            y = x < minArg ? 0.0f : y;
+            return x != x ? x : y;
+        }
+        // ---------------------------------------------------------------------
+        
+        // ---------------------------------------------------------------------
+        inline float log(float x)
+        {
+            // denormals are scaled by 2^23 into the normal range first
+            bool bDenormal = x < 1.17549435e-38f;
+            uint32_t i = asInt(bDenormal ? x * 8388608.0f : x);
+            
+            // x = m * 2^e, m in [0.5, 1)
+            int32_t e = (int32_t)((i >> 23) & 0xff) - (bDenormal ? 149 : 126);
+            float m = asFloat((i & 0x007fffff) | 0x3f000000);
+            
+            // shift m into [sqrt(0.5), sqrt(2))
+            bool bSmall = m < 0.707106781186547524f;
+            float fe = (float)e - (bSmall ? 1.0f : 0.0f);
+            float t = bSmall ? (m + m - 1.0f) : (m - 1.0f);
+            
+            float z = t * t;
+            float p = 7.0376836292E-2f;
+            p = p * t - 1.1514610310E-1f;
+            p = p * t + 1.1676998740E-1f;
+            p = p * t - 1.2420140846E-1f;
+            p = p * t + 1.4249322787E-1f;
+            p = p * t - 1.6668057665E-1f;
+            p = p * t + 2.0000714765E-1f;
+            p = p * t - 2.4999993993E-1f;
+            p = p * t + 3.3333331174E-1f;
+            
+            float y = p * t * z;
+            y += fe * -2.12194440e-4f;
+            y += -0.5f * z;
+            y = t + y;
+            y += fe * 0.693359375f;
+            
+            // zero, negative numbers, +inf and NaN
+            y = x == 0.0f ? -HUGE_VALF : y;
+            y = x < 0.0f ? NAN : y;
+            y = x == HUGE_VALF ? x : y;
+            return x != x ? x : y;
+        }
+        // ---------------------------------------------------------------------
+        
+        // ---------------------------------------------------------------------
+        //  'bIntegerPower' and 'bOddPower' describe p, so that they can be
+        //  computed once per array
+        inline float pow(float x, float p, bool bIntegerPower, bool bOddPower)
+        {
+            float y = exp(p * log(fabsf(x)));
+            
+            // negative bases are only defined for integer exponents
+            y = (x < 0.0f && bOddPower) ? -y : y;
+            y = (x < 0.0f && !bIntegerPower) ? NAN : y;
+            return p == 0.0f ? 1.0f : y;
+        }
+        
+        inline float pow(float x, float p)
+        {
+            bool bIntegerPower = floorf(p) == p;
+            bool bOddPower = bIntegerPower && (fmodf(p, 2.0f) != 0.0f);
+            return pow(x, p, bIntegerPower, bOddPower);
+        }
+        // ---------------------------------------------------------------------
+        
+        // ---------------------------------------------------------------------
+        //  sin and cos share the reduction to [-pi/4, pi/4], which is accurate
+        //  up to SINCOS_MAX_ARG; larger and non-finite x give meaningless (but
+        //  defined) results here, and are handed to sinf / cosf by sin() and cos()
+        // ---------------------------------------------------------------------
+        static const float SINCOS_MAX_ARG = 8192.0f;
+        
+        inline void sincosReduce(float x, float &r, int32_t &octant)
+        {
+            float ax = fabsf(x);
+            
+            // the even octant nearest |x| * 4 / pi, rounded with the same
+            // 1.5 * 2^23 trick as exp(): no float to int conversion, which
+            // would overflow for large x, and no branch in the loop
+            const float shifter = 12582912.0f;
+            float t = ax * 0.63661977236758f + shifter;
+            int32_t j = (int32_t)((asInt(t) - asInt(shifter)) << 1);
+            float y = (t - shifter) * 2.0f;
+            
+            // extended precision modular arithmetic
+            r = ((ax - y * 0.78515625f) - y * 2.4187564849853515625e-4f) - y * 3.77489497744594108e-8f;
+            octant = j;
+        }
+        
+        inline float sinPoly(float r)
+        {
+            float z = r * r;
+            float p = -1.9515295891E-4f;
+            p = p * z + 8.3321608736E-3f;
+            p = p * z - 1.6666654611E-1f;
+            return p * z * r + r;
+        }
+        
+        inline float cosPoly(float r)
+        {
+            float z = r * r;
+            float p = 2.443315711809948E-005f;
+            p = p * z - 1.388731625493765E-003f;
+            p = p * z + 4.166664568298827E-002f;
+            return p * z * z - 0.5f * z + 1.0f;
+        }
+        
+        // branch-free forms for |x| <= SINCOS_MAX_ARG
+        inline float sinReduced(float x)
+        {
+            float r;
+            int32_t j;
+            sincosReduce(x, r, j);
+            
+            float y = (j & 2) ? cosPoly(r) : sinPoly(r);
+            
+            // sin is odd, and changes sign every half period; the sign bit
+            // rather than x < 0 keeps sin(-0) = -0
+            bool bNegative = ((j & 4) != 0) != ((asInt(x) >> 31) != 0);
+            return bNegative ? -y : y;
+        }
+        
+        inline float cosReduced(float x)
+        {
+            float r;
+            int32_t j;
+            sincosReduce(x, r, j);
+            
+            float y = (j & 2) ? sinPoly(r) : cosPoly(r);
+            
+            bool bNegative = (((j + 2) & 4) != 0);
+            return bNegative ? -y : y;
+        }
+        
+        inline float sin(float x)
+        {
+            return fabsf(x) <= SINCOS_MAX_ARG ? sinReduced(x) : sinf(x);
+        }
+        
+        inline float cos(float x)
+        {
+            return fabsf(x) <= SINCOS_MAX_ARG ? cosReduced(x) : cosf(x);
+        }
+        
+        // true if every |src[i]| <= SINCOS_MAX_ARG; compares the magnitude
+        // bits, which order like the floats and put infinities and NaN last
+        inline bool sincosInRange(const float *src, size_t n)
+        {
+            uint32_t largest = 0;
+            for (size_t i = 0; i < n; i++) {
+                largest = std::max(largest, asInt(src[i]) & 0x7fffffff);
+            }
+            return largest <= asInt(SINCOS_MAX_ARG);
+        }
+        // ---------------------------------------------------------------------
+        
+        // ---------------------------------------------------------------------
+        inline float sqrt(float x)
+        {
+            return sqrtf(x);
+        }
+        // ---------------------------------------------------------------------
+        
+        
+        // ---------------------------------------------------------------------
+        //  Array forms: dst[i] = f(src[i]) for i in [0, n)
+        // ---------------------------------------------------------------------
+        inline void exp(float *dst, const float *src, size_t n)
+        {
+            for (size_t i = 0; i < n; i++) {
+                dst[i] = exp(src[i]);
+            }
+        }
+        
+        inline void log(float *dst, const float *src, size_t n)
+        {
+            for (size_t i = 0; i < n; i++) {
+                dst[i] = log(src[i]);
+            }
+        }
+        
+        inline void pow(float *dst, const float *src, float p, size_t n)
+        {
+            bool bIntegerPower = floorf(p) == p;
+            bool bOddPower = bIntegerPower && (fmodf(p, 2.0f) != 0.0f);
+            for (size_t i = 0; i < n; i++) {
+                dst[i] = pow(src[i], p, bIntegerPower, bOddPower);
+            }
+        }
+        
+        // blocks are checked before they are written, so that in place calls
+        // still see the input, and only blocks holding a large or non-finite
+        // argument leave the branch-free loop
+        static const size_t SINCOS_BLOCK = 256;
+        
+        inline void sin(float *dst, const float *src, size_t n)
+        {
+            for (size_t b = 0; b < n; b += SINCOS_BLOCK) {
+                size_t end = std::min(n, b + SINCOS_BLOCK);
+                if (sincosInRange(src + b, end - b)) {
+                    for (size_t i = b; i < end; i++) {
+                        dst[i] = sinReduced(src[i]);
+                    }
+                }
+                else {
+                    for (size_t i = b; i < end; i++) {
+                        dst[i] = sin(src[i]);
+                    }
+                }
+            }
+        }
+        
+        inline void cos(float *dst, const float *src, size_t n)
+        {
+            for (size_t b = 0; b < n; b += SINCOS_BLOCK) {
+                size_t end = std::min(n, b + SINCOS_BLOCK);
+                if (sincosInRange(src + b, end - b)) {
+                    for (size_t i = b; i < end; i++) {
+                        dst[i] = cosReduced(src[i]);
+                    }
+                }
+                else {
+                    for (size_t i = b; i < end; i++) {
+                        dst[i] = cos(src[i]);
+                    }
+                }
+            }
+        }
+        
+        inline void sqrt(float *dst, const float *src, size_t n)
+        {
+            for (size_t i = 0; i < n; i++) {
+                dst[i] = sqrtf(src[i]);
+            }
+        }
+        // ---------------------------------------------------------------------
+        
+        // ---------------------------------------------------------------------
+        //  sum |a[i] - b[i]| and sum (a[i] - b[i])^2.  Accumulated in 8
+        //  independent lanes, which lets the compiler vectorize the reduction
+        //  without -ffast-math (and changes the rounding slightly against a
+        //  sequential sum)
+        // ---------------------------------------------------------------------
+        inline float l1Distance(const float *a, const float *b, size_t n)
+        {
+            float acc[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                for (size_t j = 0; j < 8; j++) {
+                    acc[j] += fabsf(a[i + j] - b[i + j]);
+                }
+            }
+            float sum = ((acc[0] + acc[4]) + (acc[1] + acc[5])) + ((acc[2] + acc[6]) + (acc[3] + acc[7]));
+            for (; i < n; i++) {
+                sum += fabsf(a[i] - b[i]);
+            }
+            return sum;
+        }
+        
+        inline float squaredL2Distance(const float *a, const float *b, size_t n)
+        {
+            float acc[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                for (size_t j = 0; j < 8; j++) {
+                    float v = a[i + j] - b[i + j];
+                    acc[j] += v * v;
+                }
+            }
+            float sum = ((acc[0] + acc[4]) + (acc[1] + acc[5])) + ((acc[2] + acc[6]) + (acc[3] + acc[7]));
+            for (; i < n; i++) {
+                float v = a[i] - b[i];
+                sum += v * v;
+            }
+            return sum;
+        }
+        // ---------------------------------------------------------------------
+        
+        // ---------------------------------------------------------------------
+        //  log(sum_i exp(src[i * stride])) without overflow or underflow, and
+        //  without a temporary buffer: max(src) + log(sum(exp(src - max(src))))
+        // ---------------------------------------------------------------------
+        inline float logSumExp(const float *src, size_t n, size_t stride = 1)
+        {
+            if (n == 0) {
+                return -HUGE_VALF;
+            }
+            
+            float maxval = src[0];
+            for (size_t i = 1; i < n; i++) {
+                float v = src[i * stride];
+                maxval = v > maxval ? v : maxval;
+            }
+            
+            // all -inf (or +inf): nothing to rescale
+            if (maxval == HUGE_VALF || maxval == -HUGE_VALF) {
+                return maxval;
+            }
+            
+            float sum = 0.0f;
+            for (size_t i = 0; i < n; i++) {
+                sum += exp(src[i * stride] - maxval);
+            }
+            return maxval + log(sum);
+        }
+        // ---------------------------------------------------------------------
+    };
+};
@@ -78,7 +78,12 @@
  */
 
 #include "pkmMatrix.h"
+#include "pkmParallel.h"
+#include "pkmCovariance.h"
+#include "pkmMultivariateGaussian.h"
+#include "pkmSmallMat.h"
 #include <math.h>
+#include <random>
 
 using namespace pkm;
 
@@ -89,6 +94,7 @@ Mat::Mat()
 	rows = cols = 0;
 	data = NULL;
 	bAllocated = false;
+	capacity = 0;
 	current_row = 0;
 	bCircularInsertionFull = false;
 }
@@ -110,9 +116,12 @@ Mat::Mat(const std::vector<float> m)
 {
     rows = 1;
     cols = m.size();
+    data = NULL;
+    capacity = 0;
     if(rows*cols > 0)
     {
-        data = (float *)malloc(sizeof(float)*MULTIPLE_OF_4(cols));
+        data = allocate(sizeof(float)*MULTIPLE_OF_4(cols));
+        capacity = MULTIPLE_OF_4(cols);
         cblas_scopy(cols, &m[0], 1, data, 1);
     }
 	current_row = 0;
@@ -125,9 +134,12 @@ Mat::Mat(const std::vector<std::vector<float> > m)
 {
     rows = m.size();
     cols = m[0].size();
+    data = NULL;
+    capacity = 0;
     if(rows*cols > 0)
     {
-        data = (float *)malloc(sizeof(float)*MULTIPLE_OF_4(rows*cols));
+        data = allocate(sizeof(float)*MULTIPLE_OF_4(rows*cols));
+        capacity = MULTIPLE_OF_4(rows*cols);
         
         for(size_t i = 0; i < rows; i++)
             cblas_scopy(cols, &(m[i][0]), 1, data+i*cols, 1);
@@ -144,7 +156,8 @@ Mat::Mat(const cv::Mat &m)
 {
     rows = m.rows;
     cols = m.cols;
-    data = (float *)malloc(sizeof(float)*MULTIPLE_OF_4(rows*cols));
+    data = allocate(sizeof(float)*MULTIPLE_OF_4(rows*cols));
+    capacity = MULTIPLE_OF_4(rows*cols);
     
     for(size_t i = 0; i < rows; i++)
         cblas_scopy(cols, m.ptr<float>(i), 1, data+i*cols, 1);
@@ -170,7 +183,8 @@ Mat::Mat(size_t r, size_t c, bool clear)
 	cols = c;
 	current_row = 0;
 	bCircularInsertionFull = false;
-	data = (float *)malloc(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+	data = allocate(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+	capacity = MULTIPLE_OF_4(rows * cols);
 
 	bAllocated = true;
 	
@@ -197,7 +211,8 @@ Mat::Mat(size_t r, size_t c, const float *existing_buffer)
     current_row = 0;
     bCircularInsertionFull = false;
     
-    data = (float *)malloc(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+    data = allocate(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+    capacity = MULTIPLE_OF_4(rows * cols);
         
     cblas_scopy(rows*cols, existing_buffer, 1, data, 1);
     
@@ -219,9 +234,12 @@ Mat::Mat(size_t r, size_t c, float *existing_buffer, bool withCopy)
 	current_row = 0;
 	bCircularInsertionFull = false;
 	
+	capacity = 0;
+	
 	if(withCopy)
 	{
-		data = (float *)malloc(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+		data = allocate(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+		capacity = MULTIPLE_OF_4(rows * cols);
 		
 		cblas_scopy(rows*cols, existing_buffer, 1, data, 1);
         //memcpy(data, existing_buffer, sizeof(float)*r*c);
@@ -247,7 +265,8 @@ Mat::Mat(size_t r, size_t c, float val)
 	current_row = 0;
 	bCircularInsertionFull = false;
 	
-	data = (float *)malloc(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+	data = allocate(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+	capacity = MULTIPLE_OF_4(rows * cols);
 	
 	bAllocated = true;
 	
@@ -263,14 +282,18 @@ Mat::Mat(const Mat &rhs)
 {
 	if(rhs.bAllocated)
 	{
+		PKM_INSTRUMENT_OP("copy", sizeof(float) * rhs.rows * rhs.cols, 0);
 		rows = rhs.rows;
 		cols = rhs.cols;
 		current_row = rhs.current_row;
 		bCircularInsertionFull = rhs.bCircularInsertionFull;
         bUserData = false;
+        data = NULL;
+        capacity = 0;
         if(rows * cols > 0)
         {
-            data = (float *)malloc(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+            data = allocate(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+            capacity = MULTIPLE_OF_4(rows * cols);
             memcpy(data, rhs.data, rows * cols * sizeof(float));
         }
 		bAllocated = true;
@@ -284,6 +307,7 @@ Mat::Mat(const Mat &rhs)
         bUserData = rhs.bUserData;
         bAllocated = rhs.bAllocated;
         data = rhs.data;
+        capacity = 0;
     }
 	else {
 		rows = 0;
@@ -294,6 +318,7 @@ Mat::Mat(const Mat &rhs)
 		data = NULL;
 		bUserData = false;
 		bAllocated = false;
+		capacity = 0;
 	}
 }
 
@@ -305,12 +330,15 @@ Mat & Mat::operator=(const Mat &rhs)
 	
 	if(rhs.size())
 	{
-        if(bAllocated && size() == rhs.size())
+		PKM_INSTRUMENT_OP("copy", sizeof(float) * rhs.size(), 0);
+        // reuse our own storage whenever it is large enough
+        if(bAllocated && !bUserData && rhs.size() <= capacity)
         {
-            memcpy(data, rhs.data, sizeof(float)*rows*cols);
-            
             rows = rhs.rows;
             cols = rhs.cols;
+            
+            // rhs may be a view into our own buffer
+            memmove(data, rhs.data, sizeof(float)*rows*cols);
         }
         else {
 
@@ -319,7 +347,8 @@ Mat & Mat::operator=(const Mat &rhs)
             rows = rhs.rows;
             cols = rhs.cols;
             
-            data = (float *)malloc(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+            data = allocate(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+            capacity = MULTIPLE_OF_4(rows * cols);
             memcpy(data, rhs.data, sizeof(float)*rows*cols);
             bAllocated = true;
 
@@ -364,7 +393,8 @@ Mat & Mat::operator=(const std::vector<float> &rhs)
 			
             releaseMemory();
 			
-			data = (float *)malloc(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+			data = allocate(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+			capacity = MULTIPLE_OF_4(rows * cols);
 			
 			bAllocated = true;
 		}
@@ -408,7 +438,8 @@ Mat & Mat::operator=(const std::vector<std::vector<float> > &rhs)
 			
             releaseMemory();
 			
-			data = (float *)malloc(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+			data = allocate(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+			capacity = MULTIPLE_OF_4(rows * cols);
 			
 			bAllocated = true;
 		}
@@ -453,7 +484,8 @@ Mat & Mat::operator=(const cv::Mat &rhs)
 			
             releaseMemory();
 			
-			data = (float *)malloc(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+			data = allocate(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+			capacity = MULTIPLE_OF_4(rows * cols);
 			
 			bAllocated = true;
 		}
@@ -504,6 +536,7 @@ Mat Mat::getTranspose() const
 #ifndef DEBUG			
 	assert(data != NULL);
 #endif	
+	PKM_INSTRUMENT_OP("transpose", 2 * sizeof(float) * rows * cols, 0);
 	Mat transposedMatrix(cols, rows);
 	
 	if (rows == 1 || cols == 1) {
@@ -604,8 +637,11 @@ Mat Mat::abs(const Mat &A)
     assert(A.rows >0 &&
            A.cols >0);
 #endif	
+    PKM_INSTRUMENT_OP("abs", 2 * sizeof(float) * A.rows * A.cols, A.rows * A.cols);
 	Mat newMat(A.rows, A.cols);
-    vDSP_vabs(A.data, 1, newMat.data, 1, A.rows * A.cols);
+    parallelForElements(A.rows * A.cols, [&](size_t i0, size_t i1) {
+        vDSP_vabs(A.data + i0, 1, newMat.data + i0, 1, i1 - i0);
+    });
     return newMat;
 }
 
@@ -616,7 +652,10 @@ void Mat::abs()
     assert(rows >0 &&
            cols >0);
 #endif	
-    vDSP_vabs(data, 1, data, 1, rows * cols);
+    PKM_INSTRUMENT_OP("abs", 2 * sizeof(float) * rows * cols, rows * cols);
+    parallelForElements(rows * cols, [&](size_t i0, size_t i1) {
+        vDSP_vabs(data + i0, 1, data + i0, 1, i1 - i0);
+    });
 }
 
 /*
@@ -693,6 +732,7 @@ Mat Mat::rand(size_t r, size_t c, float low, float high)
 
 Mat Mat::sum(bool across_rows)
 {
+	PKM_INSTRUMENT_OP("sum", sizeof(float) * rows * cols, rows * cols);
 	// sum across rows
 	if(across_rows)
 	{
@@ -714,35 +754,197 @@ Mat Mat::sum(bool across_rows)
 	
 }
 
+// max(x) + log(sum(exp(x - max(x)))) of each column, accumulated a row at a
+// time so that the inner loops run over contiguous memory
+static void columnLogSumExp(const float *data, size_t rows, size_t cols, size_t c0, size_t c1, float *result)
+{
+    size_t n = c1 - c0;
+    std::vector<float> maxvals(data + c0, data + c1);
+    for (size_t r = 1; r < rows; r++) {
+        const float *p = data + r*cols + c0;
+        for (size_t c = 0; c < n; c++) {
+            maxvals[c] = p[c] > maxvals[c] ? p[c] : maxvals[c];
+        }
+    }
+    
+    std::vector<float> sums(n, 0.0f), buf(n);
+    for (size_t r = 0; r < rows; r++) {
+        const float *p = data + r*cols + c0;
+        for (size_t c = 0; c < n; c++) {
+            buf[c] = p[c] - maxvals[c];
+        }
+        pkm::vectorExp(&(buf[0]), &(buf[0]), n);
+        vDSP_vadd(&(sums[0]), 1, &(buf[0]), 1, &(sums[0]), 1, n);
+    }
+    
+    for (size_t c = 0; c < n; c++) {
+        // a column of -inf (or +inf) has nothing to rescale
+        result[c] = isinf(maxvals[c]) ? maxvals[c] : maxvals[c] + logf(sums[c]);
+    }
+}
+
+Mat Mat::logSumExp(bool across_rows) const
+{
+#ifdef DEBUG
+    assert(data != NULL);
+    assert(rows > 0 && cols > 0);
+#endif
+    // max, subtract, exp and add per element
+    PKM_INSTRUMENT_OP("logSumExp", sizeof(float) * rows * cols, 4 * rows * cols);
+    // one value per column
+    if(across_rows)
+    {
+        Mat result(1, cols);
+        float *result_data = result.data;
+        const float *src = data;
+        size_t r = rows, c = cols;
+        parallelFor(0, cols, std::max<size_t>(64, PARALLEL_GRAIN_ELEMENTS / std::max<size_t>(1, rows)), [=](size_t c0, size_t c1) {
+            columnLogSumExp(src, r, c, c0, c1, result_data + c0);
+        });
+        return result;
+    }
+    // one value per row
+    else
+    {
+        Mat result(rows, 1);
+        float *result_data = result.data;
+        const float *src = data;
+        size_t c = cols;
+        parallelFor(0, rows, parallelRowGrain(cols), [=](size_t r0, size_t r1) {
+            for (size_t i = r0; i < r1; i++) {
+                result_data[i] = pkm::vectorLogSumExp(src + i*c, c);
+            }
+        });
+        return result;
+    }
+}
+
+// softmax of a vector whose maximum is infinite: the +inf entries share the
+// mass equally, and a vector of only -inf is uniform.  bLog writes the log
+// probabilities instead
+static void infiniteSoftmax(float *p, size_t n, float maxval, bool bLog)
+{
+    size_t count = n;
+    if (maxval == HUGE_VALF) {
+        count = 0;
+        for (size_t i = 0; i < n; i++) {
+            count += p[i] == HUGE_VALF;
+        }
+    }
+    float prob = 1.0f / (float)count, zero = 0.0f;
+    if (bLog) {
+        prob = -logf((float)count);
+        zero = -HUGE_VALF;
+    }
+    for (size_t i = 0; i < n; i++) {
+        p[i] = (maxval == -HUGE_VALF || p[i] == HUGE_VALF) ? prob : zero;
+    }
+}
+
+void Mat::setSoftmax(bool row_major)
+{
+#ifdef DEBUG
+    assert(data != NULL);
+#endif
+    if (!row_major) {
+        setTranspose();
+        setSoftmax(true);
+        setTranspose();
+        return;
+    }
+    
+    PKM_INSTRUMENT_OP("softmax", 2 * sizeof(float) * rows * cols, 5 * rows * cols);
+    float *dst = data;
+    size_t c = cols;
+    parallelFor(0, rows, parallelRowGrain(cols), [=](size_t r0, size_t r1) {
+        for (size_t i = r0; i < r1; i++) {
+            float *p = dst + i*c;
+            float maxval;
+            vDSP_maxv(p, 1, &maxval, c);
+            if (isinf(maxval)) {
+                infiniteSoftmax(p, c, maxval, false);
+                continue;
+            }
+            maxval = -maxval;
+            vDSP_vsadd(p, 1, &maxval, p, 1, c);
+            pkm::vectorExp(p, p, c);
+            float sumval;
+            vDSP_sve(p, 1, &sumval, c);
+            vDSP_vsdiv(p, 1, &sumval, p, 1, c);
+        }
+    });
+}
+
+Mat Mat::getSoftmax(bool row_major) const
+{
+    Mat result(*this);
+    result.setSoftmax(row_major);
+    return result;
+}
+
+void Mat::setLogSoftmax(bool row_major)
+{
+#ifdef DEBUG
+    assert(data != NULL);
+#endif
+    if (!row_major) {
+        setTranspose();
+        setLogSoftmax(true);
+        setTranspose();
+        return;
+    }
+    
+    PKM_INSTRUMENT_OP("logSoftmax", 2 * sizeof(float) * rows * cols, 5 * rows * cols);
+    float *dst = data;
+    size_t c = cols;
+    parallelFor(0, rows, parallelRowGrain(cols), [=](size_t r0, size_t r1) {
+        for (size_t i = r0; i < r1; i++) {
+            float *p = dst + i*c;
+            float lse = -pkm::vectorLogSumExp(p, c);
+            if (isinf(lse)) {
+                infiniteSoftmax(p, c, -lse, true);
+                continue;
+            }
+            vDSP_vsadd(p, 1, &lse, p, 1, c);
+        }
+    });
+}
+
 // normalize the values for each row-std::vector
 void Mat::setNormalize(bool row_major)
 {
+	// min and max, then subtract and divide
+	PKM_INSTRUMENT_OP("setNormalize", 3 * sizeof(float) * rows * cols, 4 * rows * cols);
 	if (row_major) {
-		for (size_t r = 0; r < rows; r++) {
-			float min, max;
-			vDSP_minv(&(data[r*cols]), 1, &min, cols);
-			vDSP_maxv(&(data[r*cols]), 1, &max, cols);
-			float height = max-min;
-			min = -min;
-			vDSP_vsadd(&(data[r*cols]), 1, &min, &(data[r*cols]), 1, cols);
-			if (height != 0) {
-				vDSP_vsdiv(&(data[r*cols]), 1, &height, &(data[r*cols]), 1, cols);	
+		parallelFor(0, rows, parallelRowGrain(cols), [&](size_t r0, size_t r1) {
+			for (size_t r = r0; r < r1; r++) {
+				float min, max;
+				vDSP_minv(&(data[r*cols]), 1, &min, cols);
+				vDSP_maxv(&(data[r*cols]), 1, &max, cols);
+				float height = max-min;
+				min = -min;
+				vDSP_vsadd(&(data[r*cols]), 1, &min, &(data[r*cols]), 1, cols);
+				if (height != 0) {
+					vDSP_vsdiv(&(data[r*cols]), 1, &height, &(data[r*cols]), 1, cols);	
+				}
 			}
-		}			
+		});
 	}
 	// or for each column
 	else {
-		for (size_t c = 0; c < cols; c++) {
-			float min, max;
-			vDSP_minv(&(data[c]), cols, &min, rows);
-			vDSP_maxv(&(data[c]), cols, &max, rows);
-			float height = max-min;
-			min = -min;
-			vDSP_vsadd(&(data[c]), cols, &min, &(data[c]), cols, rows);
-			if (height != 0) {
-				vDSP_vsdiv(&(data[c]), cols, &height, &(data[c]), cols, rows);	
+		parallelFor(0, cols, parallelRowGrain(rows), [&](size_t c0, size_t c1) {
+			for (size_t c = c0; c < c1; c++) {
+				float min, max;
+				vDSP_minv(&(data[c]), cols, &min, rows);
+				vDSP_maxv(&(data[c]), cols, &max, rows);
+				float height = max-min;
+				min = -min;
+				vDSP_vsadd(&(data[c]), cols, &min, &(data[c]), cols, rows);
+				if (height != 0) {
+					vDSP_vsdiv(&(data[c]), cols, &height, &(data[c]), cols, rows);	
+				}
 			}
-		}
+		});
 	}
 }
 
@@ -770,23 +972,28 @@ void Mat::divideEachVecByMaxVecElement(bool row_major)
 
 void Mat::divideEachVecBySum(bool row_major)
 {
+	PKM_INSTRUMENT_OP("divideEachVecBySum", 3 * sizeof(float) * rows * cols, 2 * rows * cols);
 	if (row_major) {
-		for (size_t r = 0; r < rows; r++) {
-			float val;
-			vDSP_sve(data+r*cols, 1, &val, cols);
-			if (val != 0.0f) {
-				vDSP_vsdiv(data+r*cols, 1, &val, data+r*cols, 1, cols);	
+		parallelFor(0, rows, parallelRowGrain(cols), [&](size_t r0, size_t r1) {
+			for (size_t r = r0; r < r1; r++) {
+				float val;
+				vDSP_sve(data+r*cols, 1, &val, cols);
+				if (val != 0.0f) {
+					vDSP_vsdiv(data+r*cols, 1, &val, data+r*cols, 1, cols);	
+				}
 			}
-		}
+		});
 	}
 	else {
-		for (size_t c = 0; c < cols; c++) {
-			float val;
-			vDSP_sve(data+c, cols, &val, rows);
-			if (val != 0.0f) {
-				vDSP_vsdiv(data+c, cols, &val, data+c, cols, rows);	
+		parallelFor(0, cols, parallelRowGrain(rows), [&](size_t c0, size_t c1) {
+			for (size_t c = c0; c < c1; c++) {
+				float val;
+				vDSP_sve(data+c, cols, &val, rows);
+				if (val != 0.0f) {
+					vDSP_vsdiv(data+c, cols, &val, data+c, cols, rows);	
+				}
 			}
-		}
+		});
 	}
 }
 
@@ -847,3 +1054,483 @@ void Mat::print(bool row_major, char delimiter)
 
 
 
+
+/////////////////////////////////////////
+// LAPACK wrappers (see pkmLapack.h)
+/////////////////////////////////////////
+
+// (re)allocate only when the shape changes, so that repeated calls of the
+// same shape reuse the caller's output matrices
+static void reshapeOutput(Mat &m, size_t r, size_t c)
+{
+	if (m.rows != r || m.cols != c || !m.bAllocated || m.bUserData) {
+		m.reset(r, c);
+	}
+}
+
+#ifdef PKM_INSTRUMENT
+// Golub and Van Loan's count for an svd of an m x n matrix, m >= n, with
+// both sets of singular vectors
+static double svdFlops(double m, double n)
+{
+	return 4 * m * m * n + 8 * m * n * n + 9 * n * n * n;
+}
+#endif
+
+long Mat::svd(Mat &U, Mat &S, Mat &V_t) const
+{
+	if (data == NULL || rows == 0 || cols == 0) {
+		printf("[ERROR]: Mat::svd() matrix is empty\n");
+		return -1;
+	}
+	
+	// reading A and writing U, S and V_t
+	PKM_INSTRUMENT_OP("svd", sizeof(float) * (rows * cols + rows * rows + cols * cols + std::min(rows, cols)),
+					  svdFlops(std::max(rows, cols), std::min(rows, cols)));
+	// LAPACK is column-major, so it sees our data as the cols x rows transpose.
+	// Its left singular vectors are our V_t and its right singular vectors
+	// our U, each already in row-major order.
+	__CLPK_integer m = cols;
+	__CLPK_integer n = rows;
+	__CLPK_integer lda = m;
+	__CLPK_integer ldu = m;
+	__CLPK_integer ldvt = n;
+	__CLPK_integer info = 0;
+	size_t nSVs = std::min<size_t>(rows, cols);
+	
+	reshapeOutput(U, rows, rows);
+	reshapeOutput(V_t, cols, cols);
+	reshapeOutput(S, 1, nSVs);
+	
+	LapackWorkspace &workspace = LapackWorkspace::get();
+	__CLPK_real *a = workspace.floats(LapackWorkspace::BUFFER_INPUT, rows*cols);
+	cblas_scopy(rows*cols, data, 1, a, 1);
+	
+	// iwork dimension should be at least 8*min(m,n)
+	__CLPK_integer *iwork = workspace.integers(8*nSVs);
+	
+	//https://groups.google.com/forum/#!topic/julia-dev/mmgO65i6-fA sdd (divide/conquer, better if memory is available, for large matrices) versus svd (qr)
+	char job = 'A';
+	__CLPK_integer lwork = workspace.workSize(LapackWorkspace::ROUTINE_GESDD, rows, cols, job);
+	if (lwork == 0) {
+		__CLPK_real workSize;
+		__CLPK_integer query = -1;
+		sgesdd_(&job, &m, &n, a, &lda, S.data, V_t.data, &ldu, U.data, &ldvt, &workSize, &query, iwork, &info);
+		lwork = (__CLPK_integer)ceilf(workSize);
+		workspace.setWorkSize(LapackWorkspace::ROUTINE_GESDD, rows, cols, job, lwork);
+	}
+	__CLPK_real *work = workspace.floats(LapackWorkspace::BUFFER_WORK, lwork);
+	
+	sgesdd_(&job, &m, &n, a, &lda, S.data, V_t.data, &ldu, U.data, &ldvt, work, &lwork, iwork, &info);
+	
+	if (info > 0) {
+		printf("[ERROR]: Mat::svd() sgesdd_() failed to converge\n");
+	}
+	return info;
+}
+
+void Mat::inv()
+{
+	if (rows != cols) {
+		printf("[ERROR]: Mat::inv() matrix is %lu x %lu, not square\n", rows, cols);
+		return;
+	}
+	
+	PKM_INSTRUMENT_OP("inv", 2 * sizeof(float) * rows * cols, 2.0 * rows * rows * rows);
+	if (rows == 1 && cols == 1) {
+		data[0] = 1.0 / data[0];
+	}
+	else if(rows == 2 && cols == 2) {
+		inv2x2();
+	}
+	else {
+		// the inverse of the transpose is the transpose of the inverse, so the
+		// row-major data can be inverted as it is
+		__CLPK_integer n = rows;
+		__CLPK_integer info = 0;
+		
+		LapackWorkspace &workspace = LapackWorkspace::get();
+		__CLPK_integer *ipiv = workspace.integers(n);
+		
+		sgetrf_(&n, &n, data, &n, ipiv, &info);
+		if (info != 0) {
+			printf("[ERROR]: Mat::inv() LU factorization failed, matrix is singular\n");
+			return;
+		}
+		
+		__CLPK_integer lwork = workspace.workSize(LapackWorkspace::ROUTINE_GETRI, rows, cols, ' ');
+		if (lwork == 0) {
+			__CLPK_real workSize;
+			__CLPK_integer query = -1;
+			sgetri_(&n, data, &n, ipiv, &workSize, &query, &info);
+			lwork = std::max<__CLPK_integer>(n, (__CLPK_integer)ceilf(workSize));
+			workspace.setWorkSize(LapackWorkspace::ROUTINE_GETRI, rows, cols, ' ', lwork);
+		}
+		__CLPK_real *work = workspace.floats(LapackWorkspace::BUFFER_WORK, lwork);
+		
+		sgetri_(&n, data, &n, ipiv, work, &lwork, &info);
+		if (info != 0) {
+			printf("[ERROR]: Mat::inv() sgetri_() failed\n");
+		}
+	}
+}
+
+Mat Mat::getInv() const
+{
+	Mat m(rows, cols);
+	cblas_scopy(rows*cols, data, 1, m.data, 1);
+	m.inv();
+	return m;
+}
+
+long Mat::solve(const Mat &B, Mat &X, bool bSymmetricPositiveDefinite) const
+{
+	if (rows != cols || B.rows != rows || B.cols == 0) {
+		printf("[ERROR]: Mat::solve() cannot solve a %lu x %lu system for a %lu x %lu right hand side\n",
+			   rows, cols, B.rows, B.cols);
+		return -1;
+	}
+	
+	// a Cholesky or LU factorization, then a forward and back substitution
+	// per right hand side
+	PKM_INSTRUMENT_OP("solve", sizeof(float) * (rows * cols + 2 * B.rows * B.cols),
+					  (bSymmetricPositiveDefinite ? 1.0 / 3.0 : 2.0 / 3.0) * rows * rows * rows + 2.0 * rows * rows * B.cols);
+	__CLPK_integer n = rows;
+	__CLPK_integer nrhs = B.cols;
+	__CLPK_integer info = 0;
+	
+	// column-major copies; a symmetric matrix is its own transpose
+	LapackWorkspace &workspace = LapackWorkspace::get();
+	__CLPK_real *a = workspace.floats(LapackWorkspace::BUFFER_INPUT, rows*cols);
+	__CLPK_real *b = workspace.floats(LapackWorkspace::BUFFER_RHS, B.rows*B.cols);
+	if (bSymmetricPositiveDefinite) {
+		cblas_scopy(rows*cols, data, 1, a, 1);
+	}
+	else {
+		vDSP_mtrans(data, 1, a, 1, cols, rows);
+	}
+	if (nrhs == 1) {
+		cblas_scopy(B.rows, B.data, 1, b, 1);
+	}
+	else {
+		vDSP_mtrans(B.data, 1, b, 1, B.cols, B.rows);
+	}
+	
+	if (bSymmetricPositiveDefinite) {
+		char uplo = 'U';
+		sposv_(&uplo, &n, &nrhs, a, &n, b, &n, &info);
+		if (info != 0) {
+			printf("[ERROR]: Mat::solve() sposv_() failed (%ld), matrix is not positive definite\n", (long)info);
+			return info;
+		}
+	}
+	else {
+		__CLPK_integer *ipiv = workspace.integers(n);
+		sgesv_(&n, &nrhs, a, &n, ipiv, b, &n, &info);
+		if (info != 0) {
+			printf("[ERROR]: Mat::solve() sgesv_() failed (%ld), matrix is singular\n", (long)info);
+			return info;
+		}
+	}
+	
+	reshapeOutput(X, B.rows, B.cols);
+	if (nrhs == 1) {
+		cblas_scopy(B.rows, b, 1, X.data, 1);
+	}
+	else {
+		vDSP_mtrans(b, 1, X.data, 1, B.rows, B.cols);
+	}
+	return info;
+}
+
+long Mat::svdTruncated(Mat &U, Mat &S, Mat &V_t, size_t k) const
+{
+	if (data == NULL || rows == 0 || cols == 0) {
+		printf("[ERROR]: Mat::svdTruncated() matrix is empty\n");
+		return -1;
+	}
+	
+	size_t p = std::min<size_t>(rows, cols);
+	if (k == 0 || k > p) {
+		k = p;
+	}
+	
+	PKM_INSTRUMENT_OP("svdTruncated", sizeof(float) * (rows * cols + (rows + cols + 1) * k), svdFlops(std::max(rows, cols), p));
+	// as in svd(), LAPACK factors the cols x rows transpose: its p x rows VT
+	// is our rows x p U and its cols x p U our p x cols V_t
+	__CLPK_integer m = cols;
+	__CLPK_integer n = rows;
+	__CLPK_integer lda = m;
+	__CLPK_integer ldu = m;
+	__CLPK_integer ldvt = p;
+	__CLPK_integer info = 0;
+	
+	LapackWorkspace &workspace = LapackWorkspace::get();
+	__CLPK_real *a = workspace.floats(LapackWorkspace::BUFFER_INPUT, rows*cols);
+	__CLPK_real *s = workspace.floats(LapackWorkspace::BUFFER_SINGULAR_VALUES, p);
+	__CLPK_real *left = workspace.floats(LapackWorkspace::BUFFER_LEFT_VECTORS, rows*p);
+	__CLPK_real *right = workspace.floats(LapackWorkspace::BUFFER_RIGHT_VECTORS, p*cols);
+	__CLPK_integer *iwork = workspace.integers(8*p);
+	cblas_scopy(rows*cols, data, 1, a, 1);
+	
+	char job = 'S';
+	__CLPK_integer lwork = workspace.workSize(LapackWorkspace::ROUTINE_GESDD, rows, cols, job);
+	if (lwork == 0) {
+		__CLPK_real workSize;
+		__CLPK_integer query = -1;
+		sgesdd_(&job, &m, &n, a, &lda, s, right, &ldu, left, &ldvt, &workSize, &query, iwork, &info);
+		lwork = (__CLPK_integer)ceilf(workSize);
+		workspace.setWorkSize(LapackWorkspace::ROUTINE_GESDD, rows, cols, job, lwork);
+	}
+	__CLPK_real *work = workspace.floats(LapackWorkspace::BUFFER_WORK, lwork);
+	
+	sgesdd_(&job, &m, &n, a, &lda, s, right, &ldu, left, &ldvt, work, &lwork, iwork, &info);
+	if (info > 0) {
+		printf("[ERROR]: Mat::svdTruncated() sgesdd_() failed to converge\n");
+		return info;
+	}
+	
+	// keep the first k columns of U and rows of V_t
+	reshapeOutput(U, rows, k);
+	reshapeOutput(S, 1, k);
+	reshapeOutput(V_t, k, cols);
+	for (size_t r = 0; r < rows; r++) {
+		cblas_scopy(k, left + r*p, 1, U.data + r*k, 1);
+	}
+	cblas_scopy(k, s, 1, S.data, 1);
+	cblas_scopy(k*cols, right, 1, V_t.data, 1);
+	return info;
+}
+
+// replace the m x n column-major 'a' (m >= n) by an orthonormal basis of its
+// columns (Householder QR)
+static long orthonormalizeColumns(__CLPK_real *a, size_t m, size_t n)
+{
+	__CLPK_integer M = m;
+	__CLPK_integer N = n;
+	__CLPK_integer info = 0;
+	
+	LapackWorkspace &workspace = LapackWorkspace::get();
+	__CLPK_real *tau = workspace.floats(LapackWorkspace::BUFFER_REFLECTORS, n);
+	
+	__CLPK_integer lwork = std::max(workspace.workSize(LapackWorkspace::ROUTINE_GEQRF, m, n, ' '),
+									workspace.workSize(LapackWorkspace::ROUTINE_ORGQR, m, n, ' '));
+	if (lwork == 0) {
+		__CLPK_real qrSize, qSize;
+		__CLPK_integer query = -1;
+		sgeqrf_(&M, &N, a, &M, tau, &qrSize, &query, &info);
+		sorgqr_(&M, &N, &N, a, &M, tau, &qSize, &query, &info);
+		workspace.setWorkSize(LapackWorkspace::ROUTINE_GEQRF, m, n, ' ', (__CLPK_integer)ceilf(qrSize));
+		workspace.setWorkSize(LapackWorkspace::ROUTINE_ORGQR, m, n, ' ', (__CLPK_integer)ceilf(qSize));
+		lwork = std::max((__CLPK_integer)ceilf(qrSize), (__CLPK_integer)ceilf(qSize));
+	}
+	__CLPK_real *work = workspace.floats(LapackWorkspace::BUFFER_WORK, lwork);
+	
+	sgeqrf_(&M, &N, a, &M, tau, work, &lwork, &info);
+	if (info == 0) {
+		sorgqr_(&M, &N, &N, a, &M, tau, work, &lwork, &info);
+	}
+	return info;
+}
+
+long Mat::svdRandomized(Mat &U, Mat &S, Mat &V_t, size_t k,
+						size_t powerIterations, size_t oversamples, unsigned long seed) const
+{
+	size_t p = std::min<size_t>(rows, cols);
+	if (data == NULL || rows == 0 || cols == 0 || k == 0) {
+		printf("[ERROR]: Mat::svdRandomized() matrix is empty or no components were asked for\n");
+		return -1;
+	}
+	k = std::min(k, p);
+	size_t l = std::min(k + oversamples, p);
+	
+	// two products with A per power iteration, plus the sketch and the
+	// projection; the small svd and QRs are counted on their own
+	PKM_INSTRUMENT_OP("svdRandomized", sizeof(float) * (rows * cols * (2 * powerIterations + 2) + (rows + cols + 1) * k),
+					  2.0 * rows * cols * l * (2 * powerIterations + 2));
+	// Gaussian test matrix, stored transposed (l x cols)
+	Mat omega(l, cols);
+	std::mt19937 rng(seed);
+	std::normal_distribution<float> gaussian;
+	for (size_t i = 0; i < l*cols; i++) {
+		omega.data[i] = gaussian(rng);
+	}
+	
+	// the range basis Q (rows x l) is kept column-major, i.e. as the row-major
+	// l x rows Q^T, which is what the products below need
+	LapackWorkspace &workspace = LapackWorkspace::get();
+	__CLPK_real *qt = workspace.floats(LapackWorkspace::BUFFER_RANGE, l*rows);
+	Mat projection(l, cols);
+	long info = 0;
+	
+	// Y^T = Omega^T A^T
+	cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, l, rows, cols,
+				1.0f, omega.data, cols, data, cols, 0.0f, qt, rows);
+	info = orthonormalizeColumns(qt, rows, l);
+	
+	for (size_t i = 0; i < powerIterations && info == 0; i++)
+	{
+		// Z^T = Q^T A, re-orthonormalized, then Y^T = Z^T A^T
+		cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, l, cols, rows,
+					1.0f, qt, rows, data, cols, 0.0f, projection.data, cols);
+		info = orthonormalizeColumns(projection.data, cols, l);
+		if (info == 0) {
+			cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, l, rows, cols,
+						1.0f, projection.data, cols, data, cols, 0.0f, qt, rows);
+			info = orthonormalizeColumns(qt, rows, l);
+		}
+	}
+	if (info != 0) {
+		printf("[ERROR]: Mat::svdRandomized() QR factorization failed\n");
+		return info;
+	}
+	
+	// B = Q^T A (l x cols) = U_B S V_t, so A ~ (Q U_B) S V_t
+	cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, l, cols, rows,
+				1.0f, qt, rows, data, cols, 0.0f, projection.data, cols);
+	Mat U_B;
+	info = projection.svdTruncated(U_B, S, V_t, k);
+	if (info != 0) {
+		return info;
+	}
+	
+	// the small svd used the workspace, but not the range buffer
+	reshapeOutput(U, rows, k);
+	cblas_sgemm(CblasRowMajor, CblasTrans, CblasNoTrans, rows, k, l,
+				1.0f, qt, rows, U_B.data, k, 0.0f, U.data, k);
+	return info;
+}
+
+long Mat::eigSymmetric(Mat &values, Mat &vectors, size_t k) const
+{
+	if (data == NULL || rows == 0 || rows != cols) {
+		printf("[ERROR]: Mat::eigSymmetric() matrix is %lu x %lu, not square\n", rows, cols);
+		return -1;
+	}
+	if (k == 0 || k > rows) {
+		k = rows;
+	}
+	
+	// tridiagonal reduction, then k eigenvectors back-transformed
+	PKM_INSTRUMENT_OP("eigSymmetric", sizeof(float) * (rows * cols + (rows + 1) * k),
+					  4.0 / 3.0 * rows * rows * rows + 2.0 * rows * rows * k);
+	// a symmetric matrix is the same in row and column-major order; LAPACK's
+	// lower triangle is our upper triangle
+	__CLPK_integer n = rows;
+	__CLPK_integer il = n - k + 1;
+	__CLPK_integer iu = n;
+	__CLPK_integer found = 0;
+	__CLPK_integer info = 0;
+	__CLPK_real vl = 0, vu = 0, abstol = 0;
+	char jobz = 'V';
+	char range = k == rows ? 'A' : 'I';
+	char uplo = 'L';
+	
+	LapackWorkspace &workspace = LapackWorkspace::get();
+	__CLPK_real *a = workspace.floats(LapackWorkspace::BUFFER_INPUT, rows*cols);
+	__CLPK_real *w = workspace.floats(LapackWorkspace::BUFFER_SINGULAR_VALUES, rows);
+	__CLPK_real *z = workspace.floats(LapackWorkspace::BUFFER_EIGENVECTORS, rows*k);
+	__CLPK_integer *isuppz = workspace.supports(2*k);
+	cblas_scopy(rows*cols, data, 1, a, 1);
+	
+	// ssyevr needs both a float and an integer work size; the integer one is
+	// cached under the 'I' job of the same shape
+	__CLPK_integer lwork = workspace.workSize(LapackWorkspace::ROUTINE_SYEVR, rows, k, 'F');
+	__CLPK_integer liwork = workspace.workSize(LapackWorkspace::ROUTINE_SYEVR, rows, k, 'I');
+	if (lwork == 0) {
+		__CLPK_real workSize;
+		__CLPK_integer iworkSize;
+		__CLPK_integer query = -1;
+		ssyevr_(&jobz, &range, &uplo, &n, a, &n, &vl, &vu, &il, &iu, &abstol, &found, w, z, &n, isuppz,
+				&workSize, &query, &iworkSize, &query, &info);
+		lwork = (__CLPK_integer)ceilf(workSize);
+		liwork = iworkSize;
+		workspace.setWorkSize(LapackWorkspace::ROUTINE_SYEVR, rows, k, 'F', lwork);
+		workspace.setWorkSize(LapackWorkspace::ROUTINE_SYEVR, rows, k, 'I', liwork);
+	}
+	__CLPK_real *work = workspace.floats(LapackWorkspace::BUFFER_WORK, lwork);
+	__CLPK_integer *iwork = workspace.integers(liwork);
+	
+	ssyevr_(&jobz, &range, &uplo, &n, a, &n, &vl, &vu, &il, &iu, &abstol, &found, w, z, &n, isuppz,
+			work, &lwork, iwork, &liwork, &info);
+	if (info != 0) {
+		printf("[ERROR]: Mat::eigSymmetric() ssyevr_() failed (%ld)\n", (long)info);
+		return info;
+	}
+	
+	// ascending column-major eigenvectors are ascending rows in row-major
+	// order; reverse both to put the largest first
+	reshapeOutput(values, 1, found);
+	reshapeOutput(vectors, found, rows);
+	for (__CLPK_integer i = 0; i < found; i++) {
+		values.data[i] = w[found - 1 - i];
+		cblas_scopy(rows, z + (found - 1 - i)*rows, 1, vectors.data + i*rows, 1);
+	}
+	return info;
+}
+
+/////////////////////////////////////////
+// covariance (see pkmCovariance.h)
+/////////////////////////////////////////
+
+Mat Mat::cov(bool bUnbiased) const
+{
+	PKM_INSTRUMENT_OP("cov", sizeof(float) * (rows * cols + cols * cols), 2.0 * rows * cols * cols);
+	CovarianceAccumulator statistics;
+	accumulateCovariance(*this, statistics);
+	Mat C;
+	statistics.covariance(C, bUnbiased ? 1.0 : 0.0);
+	return C;
+}
+
+Mat Mat::cov(const Mat &weights) const
+{
+	if (weights.rows * weights.cols != rows) {
+		printf("[ERROR]: Mat::cov() %lu weights for %lu observations\n", weights.rows * weights.cols, rows);
+		return Mat();
+	}
+	PKM_INSTRUMENT_OP("cov", sizeof(float) * (rows * cols + rows + cols * cols), 2.0 * rows * cols * cols);
+	CovarianceAccumulator statistics;
+	accumulateCovariance(*this, statistics, weights.data);
+	Mat C;
+	statistics.covariance(C, 0.0);
+	return C;
+}
+
+Mat Mat::corrcoef() const
+{
+	Mat C = cov();
+	const size_t D = C.rows;
+	std::vector<float> scale(D);
+	for (size_t i = 0; i < D; i++) {
+		float v = C.data[i*D + i];
+		scale[i] = v > 0 ? 1.0f / sqrtf(v) : 0.0f;
+	}
+	for (size_t i = 0; i < D; i++) {
+		for (size_t j = 0; j < D; j++) {
+			C.data[i*D + j] *= scale[i] * scale[j];
+		}
+		if (scale[i] > 0) {
+			C.data[i*D + i] = 1.0f;
+		}
+	}
+	return C;
+}
+
+float Mat::gaussianPosterior(const Mat &input, const Mat &mean, const Mat &sigma)
+{
+	if (input.rows * input.cols != sigma.rows) {
+		printf("[ERROR]: Mat::gaussianPosterior() %lu values for a %lu x %lu covariance\n", input.rows * input.cols, sigma.rows, sigma.cols);
+		return 0.0f;
+	}
+	// small covariances are factored on the stack
+	const size_t D = sigma.rows;
+	if (D <= SMALL_MAT_MAX_SIZE && sigma.cols == D && mean.rows * mean.cols == D) {
+		return (float)smallGaussianDensity(D, input.data, mean.data, sigma.data);
+	}
+	pkmMultivariateGaussian gaussian;
+	if (!gaussian.set(mean, sigma)) {
+		return 0.0f;
+	}
+	return (float)gaussian.density(input.data);
+}
@@ -83,6 +83,10 @@
 #include <assert.h>
 #include <Accelerate/Accelerate.h>
 #include <vector>
+#include "pkmMath.h"
+#include "pkmLapack.h"
+#include "pkmInstrument.h"
+#include "pkmParallel.h"
 
 #ifdef OPENCV
 #define HAVE_OPENCV
@@ -112,12 +116,116 @@
 //#define MULTIPLE_OF_4(x) ((x | 0x03) + 1)
 #define MULTIPLE_OF_4(x) x
 
+// uncomment next line to use pkmMath's polynomial kernels instead of vForce
+// for every array sqrt, sin, cos, log, exp, pow and log-sum-exp; they are
+// only faster when built with -O3 and the host's vector ISA (-march=native)
+//#define USE_PKM_MATH
+
+// build every file with -DPKM_INSTRUMENT to count the calls, bytes, FLOPs and
+// time of Mat operations; see pkmInstrument.h
+
 template <typename T> long signum(T val) {
     return (T(0) < val) - (val < T(0));
 }
 
 namespace pkm
 {
+    // -------------------------------------------------------------------------
+    //  Array math for Mat and the models built on it, dst may equal src.  All
+    //  of it goes through vForce unless USE_PKM_MATH selects pkmMath.
+    // -------------------------------------------------------------------------
+    inline void vectorSqrt(float *dst, const float *src, size_t n)
+    {
+#ifdef USE_PKM_MATH
+        pkm::math::sqrt(dst, src, n);
+#else
+        int size = (int)n;
+        vvsqrtf(dst, src, &size);
+#endif
+    }
+    
+    inline void vectorSin(float *dst, const float *src, size_t n)
+    {
+#ifdef USE_PKM_MATH
+        pkm::math::sin(dst, src, n);
+#else
+        int size = (int)n;
+        vvsinf(dst, src, &size);
+#endif
+    }
+    
+    inline void vectorCos(float *dst, const float *src, size_t n)
+    {
+#ifdef USE_PKM_MATH
+        pkm::math::cos(dst, src, n);
+#else
+        int size = (int)n;
+        vvcosf(dst, src, &size);
+#endif
+    }
+    
+    inline void vectorLog(float *dst, const float *src, size_t n)
+    {
+#ifdef USE_PKM_MATH
+        pkm::math::log(dst, src, n);
+#else
+        int size = (int)n;
+        vvlogf(dst, src, &size);
+#endif
+    }
+    
+    inline void vectorExp(float *dst, const float *src, size_t n)
+    {
+#ifdef USE_PKM_MATH
+        pkm::math::exp(dst, src, n);
+#else
+        int size = (int)n;
+        vvexpf(dst, src, &size);
+#endif
+    }
+    
+    // vvpowf takes an array of exponents, so a scalar power loops over powf
+    inline void vectorPow(float *dst, const float *src, float p, size_t n)
+    {
+#ifdef USE_PKM_MATH
+        pkm::math::pow(dst, src, p, n);
+#else
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = powf(src[i], p);
+        }
+#endif
+    }
+    
+    // log(sum_i exp(src[i * stride])) without overflow, see pkm::math::logSumExp
+    inline float vectorLogSumExp(const float *src, size_t n, size_t stride = 1)
+    {
+#ifdef USE_PKM_MATH
+        return pkm::math::logSumExp(src, n, stride);
+#else
+        if (n == 0) {
+            return -HUGE_VALF;
+        }
+        
+        float maxval = src[0];
+        for (size_t i = 1; i < n; i++) {
+            float v = src[i * stride];
+            maxval = v > maxval ? v : maxval;
+        }
+        
+        // all -inf (or +inf): nothing to rescale
+        if (maxval == HUGE_VALF || maxval == -HUGE_VALF) {
+            return maxval;
+        }
+        
+        float sum = 0.0f;
+        for (size_t i = 0; i < n; i++) {
+            sum += expf(src[i * stride] - maxval);
+        }
+        return maxval + logf(sum);
+#endif
+    }
+    // -------------------------------------------------------------------------
+    
     // row-major floating point matrix
     class Mat
     {
@@ -166,8 +274,11 @@ namespace pkm
             assert(rows == rhs.rows &&
                    cols == rhs.cols);
 #endif
+            PKM_INSTRUMENT_OP("add", 3 * sizeof(float) * rows * cols, rows * cols);
             Mat newMat(rows, cols);
-            vDSP_vadd(data, 1, rhs.data, 1, newMat.data, 1, rows*cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vadd(data + i0, 1, rhs.data + i0, 1, newMat.data + i0, 1, i1 - i0);
+            });
             return newMat;
         }
         
@@ -177,8 +288,11 @@ namespace pkm
 #ifdef DEBUG
             assert(data != NULL);
 #endif
+            PKM_INSTRUMENT_OP("add", 2 * sizeof(float) * rows * cols, rows * cols);
             Mat newMat(rows, cols);
-            vDSP_vsadd(data, 1, &rhs, newMat.data, 1, rows*cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vsadd(data + i0, 1, &rhs, newMat.data + i0, 1, i1 - i0);
+            });
             return newMat;
         }
         
@@ -190,8 +304,11 @@ namespace pkm
             assert(rows == rhs.rows &&
                    cols == rhs.cols);
 #endif
+            PKM_INSTRUMENT_OP("subtract", 3 * sizeof(float) * rows * cols, rows * cols);
             Mat newMat(rows, cols);
-            vDSP_vsub(rhs.data, 1, data, 1, newMat.data, 1, rows*cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vsub(rhs.data + i0, 1, data + i0, 1, newMat.data + i0, 1, i1 - i0);
+            });
             return newMat;
         }
         
@@ -202,9 +319,12 @@ namespace pkm
 #ifdef DEBUG
             assert(data != NULL);
 #endif
+            PKM_INSTRUMENT_OP("subtract", 2 * sizeof(float) * rows * cols, rows * cols);
             Mat newMat(rows, cols);
             float rhs = -scalar;
-            vDSP_vsadd(data, 1, &rhs, newMat.data, 1, rows*cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vsadd(data + i0, 1, &rhs, newMat.data + i0, 1, i1 - i0);
+            });
             return newMat;
         }
         
@@ -216,6 +336,7 @@ namespace pkm
             assert(rhs.data != NULL);
             assert(cols == rhs.rows);
 #endif
+            PKM_INSTRUMENT_OP("GEMM", sizeof(float) * (rows * cols + rhs.rows * rhs.cols + rows * rhs.cols), 2.0 * rows * cols * rhs.cols);
             
             Mat gemmResult(rows, rhs.cols);
             //ldb must be >= MAX(N,1): ldb=30 N=3533Parameter 11 to routine cblas_sgemm was incorrect
@@ -231,9 +352,12 @@ namespace pkm
 #ifdef DEBUG
             assert(data != NULL);
 #endif
+            PKM_INSTRUMENT_OP("multiply", 2 * sizeof(float) * rows * cols, rows * cols);
             
             Mat gemmResult(rows, cols);
-            vDSP_vsmul(data, 1, &scalar, gemmResult.data, 1, rows*cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vsmul(data + i0, 1, &scalar, gemmResult.data + i0, 1, i1 - i0);
+            });
             
             return gemmResult;
         }
@@ -247,8 +371,11 @@ namespace pkm
             assert(rows == rhs.rows &&
                    cols == rhs.cols);
 #endif
+            PKM_INSTRUMENT_OP("divide", 3 * sizeof(float) * rows * cols, rows * cols);
             Mat result(rows, cols);
-            vDSP_vdiv(rhs.data, 1, data, 1, result.data, 1, rows*cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vdiv(rhs.data + i0, 1, data + i0, 1, result.data + i0, 1, i1 - i0);
+            });
             return result;
         }
         
@@ -257,8 +384,11 @@ namespace pkm
 #ifdef DEBUG
             assert(data != NULL);
 #endif
+            PKM_INSTRUMENT_OP("divide", 2 * sizeof(float) * rows * cols, rows * cols);
             Mat result(rows, cols);
-            vDSP_vsdiv(data, 1, &scalar, result.data, 1, rows*cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vsdiv(data + i0, 1, &scalar, result.data + i0, 1, i1 - i0);
+            });
             return result;
             
         }
@@ -532,14 +662,16 @@ namespace pkm
                 if (r >= rows && c >= cols) {
                     
                     if (bUserData) {
-                        data = (float *)malloc(MULTIPLE_OF_4(r * c) * sizeof(float));
+                        data = allocate(MULTIPLE_OF_4(r * c) * sizeof(float));
+                        capacity = MULTIPLE_OF_4(r * c);
                     }
                     else
                     {
-                        float *temp_data = (float *)malloc(sizeof(float)*MULTIPLE_OF_4(rows*cols));
+                        float *temp_data = allocate(sizeof(float)*MULTIPLE_OF_4(rows*cols));
                         cblas_scopy(rows*cols, data, 1, temp_data, 1);
                         
-                        data = (float *)realloc(data, MULTIPLE_OF_4(r * c) * sizeof(float));
+                        data = reallocate(data, MULTIPLE_OF_4(r * c) * sizeof(float));
+                        capacity = MULTIPLE_OF_4(r * c);
                         cblas_scopy(rows*cols, temp_data, 1, data, 1);
                         
                         free(temp_data);
@@ -570,7 +702,8 @@ namespace pkm
             }
             else
             {
-                data = (float *)malloc(MULTIPLE_OF_4(r * c) * sizeof(float));
+                data = allocate(MULTIPLE_OF_4(r * c) * sizeof(float));
+                capacity = MULTIPLE_OF_4(r * c);
                 rows = r;
                 cols = c;
                 
@@ -597,7 +730,8 @@ namespace pkm
             
             releaseMemory();
             
-            data = (float *)malloc(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+            data = allocate(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+            capacity = MULTIPLE_OF_4(rows * cols);
             
             bAllocated = true;
             bUserData = false;
@@ -621,11 +755,12 @@ namespace pkm
                 longerp_mat[i] = factor*i;
             }
             
-            float *new_data = (float *)malloc(sizeof(float) * MULTIPLE_OF_4(new_size));
+            float *new_data = allocate(sizeof(float) * MULTIPLE_OF_4(new_size));
             
             vDSP_vlint(data, longerp_mat.data, 1, new_data, 1, new_size, old_size);
             free(data);
             data = new_data;
+            capacity = MULTIPLE_OF_4(new_size);
             
             rows = r;
             cols = c;
@@ -671,7 +806,7 @@ namespace pkm
         // like rescale, but 2D information preserved..
         void longerpolate(size_t r, size_t c)
         {
-            float *new_data = (float *)malloc(sizeof(float) * MULTIPLE_OF_4(r * c));
+            float *new_data = allocate(sizeof(float) * MULTIPLE_OF_4(r * c));
             
             vImage_Buffer src = { (void *)data, (vImagePixelCount)rows, (vImagePixelCount)cols, (size_t)(sizeof(float) * cols) };
             vImage_Buffer dest = { (void *)new_data, (vImagePixelCount)r, (vImagePixelCount)c, (size_t)(sizeof(float) * cols) };
@@ -724,6 +859,7 @@ namespace pkm
             
             free(data);
             data = new_data;
+            capacity = MULTIPLE_OF_4(r * c);
             
             rows = r;
             cols = c;
@@ -798,7 +934,8 @@ namespace pkm
             
             releaseMemory();
             
-            data = (float *)malloc(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+            data = allocate(MULTIPLE_OF_4(rows * cols) * sizeof(float));
+            capacity = MULTIPLE_OF_4(rows * cols);
             
             bAllocated = true;
             bUserData = false;
@@ -849,29 +986,66 @@ namespace pkm
             return !(bAllocated && (rows > 0) && (cols > 0));
         }
         
+        // pre-allocate storage for r rows so that push_back() can append
+        // without reallocating.  an empty matrix needs the number of columns.
+        void reserve(size_t r, size_t c = 0)
+        {
+            if (rows == 0 || cols == 0) {
+                if (c == 0) {
+                    printf("[ERROR]: pkm::Mat reserve(r, c) on an empty matrix requires the number of columns!\n");
+                    return;
+                }
+                rows = 0;
+                cols = c;
+            }
+            if (r * cols > capacity || !bAllocated || bUserData) {
+                setCapacity(MULTIPLE_OF_4(r * cols));
+            }
+        }
+        
+        // number of rows that fit in the current allocation
+        inline size_t capacityRows() const
+        {
+            return cols > 0 ? capacity / cols : 0;
+        }
+        
+        // release any storage held beyond rows * cols
+        void shrink_to_fit()
+        {
+            if (!bAllocated || bUserData || capacity == MULTIPLE_OF_4(rows * cols)) {
+                return;
+            }
+            if (rows * cols == 0) {
+                releaseMemory();
+                rows = cols = 0;
+                return;
+            }
+            setCapacity(MULTIPLE_OF_4(rows * cols));
+        }
+        
+        // rows are appended into geometrically grown storage, so building a
+        // matrix one row at a time costs amortized O(cols) per row
         void push_back(const Mat &m)
         {
 #ifdef DEBUG
             if(bUserData)
             {
-                std::cout << "[WARNING]: Pointer to user data will be resized.  Possible leak!" << std::endl;
+                std::cout << "[WARNING]: Pointer to user data will be copied to a new buffer." << std::endl;
             }
 #endif
+            PKM_INSTRUMENT_OP("push_back", sizeof(float) * m.rows * m.cols, 0);
             // we're not empty
             if (!isEmpty()) {
-                if(!m.isEmpty())
+                // m may be a non-owning view (e.g. rowRange(..., false))
+                if(m.data != NULL && m.rows > 0 && m.cols > 0)
                 {
                     if (m.cols == cols){
                         // add more rows, since the columns are the same dimension
-                        float *temp_data = (float *)malloc((rows+m.rows)*cols*sizeof(float));
-                        
-                        cblas_scopy(rows*cols, data, 1, temp_data, 1);
-                        
-                        cblas_scopy(m.rows*m.cols, m.data, 1, temp_data + (rows*cols), 1);
-                        
-                        free(data);
-                        data = temp_data;
-                        
+                        // (m may be a view of our own rows, which can move when we grow)
+                        bool bAliased = (m.data >= data && m.data < data + rows*cols);
+                        size_t offset = bAliased ? m.data - data : 0;
+                        growCapacity((rows+m.rows)*cols);
+                        cblas_scopy(m.rows*m.cols, bAliased ? data + offset : m.data, 1, data + (rows*cols), 1);
                         rows+=m.rows;
                     }
                     else {
@@ -884,7 +1058,7 @@ namespace pkm
                         else
                         {
                             // extend along column dimension
-                            data = (float *)realloc(data, (cols + m.cols)*sizeof(float));
+                            growCapacity(cols + m.cols);
                             cblas_scopy(m.cols, m.data, 1, data + cols, 1);
                             cols += m.cols;
                         }
@@ -912,9 +1086,10 @@ namespace pkm
 #ifdef DEBUG
             if(bUserData)
             {
-                std::cout << "[WARNING]: Pointer to user data will be resized.  Possible leak!" << std::endl;
+                std::cout << "[WARNING]: Pointer to user data will be copied to a new buffer." << std::endl;
             }
 #endif
+            PKM_INSTRUMENT_OP("push_back", sizeof(float) * size, 0);
             if(size > 0)
             {
                 if (bAllocated && (rows > 0) && (cols > 0)) {
@@ -922,41 +1097,31 @@ namespace pkm
                         printf("[ERROR]: pkm::Mat push_back(float *m) requires same number of columns in Mat as length of std::vector!\n");
                         return;
                     }
-                    data = (float *)realloc(data, MULTIPLE_OF_4((rows+1)*cols)*sizeof(float));
+                    growCapacity((rows+1)*cols);
                     cblas_scopy(cols, m, 1, data + (rows*cols), 1);
                     rows++;
                 }
                 else {
+                    // reuses storage from reserve() if there is any
+                    rows = 0;
                     cols = size;
-                    data = (float *)malloc(sizeof(float) * MULTIPLE_OF_4(cols));
+                    growCapacity(cols);
                     cblas_scopy(cols, m, 1, data, 1);
                     rows = 1;
-                    bAllocated = true;
                 }
             }
         }
         
         inline void push_back(const std::vector<float> &m)
         {
-#ifdef DEBUG
-            if(bUserData)
-            {
-                std::cout << "[WARNING]: Pointer to user data will be resized.  Possible leak!" << std::endl;
-            }
-#endif
-            if (bAllocated && rows > 0 && cols > 0) {
-                if (m.size() != cols) {
-                    printf("[ERROR]: pkm::Mat push_back(std::vector<float> m) requires same number of columns in Mat as length of std::vector!\n");
-                    return;
-                }
-                data = (float *)realloc(data, MULTIPLE_OF_4((rows+1)*cols)*sizeof(float));
-                cblas_scopy(cols, &(m[0]), 1, data + (rows*cols), 1);
-                rows++;
+            if (m.size() == 0) {
+                return;
             }
-            else {
-                *this = m;
+            if (bAllocated && rows > 0 && cols > 0 && m.size() != cols) {
+                printf("[ERROR]: pkm::Mat push_back(std::vector<float> m) requires same number of columns in Mat as length of std::vector!\n");
+                return;
             }
-            
+            push_back(&(m[0]), m.size());
         }
         
         inline void push_back(const std::vector<std::vector<float> > &m)
@@ -964,7 +1129,7 @@ namespace pkm
 #ifdef DEBUG
             if(bUserData)
             {
-                std::cout << "[WARNING]: Pointer to user data will be resized.  Possible leak!" << std::endl;
+                std::cout << "[WARNING]: Pointer to user data will be copied to a new buffer." << std::endl;
             }
 #endif
             if (rows > 0 && cols > 0) {
@@ -972,7 +1137,7 @@ namespace pkm
                     printf("[ERROR]: pkm::Mat push_back(std::vector<std::vector<float> > m) requires same number of cols in Mat as length of each std::vector!\n");
                     return;
                 }
-                data = (float *)realloc(data, MULTIPLE_OF_4((rows+m.size())*cols)*sizeof(float));
+                growCapacity((rows+m.size())*cols);
                 for (long i = 0; i < m.size(); i++) {
                     cblas_scopy(cols, &(m[i][0]), 1, data + ((rows+i)*cols), 1);
                 }
@@ -1073,23 +1238,14 @@ namespace pkm
             assert(i < rows);
             assert(i >= 0);
 #endif
-            // are we removing the last row (or only row)?
-            if(i == (rows - 1))
+            // shift the rows after the deleted row up in place; the storage
+            // is kept (see shrink_to_fit()) so that later push_backs can reuse it
+            if(i < (rows - 1))
             {
-                rows--;
-                realloc(data, sizeof(float)*MULTIPLE_OF_4(rows*cols));
-            }
-            // we have to preserve the memory after the deleted row
-            else {
                 size_t numRowsToCopy = rows - i - 1;
-                float *temp_data = (float *)malloc(sizeof(float)*numRowsToCopy * cols);
-                cblas_scopy(numRowsToCopy * cols, row(i+1), 1, temp_data, 1);
-                rows--;
-                realloc(data, sizeof(float)*MULTIPLE_OF_4(rows*cols));
-                cblas_scopy(cols * numRowsToCopy, temp_data, 1, row(i), 1);
-                free(temp_data);
-                temp_data = NULL;
+                memmove(row(i), row(i+1), sizeof(float) * numRowsToCopy * cols);
             }
+            rows--;
         }
         
         // inclusive of start, exclusive of end
@@ -1131,6 +1287,7 @@ namespace pkm
             assert(rhs.rows == rows);
             assert(rhs.cols == cols);
 #endif
+            PKM_INSTRUMENT_OP("copy", sizeof(float) * rows * cols, 0);
             cblas_scopy(rows*cols, rhs.data, 1, data, 1);
             
         }
@@ -1169,7 +1326,10 @@ namespace pkm
                    cols == rhs.cols &&
                    rhs.cols == result.cols);
 #endif
-            vDSP_vmul(data, 1, rhs.data, 1, result.data, 1, rows*cols);
+            PKM_INSTRUMENT_OP("multiply", 3 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vmul(data + i0, 1, rhs.data + i0, 1, result.data + i0, 1, i1 - i0);
+            });
             
         }
         // element-wise multiplication
@@ -1182,9 +1342,12 @@ namespace pkm
             assert(rows == rhs.rows &&
                    cols == rhs.cols);
 #endif
+            PKM_INSTRUMENT_OP("multiply", 3 * sizeof(float) * rows * cols, rows * cols);
             Mat multiplied_matrix(rows, cols);
             
-            vDSP_vmul(data, 1, rhs.data, 1, multiplied_matrix.data, 1, rows*cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vmul(data + i0, 1, rhs.data + i0, 1, multiplied_matrix.data + i0, 1, i1 - i0);
+            });
             return multiplied_matrix;
         }
         
@@ -1196,7 +1359,10 @@ namespace pkm
             assert(rows == result.rows &&
                    cols == result.cols);
 #endif
-            vDSP_vsmul(data, 1, &scalar, result.data, 1, rows*cols);
+            PKM_INSTRUMENT_OP("multiply", 2 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vsmul(data + i0, 1, &scalar, result.data + i0, 1, i1 - i0);
+            });
             
         }
         
@@ -1205,7 +1371,10 @@ namespace pkm
 #ifdef DEBUG
             assert(data != NULL);
 #endif
-            vDSP_vsmul(data, 1, &scalar, data, 1, rows*cols);
+            PKM_INSTRUMENT_OP("multiply", 2 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vsmul(data + i0, 1, &scalar, data + i0, 1, i1 - i0);
+            });
         }
         
         
@@ -1222,7 +1391,10 @@ namespace pkm
                    cols == rhs.cols &&
                    rhs.cols == result.cols);
 #endif
-            vDSP_vdiv(rhs.data, 1, data, 1, result.data, 1, rows*cols);
+            PKM_INSTRUMENT_OP("divide", 3 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vdiv(rhs.data + i0, 1, data + i0, 1, result.data + i0, 1, i1 - i0);
+            });
             
         }
         
@@ -1234,7 +1406,10 @@ namespace pkm
             assert(rows == rhs.rows &&
                    cols == rhs.cols);
 #endif
-            vDSP_vdiv(rhs.data, 1, data, 1, data, 1, rows*cols);
+            PKM_INSTRUMENT_OP("divide", 3 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vdiv(rhs.data + i0, 1, data + i0, 1, data + i0, 1, i1 - i0);
+            });
         }
         
         inline void divide(float scalar, Mat &result) const
@@ -1245,8 +1420,11 @@ namespace pkm
             assert(rows == result.rows &&
                    cols == result.cols);
 #endif
+            PKM_INSTRUMENT_OP("divide", 2 * sizeof(float) * rows * cols, rows * cols);
             
-            vDSP_vsdiv(data, 1, &scalar, result.data, 1, rows*cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vsdiv(data + i0, 1, &scalar, result.data + i0, 1, i1 - i0);
+            });
         }
         
         inline void divide(float scalar)
@@ -1254,7 +1432,10 @@ namespace pkm
 #ifdef DEBUG
             assert(data != NULL);
 #endif
-            vDSP_vsdiv(data, 1, &scalar, data, 1, rows*cols);
+            PKM_INSTRUMENT_OP("divide", 2 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vsdiv(data + i0, 1, &scalar, data + i0, 1, i1 - i0);
+            });
         }
         
         inline void divideUnder(float scalar, Mat &result) const
@@ -1265,8 +1446,11 @@ namespace pkm
             assert(rows == result.rows &&
                    cols == result.cols);
 #endif
+            PKM_INSTRUMENT_OP("divide", 2 * sizeof(float) * rows * cols, rows * cols);
             
-            vDSP_svdiv(&scalar, data, 1, result.data, 1, rows*cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_svdiv(&scalar, data + i0, 1, result.data + i0, 1, i1 - i0);
+            });
         }
         
         inline void divideUnder(float scalar)
@@ -1274,7 +1458,10 @@ namespace pkm
 #ifdef DEBUG
             assert(data != NULL);
 #endif
-            vDSP_svdiv(&scalar, data, 1, data, 1, rows*cols);
+            PKM_INSTRUMENT_OP("divide", 2 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_svdiv(&scalar, data + i0, 1, data + i0, 1, i1 - i0);
+            });
         }
         
         inline void add(const Mat &rhs, Mat &result) const
@@ -1288,7 +1475,10 @@ namespace pkm
                    cols == rhs.cols &&
                    rhs.cols == result.cols);
 #endif
-            vDSP_vadd(data, 1, rhs.data, 1, result.data, 1, rows*cols);
+            PKM_INSTRUMENT_OP("add", 3 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vadd(data + i0, 1, rhs.data + i0, 1, result.data + i0, 1, i1 - i0);
+            });
         }
         
         inline void add(const Mat &rhs)
@@ -1299,7 +1489,10 @@ namespace pkm
             assert(rows == rhs.rows &&
                    cols == rhs.cols);
 #endif
-            vDSP_vadd(data, 1, rhs.data, 1, data, 1, rows*cols);
+            PKM_INSTRUMENT_OP("add", 3 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vadd(data + i0, 1, rhs.data + i0, 1, data + i0, 1, i1 - i0);
+            });
         }
         
         inline void add(float scalar)
@@ -1307,7 +1500,10 @@ namespace pkm
 #ifdef DEBUG
             assert(data != NULL);
 #endif
-            vDSP_vsadd(data, 1, &scalar, data, 1, rows*cols);
+            PKM_INSTRUMENT_OP("add", 2 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vsadd(data + i0, 1, &scalar, data + i0, 1, i1 - i0);
+            });
         }
         
         inline void subtract(const Mat &rhs, Mat &result) const
@@ -1321,13 +1517,18 @@ namespace pkm
                    cols == rhs.cols &&
                    rhs.cols == result.cols);
 #endif
-            vDSP_vsub(rhs.data, 1, data, 1, result.data, 1, rows*cols);
+            PKM_INSTRUMENT_OP("subtract", 3 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vsub(rhs.data + i0, 1, data + i0, 1, result.data + i0, 1, i1 - i0);
+            });
             
         }
         
         inline void clip(float negativeClipAmt, float positiveClipAmt)
         {
-            vDSP_vclip(data, 1, &negativeClipAmt, &positiveClipAmt, data, 1, rows*cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vclip(data + i0, 1, &negativeClipAmt, &positiveClipAmt, data + i0, 1, i1 - i0);
+            });
         }
         
         inline void subtract(const Mat &rhs)
@@ -1338,7 +1539,10 @@ namespace pkm
             assert(rows == rhs.rows &&
                    cols == rhs.cols);
 #endif
-            vDSP_vsub(rhs.data, 1, data, 1, data, 1, rows*cols);
+            PKM_INSTRUMENT_OP("subtract", 3 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vsub(rhs.data + i0, 1, data + i0, 1, data + i0, 1, i1 - i0);
+            });
         }
         
         inline void subtract(float scalar)
@@ -1346,8 +1550,11 @@ namespace pkm
 #ifdef DEBUG
             assert(data != NULL);
 #endif
+            PKM_INSTRUMENT_OP("subtract", 2 * sizeof(float) * rows * cols, rows * cols);
             float rhs = -scalar;
-            vDSP_vsadd(data, 1, &rhs, data, 1, rows*cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vsadd(data + i0, 1, &rhs, data + i0, 1, i1 - i0);
+            });
         }
         
         inline void dot(const Mat &rhs, Mat &result) const
@@ -1365,6 +1572,7 @@ namespace pkm
                    rhs.cols == result.cols &&
                    cols == rhs.rows);
 #endif
+            PKM_INSTRUMENT_OP("GEMM", sizeof(float) * (rows * cols + rhs.rows * rhs.cols + result.rows * result.cols), 2.0 * rows * cols * rhs.cols);
             
             cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, result.rows, result.cols, cols, 1.0f, data, cols, rhs.data, rhs.cols, 0.0f, result.data, result.cols);
             //vDSP_mmul(data, 1, rhs.data, 1, result.data, 1, result.rows, result.cols, cols);
@@ -1383,6 +1591,7 @@ namespace pkm
             assert(rhs.data != NULL);
             assert(cols == rhs.rows);
 #endif
+            PKM_INSTRUMENT_OP("GEMM", sizeof(float) * (rows * cols + rhs.rows * rhs.cols + rows * rhs.cols), 2.0 * rows * cols * rhs.cols);
             
             Mat gemmResult(rows, rhs.cols);
             
@@ -1408,7 +1617,8 @@ namespace pkm
                 rows = tempvar;
             }
             else {
-                float *temp_data = (float *)malloc(sizeof(float)*rows*cols);
+                PKM_INSTRUMENT_OP("transpose", 2 * sizeof(float) * rows * cols, 0);
+                float *temp_data = allocate(sizeof(float)*rows*cols);
                 vDSP_mtrans(data, 1, temp_data, 1, cols, rows);
                 cblas_scopy(rows*cols, temp_data, 1, data, 1);
                 free(temp_data);
@@ -1439,7 +1649,7 @@ namespace pkm
                 size_t diagonal_elements = std::max<size_t>(rows,cols);
                 
                 // create a square matrix
-                float *temp_data = (float *)malloc(diagonal_elements*diagonal_elements*sizeof(float));
+                float *temp_data = allocate(diagonal_elements*diagonal_elements*sizeof(float));
                 
                 // set values to 0
                 vDSP_vclr(temp_data, 1, diagonal_elements*diagonal_elements);
@@ -1452,12 +1662,17 @@ namespace pkm
                 // store in data
                 rows = cols = diagonal_elements;
                 std::swap(data, temp_data);
+                capacity = diagonal_elements*diagonal_elements;
                 
                 if(!bUserData)
                 {
                     free(temp_data);
                     temp_data = NULL;
                 }
+                
+                // the new buffer is ours regardless of where the old one came from
+                bAllocated = true;
+                bUserData = false;
             }
             
         }
@@ -1518,6 +1733,20 @@ namespace pkm
         // sum across rows or columns creating a std::vector from a matrix, or a scalar from a std::vector
         Mat sum(bool across_rows = true);
         
+        // log(sum(exp(x))) across rows or columns, with the same layout as sum(),
+        // computed without overflow or underflow by factoring out the maximum
+        Mat logSumExp(bool across_rows = true) const;
+        
+        // exponentiate and normalize each row (or column) vector to sum to 1.
+        // a vector containing +inf shares the mass equally between its +inf
+        // entries, and a vector of only -inf becomes uniform (1 / n)
+        void setSoftmax(bool row_major = true);
+        Mat getSoftmax(bool row_major = true) const;
+        
+        // x - logSumExp(x) for each row (or column) vector, i.e. log(softmax(x)),
+        // with the same handling of infinite vectors as setSoftmax
+        void setLogSoftmax(bool row_major = true);
+        
         // repeat a std::vector for size times
         static Mat repeat(const Mat &m, size_t size)
         {
@@ -1684,6 +1913,7 @@ namespace pkm
         
         void min(float &val, unsigned long &idx) const
         {
+            PKM_INSTRUMENT_OP("min", sizeof(float) * rows * cols, rows * cols);
             vDSP_minvi(data, 1, &val, &idx, rows*cols);
         }
         
@@ -1712,21 +1942,25 @@ namespace pkm
         
         void max(float &val, unsigned long &idx)
         {
+            PKM_INSTRUMENT_OP("max", sizeof(float) * rows * cols, rows * cols);
             vDSP_maxvi(data, 1, &val, &idx, rows*cols);
         }
         
         float sumAll()
         {
-            float sumval;
-            vDSP_sve(data, 1, &sumval, rows*cols);
-            return sumval;
+            return sum(*this);
         }
         
         static float sum(const Mat &A)
         {
-            float sumval;
-            vDSP_sve(A.data, 1, &sumval, A.rows*A.cols);
-            return sumval;
+            PKM_INSTRUMENT_OP("sum", sizeof(float) * A.rows * A.cols, A.rows * A.cols);
+            // summed in fixed chunks, so the result does not depend on the
+            // number of threads
+            return parallelReduce(0, A.rows*A.cols, PARALLEL_GRAIN_ELEMENTS, 0.0f, [&](size_t i0, size_t i1) {
+                float sumval;
+                vDSP_sve(A.data + i0, 1, &sumval, i1 - i0);
+                return sumval;
+            }, [](float a, float b) { return a + b; });
         }
         
         Mat var(bool row_major = true) const
@@ -1736,6 +1970,7 @@ namespace pkm
             assert(rows >0 &&
                    cols >0);
 #endif
+            PKM_INSTRUMENT_OP("var", sizeof(float) * rows * cols, 3 * rows * cols);
             if (row_major) {
                 if (rows == 1) {
                     return *this;
@@ -1768,6 +2003,7 @@ namespace pkm
             assert(rows >0 &&
                    cols >0);
 #endif
+            PKM_INSTRUMENT_OP("stddev", sizeof(float) * rows * cols, 3 * rows * cols);
             if (row_major) {
                 if (rows == 1) {
                     return *this;
@@ -1794,6 +2030,20 @@ namespace pkm
         }
         
         
+        // -------------------------------------------------------------------------
+        //  Covariance (cols x cols) of the columns, observations in rows,
+        //  normalised by rows - 1 (rows when bUnbiased is false).  The weighted
+        //  version takes a non-negative weight per row (rows x 1 or 1 x rows)
+        //  and normalises by their sum, as in an EM M-step.  Row blocks are
+        //  centered and accumulated with SYRK in parallel (see pkmCovariance.h).
+        // -------------------------------------------------------------------------
+        Mat cov(bool bUnbiased = true) const;
+        Mat cov(const Mat &weights) const;
+        
+        // Pearson correlation of the columns; a column without variance has
+        // zero correlation with every other column
+        Mat corrcoef() const;
+        
         Mat mean(bool row_major = true) const
         {
 #ifdef DEBUG
@@ -1801,6 +2051,7 @@ namespace pkm
             assert(rows >0 &&
                    cols >0);
 #endif
+            PKM_INSTRUMENT_OP("mean", sizeof(float) * rows * cols, rows * cols);
             if (row_major) {
                 
                 if (rows == 1) {
@@ -1831,6 +2082,7 @@ namespace pkm
         
         inline void zNormalize()
         {
+            PKM_INSTRUMENT_OP("zNormalize", 3 * sizeof(float) * rows * cols, 5 * rows * cols);
             float mean, stddev;
             size_t size = rows * cols;
             getMeanAndStdDev(mean, stddev);
@@ -1845,6 +2097,7 @@ namespace pkm
         
         inline void zNormalizeEachCol()
         {
+            PKM_INSTRUMENT_OP("zNormalize", 3 * sizeof(float) * rows * cols, 5 * rows * cols);
             float mean, stddev;
             float sumval, sumsquareval;
             size_t size = rows;
@@ -1865,6 +2118,23 @@ namespace pkm
             }
         }
         
+        // normalize each column with a given 1 x cols mean and standard
+        // deviation, e.g. from pkmRunningStatistics, so that other data
+        // (queries) can be normalized with exactly the same parameters
+        inline void zNormalizeEachCol(const Mat &meanMat, const Mat &stddevMat)
+        {
+            if (meanMat.rows * meanMat.cols != cols || stddevMat.rows * stddevMat.cols != cols) {
+                printf("[ERROR]: zNormalizeEachCol() needs a mean and standard deviation for each of the %lu columns\n", (unsigned long)cols);
+                return;
+            }
+            PKM_INSTRUMENT_OP("zNormalize", 3 * sizeof(float) * rows * cols, 2 * rows * cols);
+            for (size_t i = 0; i < cols; i++) {
+                float rhs = -meanMat.data[i];
+                vDSP_vsadd(data + i, cols, &rhs, data + i, cols, rows);
+                vDSP_vsdiv(data + i, cols, stddevMat.data + i, data + i, cols, rows);
+            }
+        }
+        
         inline void centerEachCol()
         {
             float mean;
@@ -1938,10 +2208,13 @@ namespace pkm
         void divideEachVecByMaxVecElement(bool row_major);
         void divideEachVecBySum(bool row_major);
         
-        void solve()
-        {
-            
-        }
+        // -------------------------------------------------------------------------
+        //  Solve this * X = B for X, where this is square and B has one right
+        //  hand side per column.  With bSymmetricPositiveDefinite the Cholesky
+        //  based sposv is used instead of the LU based sgesv.  this and B are
+        //  not modified; returns the LAPACK info (0 on success).
+        // -------------------------------------------------------------------------
+        long solve(const Mat &B, Mat &X, bool bSymmetricPositiveDefinite = false) const;
         
         void inv2x2()
         {
@@ -1961,244 +2234,197 @@ namespace pkm
         }
         
         
-        void inv()
-        {
-#ifdef DEBUG
-            assert(rows == cols);
-#endif
-            if (rows == 1 && cols == 1) {
-                data[0] = 1.0 / data[0];
-            }
-            else if(rows == 2 && cols == 2) {
-                inv2x2();
-            }
-            else {
-                
-                __CLPK_integer n = rows;
-                __CLPK_integer info = 0;
-                __CLPK_integer ipiv[rows];
-                __CLPK_real workspace[n];
-                
-                sgetrf_(&n, &n, data, &n, ipiv, &info);
-    #ifdef DEBUG
-                if (info != 0)
-                {
-                    printf("[pkmMatrix]: ERROR: Something went wrong factoring A\n");
-                    return;
-                }
-    #endif
-                
-                sgetri_(&n, data, &n, ipiv, workspace, &n, &info);
-    #ifdef DEBUG
-                if (info != 0) {
-                    printf("[pkmMatrix]: ERROR: Something went wrong w/ inverse A\n");
-                }
-    #endif
-            }
-            
-        }
+        // in place inverse of a square matrix (LU factorization)
+        void inv();
         
-        Mat getInv() const
-        {
-            
-#ifdef DEBUG
-            assert(rows == cols);
-#endif
-            Mat m(rows, cols, 0.0f);
-            memcpy(m.data, data, sizeof(float)*rows*cols);
-            
-            if (rows == 1 && cols == 1) {
-                m[0] = 1.0 / m[0];
-                return m;
-            }
-            else if (rows == 2 && cols == 2) {
-                m.inv2x2();
-                return m;
-            }
-            else {
-                
-                __CLPK_integer n = rows;
-                __CLPK_integer info = 0;
-                __CLPK_integer ipiv[rows];
-                __CLPK_real workspace[n];
-                
-                sgetrf_(&n, &n, m.data, &n, ipiv, &info);
-    #ifdef DEBUG
-                if (info != 0)
-                {
-                    printf("[pkmMatrix]: ERROR: Something went wrong LU factorization A\n");
-                }
-    #endif
-                sgetri_(&n, m.data, &n, ipiv, workspace, &n, &info);
-                
-    #ifdef DEBUG
-                if (info != 0) {
-                    printf("[pkmMatrix]: ERROR: Something went wrong w/ inverse A\n");
-                }
-    #endif
-                
-                return m;
-            }
-        }
+        Mat getInv() const;
         
         
-        // input is 1 x d dimensional std::vector
-        // mean is 1 x d dimensional std::vector
-        // sigma is d x d dimensional matrix
-        static float gaussianPosterior(const Mat &input, Mat mean, Mat sigma)
-        {
-#ifdef DEBUG
-            assert(input.cols == mean.cols);
-            assert(input.cols == sigma.rows);
-            assert(input.cols == sigma.cols);
-#endif
-            float A = 1.0 / (powf(M_PI * 2.0, input.cols / 2.0) * sqrtf(sigma[0]*sigma[3] - sigma[2]*sigma[1]));
-            Mat inputCopy = input;
-            inputCopy.subtract(mean);
-            sigma.inv2x2();
-            Mat a = inputCopy.GEMM(sigma);
-            Mat l = inputCopy;
-            l.setTranspose();
-            Mat b = a.GEMM(l);
-            return (A * expf(-0.5 * b[0]));
-        }
+        // density of input (1 x d) under a normal with mean (1 x d) and
+        // covariance sigma (d x d), or 0 when sigma is not positive definite;
+        // see pkmMultivariateGaussian to evaluate many rows or log densities
+        static float gaussianPosterior(const Mat &input, const Mat &mean, const Mat &sigma);
         
         void sqr()
         {
-            vDSP_vmul(data, 1, data, 1, data, 1, rows*cols);
+            PKM_INSTRUMENT_OP("sqr", 2 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                vDSP_vmul(data + i0, 1, data + i0, 1, data + i0, 1, i1 - i0);
+            });
         }
         
         static Mat sqr(const Mat &b)
         {
+            PKM_INSTRUMENT_OP("sqr", 2 * sizeof(float) * b.rows * b.cols, b.rows * b.cols);
             Mat newMat(b.rows, b.cols);
-            vDSP_vmul(b.data, 1, b.data, 1, newMat.data, 1, b.rows*b.cols);
+            parallelForElements(b.rows*b.cols, [&](size_t i0, size_t i1) {
+                vDSP_vmul(b.data + i0, 1, b.data + i0, 1, newMat.data + i0, 1, i1 - i0);
+            });
             return newMat;
         }
         
         pkm::Mat& sqrt()
         {
-            int size = rows*cols;
-            vvsqrtf(data, data, &size);
+            PKM_INSTRUMENT_OP("sqrt", 2 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                pkm::vectorSqrt(data + i0, data + i0, i1 - i0);
+            });
             return *this;
         }
         
         static Mat sqrt(const Mat &b)
         {
+            PKM_INSTRUMENT_OP("sqrt", 2 * sizeof(float) * b.rows * b.cols, b.rows * b.cols);
             Mat newMat(b.rows, b.cols);
-            int size = b.rows*b.cols;
-            vvsqrtf(newMat.data, b.data, &size);
+            parallelForElements(b.rows*b.cols, [&](size_t i0, size_t i1) {
+                pkm::vectorSqrt(newMat.data + i0, b.data + i0, i1 - i0);
+            });
             return newMat;
         }
         
         void sin()
         {
-            int size = rows*cols;
-            vvsinf(data, data, &size);
+            PKM_INSTRUMENT_OP("sin", 2 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                pkm::vectorSin(data + i0, data + i0, i1 - i0);
+            });
         }
         
         static Mat sin(const Mat &b)
         {
+            PKM_INSTRUMENT_OP("sin", 2 * sizeof(float) * b.rows * b.cols, b.rows * b.cols);
             Mat newMat(b.rows, b.cols);
-            int size = b.rows*b.cols;
-            vvsinf(newMat.data, b.data, &size);
+            parallelForElements(b.rows*b.cols, [&](size_t i0, size_t i1) {
+                pkm::vectorSin(newMat.data + i0, b.data + i0, i1 - i0);
+            });
             return newMat;
         }
         
         void cos()
         {
-            int size = rows*cols;
-            vvcosf(data, data, &size);
+            PKM_INSTRUMENT_OP("cos", 2 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                pkm::vectorCos(data + i0, data + i0, i1 - i0);
+            });
         }
         
         static Mat cos(const Mat &b)
         {
+            PKM_INSTRUMENT_OP("cos", 2 * sizeof(float) * b.rows * b.cols, b.rows * b.cols);
             Mat newMat(b.rows, b.cols);
-            int size = b.rows*b.cols;
-            vvcosf(newMat.data, b.data, &size);
+            parallelForElements(b.rows*b.cols, [&](size_t i0, size_t i1) {
+                pkm::vectorCos(newMat.data + i0, b.data + i0, i1 - i0);
+            });
             return newMat;
         }
         
         void pow(float p)
         {
-            int size = rows*cols;
-            vvpowf(data, &p, data, &size);
+            PKM_INSTRUMENT_OP("pow", 2 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                pkm::vectorPow(data + i0, data + i0, p, i1 - i0);
+            });
         }
         
         static Mat pow(const Mat &b, float p)
         {
+            PKM_INSTRUMENT_OP("pow", 2 * sizeof(float) * b.rows * b.cols, b.rows * b.cols);
             Mat newMat(b.rows, b.cols);
-            int size = b.rows*b.cols;
-            vvpowf(newMat.data, &p, b.data, &size);
+            parallelForElements(b.rows*b.cols, [&](size_t i0, size_t i1) {
+                pkm::vectorPow(newMat.data + i0, b.data + i0, p, i1 - i0);
+            });
             return newMat;
         }
         
         void log()
         {
-            int size = rows*cols;
-            vvlogf(data, data, &size);
+            PKM_INSTRUMENT_OP("log", 2 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                pkm::vectorLog(data + i0, data + i0, i1 - i0);
+            });
         }
         
         static Mat log(const Mat &b)
         {
+            PKM_INSTRUMENT_OP("log", 2 * sizeof(float) * b.rows * b.cols, b.rows * b.cols);
             Mat newMat(b.rows, b.cols);
-            int size = b.rows*b.cols;
-            vvlogf(newMat.data, b.data, &size);
+            parallelForElements(b.rows*b.cols, [&](size_t i0, size_t i1) {
+                pkm::vectorLog(newMat.data + i0, b.data + i0, i1 - i0);
+            });
             return newMat;
         }
         
         void log10()
         {
-            int size = rows*cols;
-            vvlog10f(data, data, &size);
+            PKM_INSTRUMENT_OP("log10", 2 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                int size = (int)(i1 - i0);
+                vvlog10f(data + i0, data + i0, &size);
+            });
         }
         
         static Mat log10(const Mat &b)
         {
+            PKM_INSTRUMENT_OP("log10", 2 * sizeof(float) * b.rows * b.cols, b.rows * b.cols);
             Mat newMat(b.rows, b.cols);
-            int size = b.rows*b.cols;
-            vvlog10f(newMat.data, b.data, &size);
+            parallelForElements(b.rows*b.cols, [&](size_t i0, size_t i1) {
+                int size = (int)(i1 - i0);
+                vvlog10f(newMat.data + i0, b.data + i0, &size);
+            });
             return newMat;
         }
         
         void exp()
         {
-            int size = rows*cols;
-            vvexpf(data, data, &size);
+            PKM_INSTRUMENT_OP("exp", 2 * sizeof(float) * rows * cols, rows * cols);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                pkm::vectorExp(data + i0, data + i0, i1 - i0);
+            });
         }
         
         static Mat exp(const Mat &b)
         {
+            PKM_INSTRUMENT_OP("exp", 2 * sizeof(float) * b.rows * b.cols, b.rows * b.cols);
             Mat newMat(b.rows, b.cols);
-            int size = b.rows*b.cols;
-            vvexpf(newMat.data, b.data, &size);
+            parallelForElements(b.rows*b.cols, [&](size_t i0, size_t i1) {
+                pkm::vectorExp(newMat.data + i0, b.data + i0, i1 - i0);
+            });
             return newMat;
         }
         
         void floor()
         {
-            int size = rows*cols;
-            vvfloorf(data, data, &size);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                int size = (int)(i1 - i0);
+                vvfloorf(data + i0, data + i0, &size);
+            });
         }
         
         static Mat floor(const Mat &b)
         {
             Mat newMat(b.rows, b.cols);
-            int size = b.rows*b.cols;
-            vvfloorf(newMat.data, b.data, &size);
+            parallelForElements(b.rows*b.cols, [&](size_t i0, size_t i1) {
+                int size = (int)(i1 - i0);
+                vvfloorf(newMat.data + i0, b.data + i0, &size);
+            });
             return newMat;
         }
         
         void ceil()
         {
-            int size = rows*cols;
-            vvceilf(data, data, &size);
+            parallelForElements(rows*cols, [&](size_t i0, size_t i1) {
+                int size = (int)(i1 - i0);
+                vvceilf(data + i0, data + i0, &size);
+            });
         }
         
         static Mat ceil(const Mat &b)
         {
             Mat newMat(b.rows, b.cols);
-            int size = b.rows*b.cols;
-            vvceilf(newMat.data, b.data, &size);
+            parallelForElements(b.rows*b.cols, [&](size_t i0, size_t i1) {
+                int size = (int)(i1 - i0);
+                vvceilf(newMat.data + i0, b.data + i0, &size);
+            });
             return newMat;
         }
         
@@ -2247,16 +2473,17 @@ namespace pkm
             return data;
         }
         
-        void getIndexOfClosestRowL1(const pkm::Mat& row_vector, float &best_sum, size_t &best_idx)
+        // linear scans for the nearest row to 'row_vector' (1 x cols); the L2
+        // forms report squared distances.  No allocations, so they are cheap
+        // to call per query; see pkmNearestNeighbors for an index over the
+        // rows when there are many queries
+        void getIndexOfClosestRowL1(const pkm::Mat& row_vector, float &best_sum, size_t &best_idx) const
         {
             best_sum = HUGE_VALF;
             best_idx = 0;
-            pkm::Mat sub(1, cols);
             for( size_t i = 0; i < rows; i++ )
             {
-                rowRange(i, i+1, false).subtract(row_vector, sub);
-                sub.abs();
-                float l1 = sub.sum().sum(false)[0];
+                float l1 = pkm::math::l1Distance(data + i*cols, row_vector.data, cols);
                 if (l1 < best_sum) {
                     best_sum = l1;
                     best_idx = i;
@@ -2265,89 +2492,70 @@ namespace pkm
         }
         
         
-        void getIndexOfClosestRowL2(const pkm::Mat& row_vector, float &best_sum, size_t &best_idx)
+        void getIndexOfClosestRowL2(const pkm::Mat& row_vector, float &best_sum, size_t &best_idx) const
         {
             best_sum = HUGE_VALF;
             best_idx = 0;
-            pkm::Mat sub(1, cols);
             for( size_t i = 0; i < rows; i++ )
             {
-                rowRange(i, i+1, false).subtract(row_vector, sub);
-                sub.sqr();
-                float l1 = sub.sum().sum(false)[0];
-                if (l1 < best_sum) {
-                    best_sum = l1;
+                float l2 = pkm::math::squaredL2Distance(data + i*cols, row_vector.data, cols);
+                if (l2 < best_sum) {
+                    best_sum = l2;
                     best_idx = i;
                 }
             }
         }
         
-        void getIndexOfClosestRowL2(const pkm::Mat& row_vector, float &best_sum, size_t &best_idx, float &average_sum)
+        void getIndexOfClosestRowL2(const pkm::Mat& row_vector, float &best_sum, size_t &best_idx, float &average_sum) const
         {
             average_sum = 0;
             best_sum = HUGE_VALF;
             best_idx = 0;
-            pkm::Mat sub(1, cols);
             for( size_t i = 0; i < rows; i++ )
             {
-                rowRange(i, i+1, false).subtract(row_vector, sub);
-                sub.sqr();
-                float l1 = sub.sum().sum(false)[0];
-                average_sum += l1;
-                if (l1 < best_sum) {
-                    best_sum = l1;
+                float l2 = pkm::math::squaredL2Distance(data + i*cols, row_vector.data, cols);
+                average_sum += l2;
+                if (l2 < best_sum) {
+                    best_sum = l2;
                     best_idx = i;
                 }
             }
             average_sum /= (float)rows;
         }
         
-        inline long svd(Mat &U, Mat &S, Mat &V_t)
-        {
-            //            print();
-            
-            __CLPK_integer m = rows;
-            __CLPK_integer n = cols;
-            
-            __CLPK_integer lda = m;
-            __CLPK_integer ldu = m;
-            __CLPK_integer ldv = n;
-            
-            size_t nSVs = m > n ? n : m;
-            
-            U.reset(m, m);
-            V_t.reset(n, n);
-            S.reset(1, nSVs);
-            
-            float workSize;
-            
-            __CLPK_integer lwork = -1;
-            __CLPK_integer info = 0;
-            
-            // iwork dimension should be at least 8*min(m,n)
-            __CLPK_integer iwork[8*nSVs];
-            
-            //https://groups.google.com/forum/#!topic/julia-dev/mmgO65i6-fA sdd (divide/conquer, better if memory is available, for large matrices) versus svd (qr)
-            //http://docs.oracle.com/cd/E19422-01/819-3691/dgesvd.html
-            
-            // call svd to query optimal work size:
-            char job = 'A';
-            sgesdd_(&job, &m, &n, data, &lda, S.data, U.data, &ldu, V_t.data, &ldv, &workSize, &lwork, iwork, &info);
-            
-            lwork = (long)workSize;
-            float work[lwork];
-            
-            // actual svd
-            sgesdd_(&job, &m, &n, data, &lda, S.data, U.data, &ldu, V_t.data, &ldv, work, &lwork, iwork, &info);
-            
-            // Check for convergence
-            if( info > 0 ) {
-                printf( "[pkm::Mat]::svd(...) sgesvd_() failed to converge.\\n" );
-            }
-            
-            return info;
-            
-        }
+        // -------------------------------------------------------------------------
+        //  Singular value decomposition this = U * diag(S) * V_t, with U rows x
+        //  rows, S 1 x min(rows, cols) in descending order and V_t cols x cols.
+        //  this is not modified; returns the LAPACK info (0 on success).
+        // -------------------------------------------------------------------------
+        long svd(Mat &U, Mat &S, Mat &V_t) const;
+        
+        // -------------------------------------------------------------------------
+        //  The first k singular triplets only: U rows x k, S 1 x k and V_t
+        //  k x cols (k = 0 keeps all min(rows, cols)).  Uses the economy
+        //  decomposition, so the full rows x rows U is never formed.
+        // -------------------------------------------------------------------------
+        long svdTruncated(Mat &U, Mat &S, Mat &V_t, size_t k = 0) const;
+        
+        // -------------------------------------------------------------------------
+        //  Approximate first k singular triplets by a randomized range finder
+        //  (Halko, Martinsson & Tropp 2011): a Gaussian sketch of k + oversamples
+        //  columns, refined by powerIterations passes over the data, then an
+        //  exact svd of the small projected matrix.  Costs a few GEMMs over the
+        //  data instead of a full decomposition; more power iterations help
+        //  when the singular values decay slowly.
+        // -------------------------------------------------------------------------
+        long svdRandomized(Mat &U, Mat &S, Mat &V_t, size_t k,
+                           size_t powerIterations = 2, size_t oversamples = 10, unsigned long seed = 1) const;
+        
+        // -------------------------------------------------------------------------
+        //  The k largest eigenvalues (1 x k, descending) and their eigenvectors
+        //  (k x rows, one per row) of a symmetric matrix, computed with the
+        //  relatively robust representations solver ssyevr, which finds a
+        //  subset of eigenpairs without the full decomposition (k = 0 finds
+        //  all).  Only the upper triangle is read; this is not modified.
+        // -------------------------------------------------------------------------
+        long eigSymmetric(Mat &values, Mat &vectors, size_t k = 0) const;
         
         void copyToDouble(double *ptr) const
         {
@@ -2414,12 +2622,14 @@ namespace pkm
             if (bAllocated && !bUserData) {
                 free(data); data = NULL;
                 rows = cols = 0;
+                capacity = 0;
             }
             FILE *fp;
             fp = fopen(filename.c_str(), "r");
             if (fp) {
                 fscanf(fp, "%lu %lu\n", &rows, &cols);
-                data = (float *)malloc(sizeof(float) * MULTIPLE_OF_4(rows * cols));
+                data = allocate(sizeof(float) * MULTIPLE_OF_4(rows * cols));
+                capacity = MULTIPLE_OF_4(rows * cols);
                 for(long i = 0; i < rows; i++)
                 {
                     for(long j = 0; j < cols; j++)
@@ -2442,13 +2652,15 @@ namespace pkm
             if (bAllocated && !bUserData) {
                 free(data); data = NULL;
                 rows = cols = 0;
+                capacity = 0;
             }
             FILE *fp;
             fp = fopen(filename.c_str(), "r");
             if (fp) {
                 rows = r;
                 cols = c;
-                data = (float *)malloc(sizeof(float) * MULTIPLE_OF_4(rows * cols));
+                data = allocate(sizeof(float) * MULTIPLE_OF_4(rows * cols));
+                capacity = MULTIPLE_OF_4(rows * cols);
                 for(long i = 0; i < rows; i++)
                 {
                     for(long j = 0; j < cols; j++)
@@ -2485,8 +2697,54 @@ namespace pkm
         bool bAllocated = false;
         bool bUserData;
         
+        // number of floats allocated at data (>= rows * cols) when we own it
+        size_t capacity = 0;
+        
         
     protected:
+        // malloc and realloc of matrix storage, counted as "allocate" when
+        // instrumented
+        static float * allocate(size_t bytes)
+        {
+            PKM_INSTRUMENT_COUNT("allocate", bytes, 0);
+            return (float *)malloc(bytes);
+        }
+        
+        static float * reallocate(float *buffer, size_t bytes)
+        {
+            PKM_INSTRUMENT_COUNT("allocate", bytes, 0);
+            return (float *)realloc(buffer, bytes);
+        }
+        
+        // reallocate our own storage to hold exactly n elements, copying
+        // user data into a new buffer if we did not own it
+        void setCapacity(size_t n)
+        {
+            if (bAllocated && !bUserData) {
+                data = reallocate(data, sizeof(float) * n);
+            }
+            else {
+                float *new_data = allocate(sizeof(float) * n);
+                if (bUserData && data != NULL && rows * cols > 0) {
+                    cblas_scopy(std::min<size_t>(rows * cols, n), data, 1, new_data, 1);
+                }
+                data = new_data;
+                bAllocated = true;
+                bUserData = false;
+            }
+            capacity = n;
+        }
+        
+        // make sure at least n elements fit, growing geometrically
+        inline void growCapacity(size_t n)
+        {
+            if (n <= capacity && bAllocated && !bUserData) {
+                return;
+            }
+            setCapacity(MULTIPLE_OF_4(std::max<size_t>(n, 2 * capacity)));
+        }
+        
+
         void releaseMemory()
         {
             if(bAllocated)
@@ -2496,6 +2754,7 @@ namespace pkm
                     free(data);
                     data = NULL;
                     bAllocated = false;
+                    capacity = 0;
                 }
             }
         }
@@ -28,6 +28,7 @@ public:
 	
 	float *getMedian(float *nextFrame)
 	{
+		PKM_INSTRUMENT_LABEL("pkmMedianFilter::getMedian");
 		frames.insertRowCircularly(nextFrame);
 		frames.setTranspose();
 		
@@ -42,6 +43,7 @@ public:
 	
 	void getMedianIP(float *&nextFrame)
 	{
+		PKM_INSTRUMENT_LABEL("pkmMedianFilter::getMedian");
 		frames.insertRowCircularly(nextFrame);
 		frames.setTranspose();
 		
@@ -0,0 +1,199 @@
+// -----------------------------------------------------------------------------
+//  pkmMultivariateGaussian.cpp
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+
+#include "pkmMultivariateGaussian.h"
+#include "pkmParallel.h"
+
+// rows per triangular solve in logDensities()
+static const size_t GAUSSIAN_BLOCK_ROWS = 256;
+
+// -------------------------------------------------------------------------
+pkmMultivariateGaussian::pkmMultivariateGaussian()
+{
+    logDeterminant = 0;
+    logNormalizer = 0;
+    bValid = false;
+}
+
+// -------------------------------------------------------------------------
+pkmMultivariateGaussian::pkmMultivariateGaussian(const Mat &m, const Mat &covariance, float regularization)
+{
+    set(m, covariance, regularization);
+}
+
+// -------------------------------------------------------------------------
+bool pkmMultivariateGaussian::set(const Mat &m, const Mat &covariance, float regularization)
+{
+    const size_t D = covariance.rows;
+    bValid = false;
+    if (D == 0 || covariance.cols != D || m.rows * m.cols != D) {
+        printf("[ERROR]: pkmMultivariateGaussian::set() mean of %lu values and %lu x %lu covariance do not match\n",
+               m.rows * m.cols, covariance.rows, covariance.cols);
+        return false;
+    }
+    
+    mean = Mat(1, D);
+    cblas_scopy(D, m.data, 1, mean.data, 1);
+    
+    // row-major Sigma is its own column-major transpose, so LAPACK's lower
+    // L (Sigma = L L^T) is our upper U = L^T
+    cholesky = Mat(D, D);
+    cblas_scopy(D * D, covariance.data, 1, cholesky.data, 1);
+    for (size_t i = 0; i < D; i++) {
+        cholesky.data[i * D + i] += regularization;
+    }
+    __CLPK_integer n = D;
+    __CLPK_integer info = 0;
+    char uplo = 'L';
+    spotrf_(&uplo, &n, cholesky.data, &n, &info);
+    if (info != 0) {
+        return false;
+    }
+    
+    logDeterminant = 0;
+    for (size_t i = 0; i < D; i++) {
+        for (size_t j = 0; j < i; j++) {
+            cholesky.data[i * D + j] = 0.0f;
+        }
+        logDeterminant += 2.0 * log((double)cholesky.data[i * D + i]);
+    }
+    logNormalizer = -0.5 * ((double)D * log(2.0 * M_PI) + logDeterminant);
+    bValid = true;
+    return true;
+}
+
+// -------------------------------------------------------------------------
+double pkmMultivariateGaussian::logDensity(const float *x) const
+{
+    if (!bValid) {
+        return -HUGE_VAL;
+    }
+    const size_t D = mean.cols;
+    
+    // z^T = U^-T (x - mean)^T
+    std::vector<float> z(D);
+    vDSP_vsub(mean.data, 1, x, 1, &z[0], 1, D);
+    cblas_strsv(CblasRowMajor, CblasUpper, CblasTrans, CblasNonUnit, D, cholesky.data, D, &z[0], 1);
+    
+    double mahalanobis = 0;
+    for (size_t d = 0; d < D; d++) {
+        mahalanobis += z[d] * (double)z[d];
+    }
+    return logNormalizer - 0.5 * mahalanobis;
+}
+
+// -------------------------------------------------------------------------
+void pkmMultivariateGaussian::logDensities(const Mat &X, Mat &result) const
+{
+    const size_t N = X.rows, D = mean.cols;
+    if (!bValid || X.cols != D) {
+        printf("[ERROR]: pkmMultivariateGaussian::logDensities() data has %lu dimensions, distribution has %lu\n", X.cols, D);
+        return;
+    }
+    if (result.rows != N || result.cols != 1 || !result.bAllocated) {
+        result = Mat(N, 1);
+    }
+    
+    // Z = (X - mean) U^-1 per block of rows, then the squared norms of Z's rows
+    parallelFor(0, N, GAUSSIAN_BLOCK_ROWS, [&](size_t b0, size_t b1) {
+        Mat centered(GAUSSIAN_BLOCK_ROWS, D);
+        for (size_t r0 = b0; r0 < b1; r0 += GAUSSIAN_BLOCK_ROWS)
+        {
+            size_t r1 = std::min(b1, r0 + GAUSSIAN_BLOCK_ROWS);
+            for (size_t r = r0; r < r1; r++) {
+                vDSP_vsub(mean.data, 1, X.data + r * D, 1, centered.data + (r - r0) * D, 1, D);
+            }
+            cblas_strsm(CblasRowMajor, CblasRight, CblasUpper, CblasNoTrans, CblasNonUnit,
+                        r1 - r0, D, 1.0f, cholesky.data, D, centered.data, D);
+            for (size_t r = r0; r < r1; r++) {
+                float mahalanobis;
+                vDSP_svesq(centered.data + (r - r0) * D, 1, &mahalanobis, D);
+                result.data[r] = (float)(logNormalizer - 0.5 * mahalanobis);
+            }
+        }
+    });
+}
+
+// -------------------------------------------------------------------------
+void pkmMultivariateGaussian::densities(const Mat &X, Mat &result) const
+{
+    logDensities(X, result);
+    if (bValid && X.cols == mean.cols) {
+        result.exp();
+    }
+}
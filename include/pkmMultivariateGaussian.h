@@ -0,0 +1,142 @@
+// -----------------------------------------------------------------------------
+//  pkmMultivariateGaussian.h
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "pkmMatrix.h"
+
+using namespace pkm;
+
+// -----------------------------------------------------------------------------
+//  A multivariate normal N(mean, covariance) in any number of dimensions.
+//
+//  The covariance is factored once, Sigma = U^T U (Cholesky, spotrf), and
+//  the normalizer with its log-determinant is cached.  A density is then
+//  |(x - mean) U^-1|^2, one triangular solve: for a batch of rows one
+//  strsm per block of centered rows, blocks in parallel.  Work in log
+//  densities where possible; densities of even moderately high dimensional
+//  data underflow.
+// -----------------------------------------------------------------------------
+class pkmMultivariateGaussian
+{
+public:
+    // -------------------------------------------------------------------------
+    pkmMultivariateGaussian();
+    pkmMultivariateGaussian(const Mat &mean, const Mat &covariance, float regularization = 0.0f);
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  mean (1 x D) and covariance (D x D), with 'regularization' added to
+    //  its diagonal.  Returns false (and isValid() is false) when the
+    //  covariance is not positive definite.
+    // -------------------------------------------------------------------------
+    bool set(const Mat &mean, const Mat &covariance, float regularization = 0.0f);
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  One observation of D values
+    // -------------------------------------------------------------------------
+    double logDensity(const float *x) const;
+    double density(const float *x) const        { return exp(logDensity(x)); }
+    
+    // -------------------------------------------------------------------------
+    //  Every row of X (N x D), into N x 1
+    // -------------------------------------------------------------------------
+    void logDensities(const Mat &X, Mat &result) const;
+    void densities(const Mat &X, Mat &result) const;
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    bool            isValid() const             { return bValid; }
+    size_t          getDimensions() const       { return mean.cols; }
+    const Mat &     getMean() const             { return mean; }
+    // upper triangular U with covariance = U^T U
+    const Mat &     getCholeskyFactor() const   { return cholesky; }
+    double          getLogDeterminant() const   { return logDeterminant; }
+    // -------------------------------------------------------------------------
+    
+protected:
+    // -------------------------------------------------------------------------
+    Mat             mean;                       // 1 x D
+    Mat             cholesky;                   // D x D, upper triangle
+    double          logDeterminant;
+    double          logNormalizer;              // -(D log(2 pi) + log det) / 2
+    bool            bValid;
+    // -------------------------------------------------------------------------
+};
@@ -0,0 +1,405 @@
+// -----------------------------------------------------------------------------
+//  pkmNearestNeighbors.cpp
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+
+#include "pkmNearestNeighbors.h"
+#include "pkmParallel.h"
+#include <algorithm>
+
+// data up to this many dimensions gets a KD-tree with INDEX_AUTO
+static const size_t NN_KDTREE_MAX_DIMENSIONS = 16;
+
+// -------------------------------------------------------------------------
+void pkmNearestNeighbors::Candidates::push(float d, size_t i)
+{
+    if (k == 0) {
+        // radius query: keep everything within the bound, sorted at the end
+        distances.push_back(d);
+        indices.push_back(i);
+        return;
+    }
+    
+    // sorted insertion into at most k candidates
+    size_t pos = distances.size();
+    if (pos == k) {
+        pos--;
+    }
+    else {
+        distances.push_back(d);
+        indices.push_back(i);
+    }
+    while (pos > 0 && distances[pos - 1] > d) {
+        distances[pos] = distances[pos - 1];
+        indices[pos] = indices[pos - 1];
+        pos--;
+    }
+    distances[pos] = d;
+    indices[pos] = i;
+    
+    if (distances.size() == k) {
+        worst = distances.back();
+    }
+}
+
+// -------------------------------------------------------------------------
+pkmNearestNeighbors::pkmNearestNeighbors()
+{
+    metric = DISTANCE_L2;
+    indexType = INDEX_BRUTE_FORCE;
+    leafSize = 16;
+}
+
+// -------------------------------------------------------------------------
+void pkmNearestNeighbors::build(const Mat &database, int m, int type)
+{
+    metric = m;
+    indexType = type;
+    if (indexType == INDEX_AUTO) {
+        indexType = database.cols <= NN_KDTREE_MAX_DIMENSIONS ? INDEX_KDTREE : INDEX_VPTREE;
+    }
+    
+    nodes.clear();
+    points = Mat(database.rows, database.cols);
+    originalIndex.resize(database.rows);
+    for (size_t i = 0; i < database.rows; i++) {
+        originalIndex[i] = i;
+    }
+    if (database.rows == 0 || database.data == NULL) {
+        return;
+    }
+    
+    if (indexType == INDEX_KDTREE) {
+        buildKDTree(database, originalIndex, 0, database.rows);
+    }
+    else if (indexType == INDEX_VPTREE) {
+        buildVPTree(database, originalIndex, 0, database.rows);
+    }
+    else {
+        Node leaf = {-1, -1, 0, 0, 0, database.rows};
+        nodes.push_back(leaf);
+    }
+    
+    // store the rows in leaf order
+    const size_t D = database.cols;
+    for (size_t i = 0; i < database.rows; i++) {
+        std::copy(database.data + originalIndex[i] * D, database.data + (originalIndex[i] + 1) * D,
+                  points.data + i * D);
+    }
+}
+
+// -------------------------------------------------------------------------
+int pkmNearestNeighbors::buildKDTree(const Mat &database, std::vector<size_t> &order, size_t begin, size_t end)
+{
+    int index = (int)nodes.size();
+    Node node = {-1, -1, 0, 0, begin, end};
+    nodes.push_back(node);
+    if (end - begin <= leafSize) {
+        return index;
+    }
+    
+    // split at the median of the dimension with the largest spread
+    const size_t D = database.cols;
+    int bestDimension = 0;
+    float bestSpread = -1;
+    for (size_t d = 0; d < D; d++) {
+        float lo = HUGE_VALF, hi = -HUGE_VALF;
+        for (size_t i = begin; i < end; i++) {
+            float v = database.data[order[i] * D + d];
+            lo = std::min(lo, v);
+            hi = std::max(hi, v);
+        }
+        if (hi - lo > bestSpread) {
+            bestSpread = hi - lo;
+            bestDimension = (int)d;
+        }
+    }
+    if (bestSpread <= 0) {
+        // all rows identical
+        return index;
+    }
+    
+    size_t mid = begin + (end - begin) / 2;
+    const float *X = database.data;
+    std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                     [=](size_t a, size_t b) { return X[a * D + bestDimension] < X[b * D + bestDimension]; });
+    
+    nodes[index].dimension = bestDimension;
+    nodes[index].threshold = X[order[mid] * D + bestDimension];
+    int left = buildKDTree(database, order, begin, mid);
+    int right = buildKDTree(database, order, mid, end);
+    nodes[index].left = left;
+    nodes[index].right = right;
+    return index;
+}
+
+// -------------------------------------------------------------------------
+int pkmNearestNeighbors::buildVPTree(const Mat &database, std::vector<size_t> &order, size_t begin, size_t end)
+{
+    int index = (int)nodes.size();
+    Node node = {-1, -1, 0, 0, begin, end};
+    nodes.push_back(node);
+    if (end - begin <= leafSize) {
+        return index;
+    }
+    
+    // a pseudo-random vantage point, moved to the front of the range
+    size_t n = end - begin;
+    size_t vp = begin + (size_t)((begin * 2654435761u + n * 40503u) % n);
+    std::swap(order[begin], order[vp]);
+    
+    // the other rows split at the median distance from the vantage point:
+    // 'left' inside the radius, 'right' outside
+    const size_t D = database.cols;
+    const float *v = database.data + order[begin] * D;
+    std::vector<std::pair<float, size_t> > byDistance(n - 1);
+    for (size_t i = begin + 1; i < end; i++) {
+        byDistance[i - begin - 1] = std::make_pair(toDistance(reducedDistance(v, database.data + order[i] * D)), order[i]);
+    }
+    size_t half = (n - 1) / 2;
+    std::nth_element(byDistance.begin(), byDistance.begin() + half, byDistance.end());
+    for (size_t i = 0; i < n - 1; i++) {
+        order[begin + 1 + i] = byDistance[i].second;
+    }
+    
+    size_t mid = begin + 1 + half;
+    nodes[index].threshold = byDistance[half].first;
+    int left = buildVPTree(database, order, begin + 1, mid);
+    int right = buildVPTree(database, order, mid, end);
+    nodes[index].left = left;
+    nodes[index].right = right;
+    return index;
+}
+
+// -------------------------------------------------------------------------
+void pkmNearestNeighbors::scanLeaf(const float *query, size_t begin, size_t end, Candidates &candidates) const
+{
+    const size_t D = points.cols;
+    for (size_t i = begin; i < end; i++) {
+        float d = reducedDistance(query, points.data + i * D);
+        if (d <= candidates.worst) {
+            candidates.push(d, i);
+        }
+    }
+}
+
+// -------------------------------------------------------------------------
+void pkmNearestNeighbors::searchKDTree(const float *query, int index, float reduced, std::vector<float> &offsets,
+                                       Candidates &candidates) const
+{
+    const Node &node = nodes[index];
+    if (node.left < 0) {
+        scanLeaf(query, node.begin, node.end, candidates);
+        return;
+    }
+    
+    float diff = query[node.dimension] - node.threshold;
+    int nearChild = diff < 0 ? node.left : node.right;
+    int farChild = diff < 0 ? node.right : node.left;
+    searchKDTree(query, nearChild, reduced, offsets, candidates);
+    
+    // the far side is at least 'diff' away along this dimension; replace
+    // this dimension's share of the lower bound to the far cell
+    float cut = (metric == DISTANCE_L1) ? fabsf(diff) : diff * diff;
+    float farReduced = reduced - offsets[node.dimension] + cut;
+    if (farReduced <= candidates.worst) {
+        float previous = offsets[node.dimension];
+        offsets[node.dimension] = cut;
+        searchKDTree(query, farChild, farReduced, offsets, candidates);
+        offsets[node.dimension] = previous;
+    }
+}
+
+// -------------------------------------------------------------------------
+void pkmNearestNeighbors::searchVPTree(const float *query, int index, Candidates &candidates) const
+{
+    const Node &node = nodes[index];
+    if (node.left < 0) {
+        scanLeaf(query, node.begin, node.end, candidates);
+        return;
+    }
+    
+    float reduced = reducedDistance(query, points.data + node.begin * points.cols);
+    if (reduced <= candidates.worst) {
+        candidates.push(reduced, node.begin);
+    }
+    
+    // triangle inequality: rows inside the radius are at least d - radius
+    // away, rows outside at least radius - d
+    float d = toDistance(reduced), mu = node.threshold;
+    if (d < mu) {
+        searchVPTree(query, node.left, candidates);
+        if (d + toDistance(candidates.worst) >= mu) {
+            searchVPTree(query, node.right, candidates);
+        }
+    }
+    else {
+        searchVPTree(query, node.right, candidates);
+        if (d - toDistance(candidates.worst) <= mu) {
+            searchVPTree(query, node.left, candidates);
+        }
+    }
+}
+
+// -------------------------------------------------------------------------
+void pkmNearestNeighbors::search(const float *query, Candidates &candidates) const
+{
+    if (nodes.empty()) {
+        return;
+    }
+    if (indexType == INDEX_KDTREE) {
+        std::vector<float> offsets(points.cols, 0.0f);
+        searchKDTree(query, 0, 0.0f, offsets, candidates);
+    }
+    else if (indexType == INDEX_VPTREE) {
+        searchVPTree(query, 0, candidates);
+    }
+    else {
+        scanLeaf(query, 0, points.rows, candidates);
+    }
+}
+
+// -------------------------------------------------------------------------
+void pkmNearestNeighbors::finish(Candidates &candidates, std::vector<size_t> &indices, std::vector<float> &distances) const
+{
+    if (candidates.k == 0) {
+        std::vector<size_t> sorted(candidates.indices.size());
+        for (size_t i = 0; i < sorted.size(); i++) {
+            sorted[i] = i;
+        }
+        std::sort(sorted.begin(), sorted.end(), [&](size_t a, size_t b) {
+            return candidates.distances[a] < candidates.distances[b];
+        });
+        indices.resize(sorted.size());
+        distances.resize(sorted.size());
+        for (size_t i = 0; i < sorted.size(); i++) {
+            indices[i] = originalIndex[candidates.indices[sorted[i]]];
+            distances[i] = toDistance(candidates.distances[sorted[i]]);
+        }
+        return;
+    }
+    
+    indices.resize(candidates.indices.size());
+    distances.resize(candidates.distances.size());
+    for (size_t i = 0; i < indices.size(); i++) {
+        indices[i] = originalIndex[candidates.indices[i]];
+        distances[i] = toDistance(candidates.distances[i]);
+    }
+}
+
+// -------------------------------------------------------------------------
+void pkmNearestNeighbors::knn(const float *query, size_t k, std::vector<size_t> &indices, std::vector<float> &distances) const
+{
+    Candidates candidates;
+    candidates.k = std::max<size_t>(1, k);
+    candidates.worst = HUGE_VALF;
+    candidates.distances.reserve(candidates.k);
+    candidates.indices.reserve(candidates.k);
+    search(query, candidates);
+    finish(candidates, indices, distances);
+}
+
+// -------------------------------------------------------------------------
+void pkmNearestNeighbors::radius(const float *query, float r, std::vector<size_t> &indices, std::vector<float> &distances) const
+{
+    Candidates candidates;
+    candidates.k = 0;
+    candidates.worst = toReduced(r);
+    search(query, candidates);
+    finish(candidates, indices, distances);
+}
+
+// -------------------------------------------------------------------------
+void pkmNearestNeighbors::knn(const Mat &queries, size_t k, std::vector<size_t> &indices, Mat &distances) const
+{
+    if (queries.cols != points.cols) {
+        printf("[ERROR]: pkmNearestNeighbors::knn() queries have %lu dimensions, index has %lu\n", queries.cols, points.cols);
+        return;
+    }
+    k = std::max<size_t>(1, k);
+    indices.assign(queries.rows * k, (size_t)-1);
+    distances = Mat(queries.rows, k, HUGE_VALF);
+    
+    parallelFor(0, queries.rows, 16, [&](size_t q0, size_t q1) {
+        std::vector<size_t> rowIndices;
+        std::vector<float> rowDistances;
+        for (size_t q = q0; q < q1; q++) {
+            knn(queries.data + q * queries.cols, k, rowIndices, rowDistances);
+            std::copy(rowIndices.begin(), rowIndices.end(), indices.begin() + q * k);
+            std::copy(rowDistances.begin(), rowDistances.end(), distances.data + q * k);
+        }
+    });
+}
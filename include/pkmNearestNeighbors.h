@@ -0,0 +1,194 @@
+// -----------------------------------------------------------------------------
+//  pkmNearestNeighbors.h
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "pkmMatrix.h"
+#include <vector>
+
+using namespace pkm;
+
+// -----------------------------------------------------------------------------
+//  Exact nearest neighbour index over the rows of a pkm::Mat, under L1 or
+//  L2 distance.
+//
+//  A KD-tree (median splits on the dimension of largest spread) is used
+//  for low dimensional data and a vantage-point tree for higher dimensions,
+//  where axis aligned splits stop pruning.  Both keep the rows of each leaf
+//  contiguous in a reordered copy of the database, so leaves are scanned
+//  with the same vectorized kernels as the brute force index.
+//
+//  Distances returned are true distances (not squared).
+// -----------------------------------------------------------------------------
+class pkmNearestNeighbors
+{
+public:
+    enum {DISTANCE_L1, DISTANCE_L2};
+    enum {INDEX_AUTO, INDEX_BRUTE_FORCE, INDEX_KDTREE, INDEX_VPTREE};
+    
+    // -------------------------------------------------------------------------
+    pkmNearestNeighbors();
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  Index a copy of the rows of 'database'.  INDEX_AUTO picks a KD-tree for
+    //  up to 16 dimensions and a VP-tree above.
+    // -------------------------------------------------------------------------
+    void build(const Mat &database, int metric = DISTANCE_L2, int indexType = INDEX_AUTO);
+    
+    // -------------------------------------------------------------------------
+    //  The (up to) k nearest rows to 'query' (1 x dimensions), nearest first,
+    //  as row indices of the original database
+    // -------------------------------------------------------------------------
+    void knn(const float *query, size_t k, std::vector<size_t> &indices, std::vector<float> &distances) const;
+    
+    // every row within 'radius' of 'query', nearest first
+    void radius(const float *query, float radius, std::vector<size_t> &indices, std::vector<float> &distances) const;
+    
+    // k nearest rows for every row of 'queries', in parallel: 'indices' and
+    // 'distances' are queries.rows x k, row major
+    void knn(const Mat &queries, size_t k, std::vector<size_t> &indices, Mat &distances) const;
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    size_t  size() const                { return points.rows; }
+    size_t  getDimensions() const       { return points.cols; }
+    int     getMetric() const           { return metric; }
+    int     getIndexType() const        { return indexType; }
+    void    setLeafSize(size_t n)       { leafSize = std::max<size_t>(1, n); }
+    // -------------------------------------------------------------------------
+    
+    // search state for one query: the best candidates so far, kept sorted,
+    // in the metric's reduced form (squared for L2)
+    struct Candidates
+    {
+        size_t              k;          // 0 for radius queries
+        float               worst;      // reduced distance bound
+        std::vector<float>  distances;
+        std::vector<size_t> indices;
+        
+        void push(float d, size_t i);
+    };
+    
+protected:
+    // -------------------------------------------------------------------------
+    struct Node
+    {
+        int     left, right;            // children, -1 for a leaf
+        int     dimension;              // KD-tree split dimension
+        float   threshold;              // KD-tree split value, VP-tree radius
+        size_t  begin, end;             // rows of 'points' under this node
+    };
+    
+    // -------------------------------------------------------------------------
+    // distance in reduced form: L1, or squared L2
+    inline float reducedDistance(const float *a, const float *b) const
+    {
+        return metric == DISTANCE_L1 ? pkm::math::l1Distance(a, b, points.cols)
+                                     : pkm::math::squaredL2Distance(a, b, points.cols);
+    }
+    inline float toDistance(float reduced) const
+    {
+        return metric == DISTANCE_L1 ? reduced : sqrtf(reduced);
+    }
+    inline float toReduced(float distance) const
+    {
+        return metric == DISTANCE_L1 ? distance : distance * distance;
+    }
+    
+    int     buildKDTree(const Mat &database, std::vector<size_t> &order, size_t begin, size_t end);
+    int     buildVPTree(const Mat &database, std::vector<size_t> &order, size_t begin, size_t end);
+    
+    void    scanLeaf(const float *query, size_t begin, size_t end, Candidates &candidates) const;
+    void    searchKDTree(const float *query, int node, float reduced, std::vector<float> &offsets,
+                         Candidates &candidates) const;
+    void    searchVPTree(const float *query, int node, Candidates &candidates) const;
+    void    search(const float *query, Candidates &candidates) const;
+    void    finish(Candidates &candidates, std::vector<size_t> &indices, std::vector<float> &distances) const;
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    Mat                 points;         // database rows, reordered by leaf
+    std::vector<size_t> originalIndex;  // row of 'points' -> row of the database
+    std::vector<Node>   nodes;
+    int                 metric;
+    int                 indexType;
+    size_t              leafSize;
+    // -------------------------------------------------------------------------
+};
@@ -0,0 +1,301 @@
+// -----------------------------------------------------------------------------
+//  pkmPCA.cpp
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+
+#include "pkmPCA.h"
+#include "pkmParallel.h"
+#include "pkmCovariance.h"
+
+// rows per centering/GEMM block
+static const size_t PCA_BLOCK_ROWS = 256;
+
+// -------------------------------------------------------------------------
+// rows [r0, r1) of X minus 'mean', into 'centered'
+static void centerRows(const Mat &X, size_t r0, size_t r1, const float *mean, float *centered)
+{
+    const size_t D = X.cols;
+    for (size_t r = r0; r < r1; r++) {
+        vDSP_vsub(mean, 1, X.data + r * D, 1, centered + (r - r0) * D, 1, D);
+    }
+}
+
+// -------------------------------------------------------------------------
+pkmPCA::pkmPCA(size_t k)
+{
+    numComponents = k;
+    numSamples = 0;
+}
+
+// -------------------------------------------------------------------------
+void pkmPCA::train(const Mat &X)
+{
+    const size_t N = X.rows, D = X.cols;
+    if (X.data == NULL || N < 2 || D == 0 || numComponents == 0) {
+        printf("[ERROR]: pkmPCA::train() needs at least 2 observations and 1 component\n");
+        return;
+    }
+    const size_t K = std::min(numComponents, D);
+    
+    // covariance of the centered rows, accumulated with SYRK over row blocks
+    CovarianceAccumulator statistics;
+    accumulateCovariance(X, statistics);
+    Mat covariance;
+    statistics.covariance(covariance, 1.0);
+    
+    const std::vector<double> &m = statistics.getMean();
+    mean = Mat(1, D);
+    squaredDeviations.resize(D);
+    for (size_t d = 0; d < D; d++) {
+        mean.data[d] = (float)m[d];
+        squaredDeviations[d] = statistics.getScatter()[d * D + d];
+    }
+    
+    if (covariance.eigSymmetric(explainedVariance, components, K) != 0) {
+        numSamples = 0;
+        return;
+    }
+    singularValues = Mat(1, explainedVariance.cols);
+    for (size_t k = 0; k < explainedVariance.cols; k++) {
+        explainedVariance.data[k] = std::max(0.0f, explainedVariance.data[k]);
+        singularValues.data[k] = sqrtf(explainedVariance.data[k] * (N - 1));
+    }
+    numComponents = components.rows;
+    numSamples = N;
+    fixSigns();
+}
+
+// -------------------------------------------------------------------------
+void pkmPCA::partialFit(const Mat &batch)
+{
+    const size_t B = batch.rows, D = batch.cols;
+    if (batch.data == NULL || B == 0) {
+        return;
+    }
+    if (numSamples == 0) {
+        if (B < numComponents || numComponents == 0) {
+            printf("[ERROR]: pkmPCA::partialFit() the first batch needs at least %lu rows, got %lu\n", numComponents, B);
+            return;
+        }
+        numComponents = std::min(numComponents, D);
+        mean = Mat(1, D, true);
+        squaredDeviations.assign(D, 0.0);
+    }
+    else if (D != mean.cols) {
+        printf("[ERROR]: pkmPCA::partialFit() batch has %lu dimensions, model has %lu\n", D, mean.cols);
+        return;
+    }
+    else if (numComponents > components.rows) {
+        // the directions beyond the stored components were discarded
+        printf("[ERROR]: pkmPCA::partialFit() model keeps %lu components, call train() to fit %lu\n", components.rows, numComponents);
+        return;
+    }
+    
+    // batch mean and squared deviations
+    std::vector<double> batchMean(D, 0.0), batchDeviations(D, 0.0);
+    for (size_t r = 0; r < B; r++) {
+        for (size_t d = 0; d < D; d++) {
+            batchMean[d] += batch.data[r * D + d];
+        }
+    }
+    Mat batchMeanf(1, D);
+    for (size_t d = 0; d < D; d++) {
+        batchMean[d] /= B;
+        batchMeanf.data[d] = (float)batchMean[d];
+    }
+    
+    // [diag(S) V_t; batch - batch mean; mean correction]
+    const size_t n = numSamples, total = n + B;
+    // every stored component feeds the update, which may keep fewer of them
+    // if setNumComponents() lowered the count
+    const size_t K = numComponents;
+    const size_t previous = n ? std::min(components.rows, singularValues.cols) : 0;
+    Mat stacked(previous + B + (n ? 1 : 0), D);
+    for (size_t k = 0; k < previous; k++) {
+        vDSP_vsmul(components.data + k * D, 1, singularValues.data + k, stacked.data + k * D, 1, D);
+    }
+    centerRows(batch, 0, B, batchMeanf.data, stacked.data + previous * D);
+    for (size_t r = 0; r < B; r++) {
+        const float *c = stacked.data + (previous + r) * D;
+        for (size_t d = 0; d < D; d++) {
+            batchDeviations[d] += c[d] * (double)c[d];
+        }
+    }
+    if (n) {
+        double scale = sqrt((double)n * B / total);
+        float *correction = stacked.data + (previous + B) * D;
+        for (size_t d = 0; d < D; d++) {
+            correction[d] = (float)(scale * (mean.data[d] - batchMean[d]));
+        }
+    }
+    
+    Mat U;
+    if (stacked.svdTruncated(U, singularValues, components, K) != 0) {
+        return;
+    }
+    
+    // combined mean and squared deviations (Chan et al.)
+    for (size_t d = 0; d < D; d++) {
+        double delta = batchMean[d] - mean.data[d];
+        squaredDeviations[d] += batchDeviations[d] + delta * delta * n * B / total;
+        mean.data[d] = (float)((mean.data[d] * (double)n + batchMean[d] * B) / total);
+    }
+    
+    numSamples = total;
+    explainedVariance = Mat(1, singularValues.cols);
+    for (size_t k = 0; k < singularValues.cols; k++) {
+        explainedVariance.data[k] = singularValues.data[k] * singularValues.data[k] / (float)std::max<size_t>(1, total - 1);
+    }
+    fixSigns();
+}
+
+// -------------------------------------------------------------------------
+void pkmPCA::transform(const Mat &X, Mat &Y) const
+{
+    const size_t N = X.rows, D = mean.cols, K = components.rows;
+    if (!isTrained() || X.cols != D) {
+        printf("[ERROR]: pkmPCA::transform() data has %lu dimensions, model has %lu\n", X.cols, D);
+        return;
+    }
+    if (Y.rows != N || Y.cols != K || !Y.bAllocated) {
+        Y = Mat(N, K);
+    }
+    
+    // centering first keeps the precision of data far from the origin
+    parallelFor(0, N, PCA_BLOCK_ROWS, [&](size_t b0, size_t b1) {
+        Mat centered(PCA_BLOCK_ROWS, D);
+        for (size_t r0 = b0; r0 < b1; r0 += PCA_BLOCK_ROWS) {
+            size_t r1 = std::min(b1, r0 + PCA_BLOCK_ROWS);
+            centerRows(X, r0, r1, mean.data, centered.data);
+            cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, r1 - r0, K, D,
+                        1.0f, centered.data, D, components.data, D, 0.0f, Y.data + r0 * K, K);
+        }
+    });
+}
+
+// -------------------------------------------------------------------------
+void pkmPCA::inverseTransform(const Mat &Y, Mat &X) const
+{
+    const size_t N = Y.rows, D = mean.cols, K = components.rows;
+    if (!isTrained() || Y.cols != K) {
+        printf("[ERROR]: pkmPCA::inverseTransform() data has %lu components, model has %lu\n", Y.cols, K);
+        return;
+    }
+    if (X.rows != N || X.cols != D || !X.bAllocated) {
+        X = Mat(N, D);
+    }
+    
+    // X = Y V_t + mean
+    for (size_t r = 0; r < N; r++) {
+        cblas_scopy(D, mean.data, 1, X.data + r * D, 1);
+    }
+    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, N, D, K,
+                1.0f, Y.data, K, components.data, D, 1.0f, X.data, D);
+}
+
+// -------------------------------------------------------------------------
+Mat pkmPCA::getExplainedVarianceRatio() const
+{
+    double total = 0;
+    for (size_t d = 0; d < squaredDeviations.size(); d++) {
+        total += squaredDeviations[d];
+    }
+    total /= numSamples > 1 ? numSamples - 1 : 1;
+    
+    Mat ratio(1, explainedVariance.cols);
+    for (size_t k = 0; k < explainedVariance.cols; k++) {
+        ratio.data[k] = total > 0 ? (float)(explainedVariance.data[k] / total) : 0.0f;
+    }
+    return ratio;
+}
+
+// -------------------------------------------------------------------------
+void pkmPCA::fixSigns()
+{
+    const size_t D = components.cols;
+    for (size_t k = 0; k < components.rows; k++) {
+        float *c = components.data + k * D;
+        size_t largest = 0;
+        for (size_t d = 1; d < D; d++) {
+            if (fabsf(c[d]) > fabsf(c[largest])) {
+                largest = d;
+            }
+        }
+        if (c[largest] < 0) {
+            vDSP_vneg(c, 1, c, 1, D);
+        }
+    }
+}
@@ -0,0 +1,165 @@
+// -----------------------------------------------------------------------------
+//  pkmPCA.h
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "pkmMatrix.h"
+#include <vector>
+
+using namespace pkm;
+
+// -----------------------------------------------------------------------------
+//  Principal component analysis of the rows of a pkm::Mat.
+//
+//  train() accumulates the covariance of the centered data with SYRK and
+//  keeps its leading eigenvectors (Mat::eigSymmetric), without forming the
+//  full decomposition of the data.  partialFit() is incremental PCA (Ross et
+//  al. 2008): each batch is stacked under the current scaled components and
+//  a mean correction row and the leading right singular vectors of that small
+//  matrix become the new components, so the projection follows streaming
+//  data in memory independent of the number of rows seen.
+//
+//  transform() and inverseTransform() are one GEMM per block of rows.
+// -----------------------------------------------------------------------------
+class pkmPCA
+{
+public:
+    // -------------------------------------------------------------------------
+    pkmPCA(size_t numComponents = 32);
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    // components kept by the next train()/first partialFit(); later
+    // partialFit() calls can lower the count but not raise it
+    void setNumComponents(size_t k)             { numComponents = k; }
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  Fit to X (observations x dimensions) from scratch
+    // -------------------------------------------------------------------------
+    void train(const Mat &X);
+    
+    // -------------------------------------------------------------------------
+    //  Update the fit with a batch of rows (at least numComponents rows for
+    //  the first batch)
+    // -------------------------------------------------------------------------
+    void partialFit(const Mat &batch);
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  X (N x D) -> Y (N x numComponents) and back
+    // -------------------------------------------------------------------------
+    void transform(const Mat &X, Mat &Y) const;
+    void inverseTransform(const Mat &Y, Mat &X) const;
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    // numComponents x D, one unit component per row
+    const Mat & getComponents() const           { return components; }
+    const Mat & getMean() const                 { return mean; }
+    // variance along each component, 1 x numComponents
+    const Mat & getExplainedVariance() const    { return explainedVariance; }
+    // fraction of the total variance along each component
+    Mat         getExplainedVarianceRatio() const;
+    size_t      getNumComponents() const        { return numComponents; }
+    size_t      getNumSamples() const           { return numSamples; }
+    bool        isTrained() const               { return numSamples > 0; }
+    // -------------------------------------------------------------------------
+    
+protected:
+    // -------------------------------------------------------------------------
+    // flip each component so its largest magnitude element is positive, so
+    // that signs do not alternate between fits
+    void        fixSigns();
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    size_t      numComponents;
+    size_t      numSamples;
+    
+    Mat         components;                 // K x D
+    Mat         singularValues;             // 1 x K, of the centered data seen
+    Mat         explainedVariance;          // 1 x K
+    Mat         mean;                       // 1 x D
+    
+    // per dimension sum of squared deviations from the mean, for the total
+    // variance
+    std::vector<double> squaredDeviations;
+    // -------------------------------------------------------------------------
+};
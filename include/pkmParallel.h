@@ -0,0 +1,635 @@
+// -----------------------------------------------------------------------------
+//  pkmParallel.h
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <algorithm>
+#include <functional>
+#include "pkmInstrument.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#endif
+#ifdef __APPLE__
+#include <pthread.h>
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+#endif
+
+namespace pkm
+{
+#ifdef __linux__
+    // -------------------------------------------------------------------------
+    //  CPUs the process may run on, in increasing order, as restricted by
+    //  taskset, cpusets or cgroups when the pool was first used; empty if the
+    //  mask cannot be read.  Never destroyed, like the pool whose workers
+    //  read it.
+    // -------------------------------------------------------------------------
+    inline const std::vector<int> & parallelAllowedCpus()
+    {
+        static const std::vector<int> *cpus = []() {
+            std::vector<int> *allowed = new std::vector<int>();
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+                for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                    if (CPU_ISSET(cpu, &set)) {
+                        allowed->push_back(cpu);
+                    }
+                }
+            }
+            return allowed;
+        }();
+        return *cpus;
+    }
+#endif
+    
+    // cores the process may use: the allowed CPUs on Linux, otherwise all
+    inline size_t getNumCores()
+    {
+#ifdef __linux__
+        if (!parallelAllowedCpus().empty()) {
+            return parallelAllowedCpus().size();
+        }
+#endif
+        return std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    
+    // -------------------------------------------------------------------------
+    //  Number of threads used by parallelFor, the caller included (defaults
+    //  to getNumCores())
+    // -------------------------------------------------------------------------
+    inline size_t & parallelNumThreadsRef()
+    {
+        static size_t numThreads = getNumCores();
+        return numThreads;
+    }
+    
+    inline size_t getNumThreads()
+    {
+        return parallelNumThreadsRef();
+    }
+    
+    // true while running inside a parallelFor, so that nested calls (e.g. an
+    // EM step called from a model-order sweep) run serially instead of
+    // oversubscribing the machine
+    inline bool & parallelInWorkerRef()
+    {
+        static thread_local bool bInWorker = false;
+        return bInWorker;
+    }
+    
+    // streaming kernels (element-wise and unary math, row normalizations)
+    // are split into tasks of at least this many elements; anything smaller
+    // than two tasks runs on the calling thread
+    static const size_t PARALLEL_GRAIN_ELEMENTS = 16384;
+    
+    // rows of 'cols' elements per task
+    inline size_t parallelRowGrain(size_t cols)
+    {
+        return std::max<size_t>(1, PARALLEL_GRAIN_ELEMENTS / std::max<size_t>(1, cols));
+    }
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  A work-stealing thread pool of getNumThreads() - 1 workers.
+    //
+    //  Every participating thread, workers and callers of parallelFor alike,
+    //  owns a deque of tasks.  A task larger than its job's split size pushes
+    //  its right half onto the back of its thread's deque and keeps the left
+    //  half, so the owner works depth first from the back while idle threads
+    //  steal the largest remaining halves from the front.  A caller only
+    //  helps with its own job and sleeps once the last pieces are running
+    //  elsewhere.  Workers start on first use and are never destroyed, so
+    //  that they can outlive other statics at exit.
+    // -------------------------------------------------------------------------
+    class ThreadPool
+    {
+    public:
+        // a parallelFor in flight; fn is the caller's functor
+        struct Job
+        {
+            void (*invoke)(const void *fn, size_t begin, size_t end);
+            const void *fn;
+            size_t splitSize;
+            std::atomic<size_t> remaining;
+            std::mutex mutex;
+            std::condition_variable finished;
+            bool bDone;
+        };
+        
+        struct Task
+        {
+            Job *job;
+            size_t begin, end;
+        };
+        
+        // a thread's deque; slots are reused but never freed, so thieves can
+        // scan them without further synchronization
+        struct Slot
+        {
+            Slot() : bInUse(false)
+            {
+            }
+            
+            void pushBack(const Task &task)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                tasks.push_back(task);
+            }
+            
+            bool popBack(Task &task, const Job *job)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (tasks.empty() || (job != NULL && tasks.back().job != job)) {
+                    return false;
+                }
+                task = tasks.back();
+                tasks.pop_back();
+                return true;
+            }
+            
+            bool stealFront(Task &task, const Job *job)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (tasks.empty() || (job != NULL && tasks.front().job != job)) {
+                    return false;
+                }
+                task = tasks.front();
+                tasks.pop_front();
+                return true;
+            }
+            
+            std::atomic<bool> bInUse;
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+        
+        // workers and callers that can take part at once
+        static const size_t MAX_SLOTS = 256;
+        
+        // tasks per thread a job is split into at most, for load balance
+        static const size_t TASKS_PER_THREAD = 8;
+        
+        static ThreadPool & get()
+        {
+            static ThreadPool *pool = new ThreadPool();
+            return *pool;
+        }
+        
+        // -------------------------------------------------------------------------
+        //  call fn(chunkBegin, chunkEnd) over [begin, end) in chunks of at least
+        //  'grain' items, on this thread and any idle workers
+        // -------------------------------------------------------------------------
+        template <typename Function>
+        void run(size_t begin, size_t end, size_t grain, const Function &fn)
+        {
+            Slot *slot = callerSlot();
+            if (slot == NULL) {
+                fn(begin, end);
+                return;
+            }
+            
+            size_t numThreads = numWorkers.load(std::memory_order_relaxed) + 1;
+            Job job;
+            job.invoke = &invoke<Function>;
+            job.fn = &fn;
+            job.splitSize = std::max(grain, (end - begin + numThreads * TASKS_PER_THREAD - 1) / (numThreads * TASKS_PER_THREAD));
+            job.remaining.store(end - begin);
+            job.bDone = false;
+            
+            Task task = { &job, begin, end };
+            execute(*slot, task);
+            
+            // finish our own pieces, then anything of ours still queued elsewhere
+            size_t spins = 0;
+            while (job.remaining.load(std::memory_order_acquire) > 0) {
+                if (pop(*slot, task, &job) || steal(task, &job)) {
+                    execute(*slot, task);
+                    spins = 0;
+                }
+                else if (++spins < 64) {
+                    std::this_thread::yield();
+                }
+                else {
+                    break;
+                }
+            }
+            std::unique_lock<std::mutex> lock(job.mutex);
+            job.finished.wait(lock, [&]() { return job.bDone; });
+        }
+        
+        // -------------------------------------------------------------------------
+        //  restart with n - 1 workers; must not be called while parallel work
+        //  is in flight
+        // -------------------------------------------------------------------------
+        void resize(size_t numThreads)
+        {
+            stopWorkers();
+            startWorkers(numThreads - 1);
+        }
+        
+        // pin worker i to allowed CPU i + 1, leaving the first to the calling
+        // thread (Linux), or give each worker its own affinity tag (macOS)
+        void setAffinity(bool bPin)
+        {
+            if (bPin != bAffinity) {
+                // the running workers read the flag as they start, so it
+                // changes only once they have stopped
+                size_t n = numWorkers.load();
+                stopWorkers();
+                bAffinity = bPin;
+                startWorkers(n);
+            }
+        }
+        
+        bool getAffinity() const
+        {
+            return bAffinity;
+        }
+        
+    private:
+        ThreadPool() : numSlots(0), numWorkers(0), queued(0), sleeping(0), bStop(false), bAffinity(false)
+        {
+            startWorkers(getNumThreads() - 1);
+        }
+        
+        template <typename Function>
+        static void invoke(const void *fn, size_t begin, size_t end)
+        {
+            (*static_cast<const Function *>(fn))(begin, end);
+        }
+        
+        Slot * claimSlot()
+        {
+            for (size_t i = 0; i < MAX_SLOTS; i++) {
+                bool bFree = false;
+                if (slots[i].bInUse.compare_exchange_strong(bFree, true)) {
+                    size_t used = numSlots.load();
+                    while (used < i + 1 && !numSlots.compare_exchange_weak(used, i + 1)) {
+                    }
+                    return &slots[i];
+                }
+            }
+            return NULL;
+        }
+        
+        // the calling thread's slot, claimed on its first parallelFor and
+        // released when it exits
+        Slot * callerSlot()
+        {
+            struct Claim
+            {
+                Claim() : slot(ThreadPool::get().claimSlot())
+                {
+                }
+                
+                ~Claim()
+                {
+                    if (slot != NULL) {
+                        slot->bInUse.store(false);
+                    }
+                }
+                
+                Slot *slot;
+            };
+            static thread_local Claim claim;
+            return claim.slot;
+        }
+        
+        // split 'task' down to its job's split size, queueing the right
+        // halves on 'slot', then run what is left
+        void execute(Slot &slot, Task task)
+        {
+            Job &job = *task.job;
+            bool bQueued = false;
+            while (task.end - task.begin > job.splitSize) {
+                size_t middle = task.begin + (task.end - task.begin) / 2;
+                Task right = { task.job, middle, task.end };
+                // counted first, so that 'queued' never runs below the deques
+                queued.fetch_add(1);
+                slot.pushBack(right);
+                task.end = middle;
+                bQueued = true;
+            }
+            if (bQueued) {
+                wakeWorkers();
+            }
+            
+            bool bWasInWorker = parallelInWorkerRef();
+            parallelInWorkerRef() = true;
+            job.invoke(job.fn, task.begin, task.end);
+            parallelInWorkerRef() = bWasInWorker;
+            
+            size_t n = task.end - task.begin;
+            if (job.remaining.fetch_sub(n, std::memory_order_acq_rel) == n) {
+                std::lock_guard<std::mutex> lock(job.mutex);
+                job.bDone = true;
+                job.finished.notify_all();
+            }
+        }
+        
+        // take the most recently queued task of our own deque
+        bool pop(Slot &slot, Task &task, const Job *job)
+        {
+            if (slot.popBack(task, job)) {
+                queued.fetch_sub(1);
+                return true;
+            }
+            return false;
+        }
+        
+        // take a task from the front of another thread's deque, starting at
+        // a random victim; 'job' restricts it to that job's tasks
+        bool steal(Task &task, const Job *job)
+        {
+            static thread_local unsigned int seed = (unsigned int)std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            size_t n = numSlots.load(std::memory_order_acquire);
+            for (size_t i = 0; i < n; i++) {
+                Slot &victim = slots[(seed + i) % n];
+                if (victim.stealFront(task, job)) {
+                    queued.fetch_sub(1);
+                    return true;
+                }
+            }
+            return false;
+        }
+        
+        void wakeWorkers()
+        {
+            if (sleeping.load() > 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                available.notify_all();
+            }
+        }
+        
+        void workerLoop(size_t index)
+        {
+            Slot &slot = *workerSlots[index];
+            pinWorker(index);
+            while (true) {
+                Task task;
+                if (pop(slot, task, NULL)) {
+                    execute(slot, task);
+                    continue;
+                }
+                if (steal(task, NULL)) {
+                    execute(slot, task);
+                    continue;
+                }
+                
+                std::unique_lock<std::mutex> lock(mutex);
+                sleeping.fetch_add(1);
+                available.wait(lock, [&]() { return bStop || queued.load() > 0; });
+                sleeping.fetch_sub(1);
+                if (bStop) {
+                    return;
+                }
+            }
+        }
+        
+        void pinWorker(size_t index)
+        {
+            if (!bAffinity) {
+                return;
+            }
+#ifdef __linux__
+            const std::vector<int> &allowed = parallelAllowedCpus();
+            if (allowed.empty()) {
+                return;
+            }
+            int cpu = allowed[(index + 1) % allowed.size()];
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(cpu, &cpus);
+            int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+            if (error != 0) {
+                // the worker still runs, wherever the scheduler puts it
+                printf("[ERROR]: pkm::ThreadPool could not pin worker %lu to CPU %d: %s\n",
+                       (unsigned long)index, cpu, strerror(error));
+            }
+#elif defined(__APPLE__)
+            // macOS only takes hints: threads with different tags are kept
+            // on different L2 caches where possible
+            thread_affinity_policy_data_t policy = { (integer_t)(index % getNumCores() + 1) };
+            thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_AFFINITY_POLICY,
+                              (thread_policy_t)&policy, THREAD_AFFINITY_POLICY_COUNT);
+#else
+            (void)index;
+#endif
+        }
+        
+        void startWorkers(size_t n)
+        {
+            bStop = false;
+            for (size_t i = 0; i < n; i++) {
+                Slot *slot = claimSlot();
+                if (slot == NULL) {
+                    break;
+                }
+                workerSlots.push_back(slot);
+            }
+            numWorkers.store(workerSlots.size());
+            for (size_t i = 0; i < workerSlots.size(); i++) {
+                workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+            }
+        }
+        
+        void stopWorkers()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                bStop = true;
+                available.notify_all();
+            }
+            for (size_t i = 0; i < workers.size(); i++) {
+                workers[i].join();
+            }
+            for (size_t i = 0; i < workerSlots.size(); i++) {
+                workerSlots[i]->bInUse.store(false);
+            }
+            workers.clear();
+            workerSlots.clear();
+            numWorkers.store(0);
+        }
+        
+        Slot slots[MAX_SLOTS];
+        std::atomic<size_t> numSlots;   // slots ever used, for thieves to scan
+        std::atomic<size_t> numWorkers;
+        std::vector<Slot *> workerSlots;
+        std::vector<std::thread> workers;
+        
+        std::atomic<size_t> queued;     // tasks waiting in any deque
+        std::atomic<size_t> sleeping;
+        std::mutex mutex;
+        std::condition_variable available;
+        bool bStop, bAffinity;
+    };
+    // -------------------------------------------------------------------------
+    
+    inline void setNumThreads(size_t n)
+    {
+        parallelNumThreadsRef() = std::max<size_t>(1, n);
+        ThreadPool::get().resize(parallelNumThreadsRef());
+    }
+    
+    // pin the pool's workers to cores (see ThreadPool::setAffinity)
+    inline void setThreadAffinity(bool bPin)
+    {
+        ThreadPool::get().setAffinity(bPin);
+    }
+    
+    // -------------------------------------------------------------------------
+    //  Split [begin, end) into contiguous chunks of at least 'grain' items and
+    //  call fn(chunkBegin, chunkEnd) for each chunk on up to getNumThreads()
+    //  threads, the caller included.  Runs inline when the range is smaller
+    //  than two chunks or when already called from inside another parallelFor.
+    // -------------------------------------------------------------------------
+    template <typename Function>
+    void parallelFor(size_t begin, size_t end, size_t grain, Function fn)
+    {
+        if (end <= begin) {
+            return;
+        }
+        
+        grain = std::max<size_t>(1, grain);
+        if (getNumThreads() <= 1 || end - begin < 2 * grain || parallelInWorkerRef()) {
+            fn(begin, end);
+            return;
+        }
+        
+        // chunks count their operations under the caller's label
+        PKM_INSTRUMENT_CAPTURE_LABEL(label);
+        auto chunk = [&](size_t b, size_t e) {
+            PKM_INSTRUMENT_RESTORE_LABEL(label);
+            fn(b, e);
+        };
+        ThreadPool::get().run(begin, end, grain, chunk);
+    }
+    
+    // parallelFor over n elements of a streaming kernel
+    template <typename Function>
+    void parallelForElements(size_t n, Function fn)
+    {
+        parallelFor(0, n, PARALLEL_GRAIN_ELEMENTS, fn);
+    }
+    
+    // -------------------------------------------------------------------------
+    //  combine(..., fn(chunkBegin, chunkEnd)) over fixed chunks of 'grain'
+    //  items, starting from 'identity'.  The chunks and the order in which
+    //  they are combined depend only on the range and grain, so the result is
+    //  the same for any number of threads.
+    // -------------------------------------------------------------------------
+    template <typename T, typename Function, typename Combine>
+    T parallelReduce(size_t begin, size_t end, size_t grain, T identity, Function fn, Combine combine)
+    {
+        if (end <= begin) {
+            return identity;
+        }
+        grain = std::max<size_t>(1, grain);
+        size_t numChunks = (end - begin + grain - 1) / grain;
+        if (numChunks == 1) {
+            return combine(identity, fn(begin, end));
+        }
+        std::vector<T> partials(numChunks, identity);
+        parallelFor(0, numChunks, 1, [&](size_t c0, size_t c1) {
+            for (size_t c = c0; c < c1; c++) {
+                partials[c] = fn(begin + c * grain, std::min(end, begin + (c + 1) * grain));
+            }
+        });
+        T result = identity;
+        for (size_t c = 0; c < numChunks; c++) {
+            result = combine(result, partials[c]);
+        }
+        return result;
+    }
+    // -------------------------------------------------------------------------
+};
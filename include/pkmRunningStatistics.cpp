@@ -0,0 +1,218 @@
+// -----------------------------------------------------------------------------
+//  pkmRunningStatistics.cpp
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+
+#include "pkmRunningStatistics.h"
+
+// -------------------------------------------------------------------------
+void pkmRunningStatistics::push(const float *row, size_t length)
+{
+    if (row == NULL || length == 0) {
+        return;
+    }
+    
+    if (cols == 0 && count == 0) {
+        reset(length);
+    }
+    
+    if (length != cols) {
+        printf("[ERROR::pkmRunningStatistics]: push(row, length) requires %lu columns, row has %lu!\n", cols, length);
+        return;
+    }
+    
+    push(row);
+}
+// -------------------------------------------------------------------------
+
+// -------------------------------------------------------------------------
+void pkmRunningStatistics::push(const Mat &m)
+{
+    // views from rowRange(..., false) are not 'allocated', so check the data
+    if (m.data == NULL || m.rows == 0 || m.cols == 0) {
+        return;
+    }
+    
+    if (cols == 0 && count == 0) {
+        reset(m.cols);
+    }
+    
+    if (m.cols != cols) {
+        printf("[ERROR::pkmRunningStatistics]: push(Mat m) requires %lu columns, m has %lu!\n", cols, m.cols);
+        return;
+    }
+    
+    for (size_t r = 0; r < m.rows; r++) {
+        push(m.data + r * m.cols);
+    }
+}
+// -------------------------------------------------------------------------
+
+// -------------------------------------------------------------------------
+void pkmRunningStatistics::merge(const pkmRunningStatistics &rhs)
+{
+    if (rhs.count == 0) {
+        return;
+    }
+    
+    if (count == 0) {
+        *this = rhs;
+        return;
+    }
+    
+    if (rhs.cols != cols) {
+        printf("[ERROR::pkmRunningStatistics]: merge() requires the same number of dimensions!\n");
+        return;
+    }
+    
+    const double na = (double)count;
+    const double nb = (double)rhs.count;
+    const double n = na + nb;
+    for (size_t i = 0; i < cols; i++)
+    {
+        const double delta = rhs.meanValues[i] - meanValues[i];
+        meanValues[i] += delta * nb / n;
+        m2Values[i] += rhs.m2Values[i] + delta * delta * na * nb / n;
+        minValues[i] = std::min<float>(minValues[i], rhs.minValues[i]);
+        maxValues[i] = std::max<float>(maxValues[i], rhs.maxValues[i]);
+    }
+    count += rhs.count;
+}
+// -------------------------------------------------------------------------
+
+// -------------------------------------------------------------------------
+Mat pkmRunningStatistics::getMean() const
+{
+    if (cols == 0) {
+        return Mat();
+    }
+    Mat m(1, cols);
+    for (size_t i = 0; i < cols; i++) {
+        m.data[i] = meanValues[i];
+    }
+    return m;
+}
+
+Mat pkmRunningStatistics::getVariance() const
+{
+    if (cols == 0) {
+        return Mat();
+    }
+    Mat m(1, cols, true);
+    if (count > 0) {
+        for (size_t i = 0; i < cols; i++) {
+            m.data[i] = m2Values[i] / (double)count;
+        }
+    }
+    return m;
+}
+
+Mat pkmRunningStatistics::getStdDev() const
+{
+    if (cols == 0) {
+        return Mat();
+    }
+    Mat m(1, cols, true);
+    if (count > 0) {
+        for (size_t i = 0; i < cols; i++) {
+            m.data[i] = sqrt(m2Values[i] / (double)count);
+        }
+    }
+    return m;
+}
+
+Mat pkmRunningStatistics::getMin() const
+{
+    if (cols == 0) {
+        return Mat();
+    }
+    return Mat(1, cols, &(minValues[0]));
+}
+
+Mat pkmRunningStatistics::getMax() const
+{
+    if (cols == 0) {
+        return Mat();
+    }
+    return Mat(1, cols, &(maxValues[0]));
+}
+
+void pkmRunningStatistics::getMeanAndStdDev(Mat &meanMat, Mat &stddevMat) const
+{
+    meanMat = getMean();
+    stddevMat = getStdDev();
+}
+// -------------------------------------------------------------------------
@@ -0,0 +1,199 @@
+// -----------------------------------------------------------------------------
+//  pkmRunningStatistics.h
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "pkmMatrix.h"
+#include <vector>
+
+using namespace pkm;
+
+// -----------------------------------------------------------------------------
+//  Online per-column statistics (count, mean, M2, min, max) of a stream of
+//  row vectors.  Each appended row costs O(cols) using Welford's update, and
+//  two accumulators (e.g. built on separate threads) can be combined with
+//  merge() using Chan et al.'s pairwise update.  Variances are the population
+//  variances, i.e. the same as pkm::Mat::var() / stddev().
+// -----------------------------------------------------------------------------
+class pkmRunningStatistics
+{
+public:
+    // -------------------------------------------------------------------------
+    pkmRunningStatistics()
+    {
+        reset(0);
+    }
+    
+    pkmRunningStatistics(size_t dimensions)
+    {
+        reset(dimensions);
+    }
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  Forget everything seen so far.  A dimension of 0 lets the first pushed
+    //  Mat or (row, length) decide the number of columns.
+    // -------------------------------------------------------------------------
+    void reset(size_t dimensions)
+    {
+        count = 0;
+        cols = dimensions;
+        meanValues.assign(cols, 0.0);
+        m2Values.assign(cols, 0.0);
+        minValues.assign(cols, HUGE_VALF);
+        maxValues.assign(cols, -HUGE_VALF);
+    }
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  Add a single observation of length 'cols'.  The dimensions must already
+    //  be known; use push(row, length) on an accumulator reset with 0.
+    // -------------------------------------------------------------------------
+    inline void push(const float *row)
+    {
+        if (cols == 0) {
+            printf("[ERROR::pkmRunningStatistics]: push(float *row) requires the dimensions to be set, use push(row, length)!\n");
+            return;
+        }
+        count++;
+        const double n = (double)count;
+        for (size_t i = 0; i < cols; i++)
+        {
+            const double x = row[i];
+            const double delta = x - meanValues[i];
+            meanValues[i] += delta / n;
+            m2Values[i] += delta * (x - meanValues[i]);
+            if (row[i] < minValues[i]) minValues[i] = row[i];
+            if (row[i] > maxValues[i]) maxValues[i] = row[i];
+        }
+    }
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  Add a single observation of 'length' values
+    // -------------------------------------------------------------------------
+    void push(const float *row, size_t length);
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  Add every row of 'm' (size is observations x dimensions)
+    // -------------------------------------------------------------------------
+    void push(const Mat &m);
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    //  Combine with statistics gathered elsewhere, e.g. on another thread
+    // -------------------------------------------------------------------------
+    void merge(const pkmRunningStatistics &rhs);
+    // -------------------------------------------------------------------------
+    
+    // -------------------------------------------------------------------------
+    inline size_t getCount() const
+    {
+        return count;
+    }
+    
+    inline size_t getDimensions() const
+    {
+        return cols;
+    }
+    
+    // 1 x cols
+    Mat getMean() const;
+    Mat getVariance() const;
+    Mat getStdDev() const;
+    Mat getMin() const;
+    Mat getMax() const;
+    
+    // same layout as pkm::Mat::getMeanAndStdDev(Mat &, Mat &)
+    void getMeanAndStdDev(Mat &meanMat, Mat &stddevMat) const;
+    // -------------------------------------------------------------------------
+    
+private:
+    // -------------------------------------------------------------------------
+    size_t                  count;
+    size_t                  cols;
+    
+    // accumulated in double so that long streams do not lose precision
+    std::vector<double>     meanValues;
+    std::vector<double>     m2Values;
+    std::vector<float>      minValues;
+    std::vector<float>      maxValues;
+    // -------------------------------------------------------------------------
+};
@@ -0,0 +1,570 @@
+// -----------------------------------------------------------------------------
+//  pkmSmallMat.h
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "pkmMatrix.h"
+#include <math.h>
+#include <type_traits>
+
+// -----------------------------------------------------------------------------
+//  Fixed-size matrices for 1x1 to 8x8 work.
+//
+//  SmallMat<R, C, T> keeps its R x C row-major elements on the stack, so the
+//  2x2 covariances of the mixture model, small Gaussian densities and the
+//  like are computed without heap allocation or LAPACK calls.  Dimensions
+//  are compile-time constants, so the compiler fully unrolls every loop;
+//  1x1 to 3x3 determinants and inverses use closed forms.  Larger or
+//  run-time sized problems belong in pkm::Mat.
+// -----------------------------------------------------------------------------
+
+namespace pkm
+{
+    static const size_t SMALL_MAT_MAX_SIZE = 8;
+    
+    template <size_t R, size_t C, typename T = float>
+    class SmallMat
+    {
+        static_assert(R > 0 && C > 0 && R <= SMALL_MAT_MAX_SIZE && C <= SMALL_MAT_MAX_SIZE,
+                      "SmallMat is for at most 8 x 8 elements, use pkm::Mat");
+        
+    public:
+        static constexpr size_t rows = R;
+        static constexpr size_t cols = C;
+        
+        T data[R * C];
+        
+        // elements are left uninitialized, as with Mat(rows, cols)
+        SmallMat() {}
+        
+        explicit SmallMat(T val)
+        {
+            for (size_t i = 0; i < R * C; i++) {
+                data[i] = val;
+            }
+        }
+        
+        // copy R * C row-major values
+        template <typename S>
+        explicit SmallMat(const S *values)
+        {
+            for (size_t i = 0; i < R * C; i++) {
+                data[i] = (T)values[i];
+            }
+        }
+        
+        explicit SmallMat(const Mat &m)
+        {
+            fromMat(m);
+        }
+        
+        static SmallMat zeros()
+        {
+            return SmallMat((T)0);
+        }
+        
+        static SmallMat identity()
+        {
+            SmallMat result((T)0);
+            for (size_t i = 0; i < (R < C ? R : C); i++) {
+                result.data[i * C + i] = (T)1;
+            }
+            return result;
+        }
+        
+        static constexpr size_t size()
+        {
+            return R * C;
+        }
+        
+        T & operator()(size_t r, size_t c)
+        {
+            return data[r * C + c];
+        }
+        
+        const T & operator()(size_t r, size_t c) const
+        {
+            return data[r * C + c];
+        }
+        
+        T & operator[](size_t i)
+        {
+            return data[i];
+        }
+        
+        const T & operator[](size_t i) const
+        {
+            return data[i];
+        }
+        
+        // -------------------------------------------------------------------------
+        //  conversion to and from pkm::Mat; fromMat() zeros the matrix and
+        //  returns false when the sizes differ
+        // -------------------------------------------------------------------------
+        bool fromMat(const Mat &m)
+        {
+            if (m.rows != R || m.cols != C) {
+                printf("[ERROR]: SmallMat::fromMat() %lu x %lu matrix for a %lu x %lu SmallMat\n", m.rows, m.cols, R, C);
+                for (size_t i = 0; i < R * C; i++) {
+                    data[i] = (T)0;
+                }
+                return false;
+            }
+            for (size_t i = 0; i < R * C; i++) {
+                data[i] = (T)m.data[i];
+            }
+            return true;
+        }
+        
+        Mat toMat() const
+        {
+            Mat m(R, C);
+            for (size_t i = 0; i < R * C; i++) {
+                m.data[i] = (float)data[i];
+            }
+            return m;
+        }
+        
+        // -------------------------------------------------------------------------
+        //  arithmetic
+        // -------------------------------------------------------------------------
+        template <size_t K>
+        SmallMat<R, K, T> operator*(const SmallMat<C, K, T> &rhs) const
+        {
+            SmallMat<R, K, T> result;
+            for (size_t i = 0; i < R; i++) {
+                for (size_t j = 0; j < K; j++) {
+                    T sum = data[i * C] * rhs.data[j];
+                    for (size_t k = 1; k < C; k++) {
+                        sum += data[i * C + k] * rhs.data[k * K + j];
+                    }
+                    result.data[i * K + j] = sum;
+                }
+            }
+            return result;
+        }
+        
+        SmallMat operator+(const SmallMat &rhs) const
+        {
+            SmallMat result;
+            for (size_t i = 0; i < R * C; i++) {
+                result.data[i] = data[i] + rhs.data[i];
+            }
+            return result;
+        }
+        
+        SmallMat operator-(const SmallMat &rhs) const
+        {
+            SmallMat result;
+            for (size_t i = 0; i < R * C; i++) {
+                result.data[i] = data[i] - rhs.data[i];
+            }
+            return result;
+        }
+        
+        SmallMat operator*(T scalar) const
+        {
+            SmallMat result;
+            for (size_t i = 0; i < R * C; i++) {
+                result.data[i] = data[i] * scalar;
+            }
+            return result;
+        }
+        
+        SmallMat & operator+=(T scalar)
+        {
+            for (size_t i = 0; i < R * C; i++) {
+                data[i] += scalar;
+            }
+            return *this;
+        }
+        
+        SmallMat & operator*=(T scalar)
+        {
+            for (size_t i = 0; i < R * C; i++) {
+                data[i] *= scalar;
+            }
+            return *this;
+        }
+        
+        SmallMat<C, R, T> getTranspose() const
+        {
+            SmallMat<C, R, T> result;
+            for (size_t i = 0; i < R; i++) {
+                for (size_t j = 0; j < C; j++) {
+                    result.data[j * R + i] = data[i * C + j];
+                }
+            }
+            return result;
+        }
+        
+        T trace() const
+        {
+            static_assert(R == C, "trace() needs a square SmallMat");
+            T sum = 0;
+            for (size_t i = 0; i < R; i++) {
+                sum += data[i * C + i];
+            }
+            return sum;
+        }
+        
+        T dot(const SmallMat &rhs) const
+        {
+            T sum = 0;
+            for (size_t i = 0; i < R * C; i++) {
+                sum += data[i] * rhs.data[i];
+            }
+            return sum;
+        }
+        
+        // -------------------------------------------------------------------------
+        //  square matrices
+        // -------------------------------------------------------------------------
+        T determinant() const
+        {
+            static_assert(R == C, "determinant() needs a square SmallMat");
+            return determinant(std::integral_constant<size_t, R>());
+        }
+        
+        // false (and result untouched) when the matrix is singular
+        bool inverse(SmallMat &result) const
+        {
+            static_assert(R == C, "inverse() needs a square SmallMat");
+            return inverse(result, std::integral_constant<size_t, R>());
+        }
+        
+        // the inverse, or zeros when the matrix is singular
+        SmallMat getInv() const
+        {
+            SmallMat result((T)0);
+            inverse(result);
+            return result;
+        }
+        
+        // lower triangular L with this = L L^T; false when this is not
+        // symmetric positive definite
+        bool cholesky(SmallMat &L) const
+        {
+            static_assert(R == C, "cholesky() needs a square SmallMat");
+            for (size_t i = 0; i < R; i++) {
+                for (size_t j = 0; j <= i; j++) {
+                    T sum = data[i * C + j];
+                    for (size_t k = 0; k < j; k++) {
+                        sum -= L.data[i * C + k] * L.data[j * C + k];
+                    }
+                    if (i == j) {
+                        if (!(sum > 0)) {
+                            return false;
+                        }
+                        L.data[i * C + i] = sqrt(sum);
+                    }
+                    else {
+                        L.data[i * C + j] = sum / L.data[j * C + j];
+                    }
+                }
+                for (size_t j = i + 1; j < C; j++) {
+                    L.data[i * C + j] = (T)0;
+                }
+            }
+            return true;
+        }
+        
+        // x with L x = b, for this lower triangular L
+        SmallMat<R, 1, T> solveLower(const SmallMat<R, 1, T> &b) const
+        {
+            static_assert(R == C, "solveLower() needs a square SmallMat");
+            SmallMat<R, 1, T> x;
+            for (size_t i = 0; i < R; i++) {
+                T sum = b.data[i];
+                for (size_t k = 0; k < i; k++) {
+                    sum -= data[i * C + k] * x.data[k];
+                }
+                x.data[i] = sum / data[i * C + i];
+            }
+            return x;
+        }
+        
+    private:
+        T determinant(std::integral_constant<size_t, 1>) const
+        {
+            return data[0];
+        }
+        
+        T determinant(std::integral_constant<size_t, 2>) const
+        {
+            return data[0] * data[3] - data[1] * data[2];
+        }
+        
+        T determinant(std::integral_constant<size_t, 3>) const
+        {
+            return data[0] * (data[4] * data[8] - data[5] * data[7])
+                 - data[1] * (data[3] * data[8] - data[5] * data[6])
+                 + data[2] * (data[3] * data[7] - data[4] * data[6]);
+        }
+        
+        // LU with partial pivoting on a copy
+        template <size_t N>
+        T determinant(std::integral_constant<size_t, N>) const
+        {
+            T a[N * N];
+            for (size_t i = 0; i < N * N; i++) {
+                a[i] = data[i];
+            }
+            T det = 1;
+            for (size_t k = 0; k < N; k++) {
+                size_t pivot = k;
+                for (size_t i = k + 1; i < N; i++) {
+                    if (fabs(a[i * N + k]) > fabs(a[pivot * N + k])) {
+                        pivot = i;
+                    }
+                }
+                if (a[pivot * N + k] == 0) {
+                    return (T)0;
+                }
+                if (pivot != k) {
+                    for (size_t j = k; j < N; j++) {
+                        T tmp = a[k * N + j];
+                        a[k * N + j] = a[pivot * N + j];
+                        a[pivot * N + j] = tmp;
+                    }
+                    det = -det;
+                }
+                det *= a[k * N + k];
+                for (size_t i = k + 1; i < N; i++) {
+                    T factor = a[i * N + k] / a[k * N + k];
+                    for (size_t j = k + 1; j < N; j++) {
+                        a[i * N + j] -= factor * a[k * N + j];
+                    }
+                }
+            }
+            return det;
+        }
+        
+        bool inverse(SmallMat &result, std::integral_constant<size_t, 1>) const
+        {
+            if (data[0] == 0) {
+                return false;
+            }
+            result.data[0] = (T)1 / data[0];
+            return true;
+        }
+        
+        bool inverse(SmallMat &result, std::integral_constant<size_t, 2>) const
+        {
+            T det = determinant();
+            if (det == 0) {
+                return false;
+            }
+            T a = data[0], b = data[1], c = data[2], d = data[3];
+            result.data[0] = d / det;
+            result.data[1] = -b / det;
+            result.data[2] = -c / det;
+            result.data[3] = a / det;
+            return true;
+        }
+        
+        bool inverse(SmallMat &result, std::integral_constant<size_t, 3>) const
+        {
+            T det = determinant();
+            if (det == 0) {
+                return false;
+            }
+            const T *a = data;
+            T cofactors[9] = {
+                a[4] * a[8] - a[5] * a[7], a[2] * a[7] - a[1] * a[8], a[1] * a[5] - a[2] * a[4],
+                a[5] * a[6] - a[3] * a[8], a[0] * a[8] - a[2] * a[6], a[2] * a[3] - a[0] * a[5],
+                a[3] * a[7] - a[4] * a[6], a[1] * a[6] - a[0] * a[7], a[0] * a[4] - a[1] * a[3]
+            };
+            for (size_t i = 0; i < 9; i++) {
+                result.data[i] = cofactors[i] / det;
+            }
+            return true;
+        }
+        
+        // Gauss-Jordan elimination with partial pivoting
+        template <size_t N>
+        bool inverse(SmallMat &result, std::integral_constant<size_t, N>) const
+        {
+            T a[N * N];
+            SmallMat inv = identity();
+            for (size_t i = 0; i < N * N; i++) {
+                a[i] = data[i];
+            }
+            for (size_t k = 0; k < N; k++) {
+                size_t pivot = k;
+                for (size_t i = k + 1; i < N; i++) {
+                    if (fabs(a[i * N + k]) > fabs(a[pivot * N + k])) {
+                        pivot = i;
+                    }
+                }
+                if (a[pivot * N + k] == 0) {
+                    return false;
+                }
+                if (pivot != k) {
+                    for (size_t j = 0; j < N; j++) {
+                        T tmp = a[k * N + j];
+                        a[k * N + j] = a[pivot * N + j];
+                        a[pivot * N + j] = tmp;
+                        tmp = inv.data[k * N + j];
+                        inv.data[k * N + j] = inv.data[pivot * N + j];
+                        inv.data[pivot * N + j] = tmp;
+                    }
+                }
+                T scale = (T)1 / a[k * N + k];
+                for (size_t j = 0; j < N; j++) {
+                    a[k * N + j] *= scale;
+                    inv.data[k * N + j] *= scale;
+                }
+                for (size_t i = 0; i < N; i++) {
+                    if (i == k) {
+                        continue;
+                    }
+                    T factor = a[i * N + k];
+                    for (size_t j = 0; j < N; j++) {
+                        a[i * N + j] -= factor * a[k * N + j];
+                        inv.data[i * N + j] -= factor * inv.data[k * N + j];
+                    }
+                }
+            }
+            result = inv;
+            return true;
+        }
+    };
+    
+    template <size_t R, size_t C, typename T>
+    constexpr size_t SmallMat<R, C, T>::rows;
+    template <size_t R, size_t C, typename T>
+    constexpr size_t SmallMat<R, C, T>::cols;
+    
+    // -------------------------------------------------------------------------
+    //  log density of x under N(mean, covariance) for D <= 8 values; false
+    //  when covariance is not positive definite
+    // -------------------------------------------------------------------------
+    template <size_t D, typename T>
+    inline bool gaussianLogDensity(const float *x, const float *mean, const SmallMat<D, D, T> &covariance, T &logDensity)
+    {
+        SmallMat<D, D, T> L;
+        if (!covariance.cholesky(L)) {
+            return false;
+        }
+        SmallMat<D, 1, T> centered;
+        for (size_t d = 0; d < D; d++) {
+            centered.data[d] = (T)x[d] - (T)mean[d];
+        }
+        SmallMat<D, 1, T> z = L.solveLower(centered);
+        T logDeterminant = 0;
+        for (size_t d = 0; d < D; d++) {
+            logDeterminant += 2 * log(L.data[d * D + d]);
+        }
+        logDensity = -0.5 * ((T)D * log(2.0 * M_PI) + logDeterminant + z.dot(z));
+        return true;
+    }
+    
+    // -------------------------------------------------------------------------
+    //  density of x (D values) under N(mean, covariance + shift), with shift
+    //  added to every element of the row-major D x D covariance, computed on
+    //  the stack in double; 0 when that is not positive definite
+    // -------------------------------------------------------------------------
+    template <size_t D>
+    inline double smallGaussianDensity(const float *x, const float *mean, const float *covariance, double shift = 0)
+    {
+        SmallMat<D, D, double> sigma(covariance);
+        sigma += shift;
+        double logDensity;
+        return gaussianLogDensity(x, mean, sigma, logDensity) ? exp(logDensity) : 0.0;
+    }
+    
+    // the same for a run-time D of at most SMALL_MAT_MAX_SIZE
+    inline double smallGaussianDensity(size_t D, const float *x, const float *mean, const float *covariance, double shift = 0)
+    {
+        switch (D) {
+            case 1: return smallGaussianDensity<1>(x, mean, covariance, shift);
+            case 2: return smallGaussianDensity<2>(x, mean, covariance, shift);
+            case 3: return smallGaussianDensity<3>(x, mean, covariance, shift);
+            case 4: return smallGaussianDensity<4>(x, mean, covariance, shift);
+            case 5: return smallGaussianDensity<5>(x, mean, covariance, shift);
+            case 6: return smallGaussianDensity<6>(x, mean, covariance, shift);
+            case 7: return smallGaussianDensity<7>(x, mean, covariance, shift);
+            case 8: return smallGaussianDensity<8>(x, mean, covariance, shift);
+            default:
+                printf("[ERROR]: pkm::smallGaussianDensity() %lu dimensions, at most %lu supported\n", D, SMALL_MAT_MAX_SIZE);
+                return 0.0;
+        }
+    }
+}
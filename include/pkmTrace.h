@@ -0,0 +1,508 @@
+// -----------------------------------------------------------------------------
+//  pkmTrace.h
+//  pkmMatrix
+//
+//  Copyright (c) 2015 Parag K Mital. All rights reserved.
+//
+/*
+Copyright (C) 2011 Parag K. Mital
+
+The Software is and remains the property of Parag K Mital
+("pkmital") The Licensee will ensure that the Copyright Notice set
+out above appears prominently wherever the Software is used.
+
+The Software is distributed under this Licence:
+
+- on a non-exclusive basis,
+
+- solely for non-commercial use in the hope that it will be useful,
+
+- "AS-IS" and in order for the benefit of its educational and research
+purposes, pkmital makes clear that no condition is made or to be
+implied, nor is any representation or warranty given or to be
+implied, as to (i) the quality, accuracy or reliability of the
+Software; (ii) the suitability of the Software for any particular
+use or for use under any specific conditions; and (iii) whether use
+of the Software will infringe third-party rights.
+
+pkmital disclaims:
+
+- all responsibility for the use which is made of the Software; and
+
+- any liability for the outcomes arising from using the Software.
+
+The Licensee may make public, results or data obtained from, dependent
+on or arising out of the use of the Software provided that any such
+publication includes a prominent statement identifying the Software as
+the source of the results or the data, including the Copyright Notice
+and stating that the Software has been made available for use by the
+Licensee under licence from pkmital and the Licensee provides a copy of
+any such publication to pkmital.
+
+The Licensee agrees to indemnify pkmital and hold them
+harmless from and against any and all claims, damages and liabilities
+asserted by third parties (including claims for negligence) which
+arise directly or indirectly from the use of the Software or any
+derivative of it or the sale of any products based on the
+Software. The Licensee undertakes to make no liability claim against
+any employee, student, agent or appointee of pkmital, in connection
+with this Licence or the Software.
+
+
+No part of the Software may be reproduced, modified, transmitted or
+transferred in any form or by any means, electronic or mechanical,
+without the express permission of pkmital. pkmital's permission is not
+required if the said reproduction, modification, transmission or
+transference is done without financial return, the conditions of this
+Licence are imposed upon the receiver of the product, and all original
+and amended source code is included in any transmitted product. You
+may be held legally responsible for any copyright infringement that is
+caused or encouraged by your failure to abide by these terms and
+conditions.
+
+You are not permitted under this Licence to use this Software
+commercially. Use for which any financial return is received shall be
+defined as commercial use, and includes (1) integration of all or part
+of the source code or the Software into a product for sale or license
+by or on behalf of Licensee to third parties or (2) use of the
+Software or any derivative of it for research with the final aim of
+developing software products for sale or license to a third party or
+(3) use of the Software or any derivative of it for research with the
+final aim of developing non-software products for sale or license to a
+third party, or (4) use of the Software to provide any service to an
+external organisation for which payment is received. If you are
+interested in using the Software commercially, please contact pkmital to
+negotiate a licence. Contact details are: parag@pkmital.com
+*/
+
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+// -----------------------------------------------------------------------------
+//  Opt-in timeline tracing, exported as Chrome trace JSON (chrome://tracing
+//  or https://ui.perfetto.dev).
+//
+//  Compiled in with -DPKM_TRACE for every translation unit.  Each
+//  PKM_INSTRUMENT_LABEL scope (the pkmDTW, pkmGVF and pkmMedianFilter
+//  stages) then becomes a "stage" span and each PKM_INSTRUMENT_OP scope (the
+//  Mat kernels) a "kernel" span, whether or not PKM_INSTRUMENT is defined
+//  as well.  Spans are only recorded between start() and stop():
+//
+//      pkm::trace::start(pkm::trace::CATEGORY_ALL, true);
+//      ...
+//      pkm::trace::stop();
+//      pkm::trace::writeChromeTrace("trace.json");
+//
+//  Each thread keeps the most recent setBufferSize() spans, so a live
+//  pipeline can be traced indefinitely and written out after a spike.  On
+//  Linux, start() can also read the cycles, instructions and last level
+//  cache misses of the calling thread at either end of every span (user
+//  space only, through perf_event_open(2)); the deltas appear in each
+//  span's arguments along with its IPC.  Where the counters are not
+//  available (other systems, or perf_event_paranoid > 2) spans are
+//  recorded without them.
+// -----------------------------------------------------------------------------
+
+#define PKM_TRACE_CONCAT_(a, b) a##b
+#define PKM_TRACE_CONCAT(a, b) PKM_TRACE_CONCAT_(a, b)
+
+#ifdef PKM_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace pkm
+{
+    namespace trace
+    {
+        enum Category
+        {
+            CATEGORY_STAGE  = 1,
+            CATEGORY_KERNEL = 2,
+            CATEGORY_ALL    = 3
+        };
+        
+        enum HardwareCounter
+        {
+            COUNTER_CYCLES = 0,
+            COUNTER_INSTRUCTIONS,
+            COUNTER_CACHE_MISSES,
+            NUM_COUNTERS
+        };
+        
+        // one completed span; 'name' is a string literal
+        struct Span
+        {
+            const char *name;
+            int category;
+            uint64_t start, duration;   // ns since the trace epoch
+            uint64_t counters[NUM_COUNTERS];
+            bool bCounters;
+        };
+        
+        // -------------------------------------------------------------------------
+        //  the cycles, instructions and LLC misses of the calling thread, as
+        //  one perf_event group so that the three are read together
+        // -------------------------------------------------------------------------
+        class HardwareCounters
+        {
+        public:
+            HardwareCounters() : leader(-1)
+            {
+                std::fill(fds, fds + NUM_COUNTERS, -1);
+            }
+            
+            ~HardwareCounters()
+            {
+                close();
+            }
+            
+            bool open()
+            {
+#ifdef __linux__
+                if (leader >= 0) {
+                    return true;
+                }
+                const uint64_t configs[NUM_COUNTERS] = {
+                    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+                };
+                for (int i = 0; i < NUM_COUNTERS; i++) {
+                    struct perf_event_attr attr;
+                    memset(&attr, 0, sizeof(attr));
+                    attr.type = PERF_TYPE_HARDWARE;
+                    attr.size = sizeof(attr);
+                    attr.config = configs[i];
+                    attr.read_format = PERF_FORMAT_GROUP;
+                    attr.exclude_kernel = 1;
+                    attr.exclude_hv = 1;
+                    fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : leader, 0);
+                    if (fds[i] < 0) {
+                        close();
+                        return false;
+                    }
+                    if (i == 0) {
+                        leader = fds[0];
+                    }
+                }
+                return true;
+#else
+                return false;
+#endif
+            }
+            
+            bool read(uint64_t *values) const
+            {
+#ifdef __linux__
+                // PERF_FORMAT_GROUP: the number of events, then their values
+                uint64_t buffer[1 + NUM_COUNTERS];
+                if (leader < 0 || ::read(leader, buffer, sizeof(buffer)) != (ssize_t)sizeof(buffer)) {
+                    return false;
+                }
+                memcpy(values, buffer + 1, sizeof(uint64_t) * NUM_COUNTERS);
+                return true;
+#else
+                return false;
+#endif
+            }
+            
+            bool isOpen() const
+            {
+                return leader >= 0;
+            }
+            
+        private:
+            void close()
+            {
+#ifdef __linux__
+                for (int i = NUM_COUNTERS - 1; i >= 0; i--) {
+                    if (fds[i] >= 0) {
+                        ::close(fds[i]);
+                    }
+                    fds[i] = -1;
+                }
+#endif
+                leader = -1;
+            }
+            
+            int leader;
+            int fds[NUM_COUNTERS];
+        };
+        
+        // -------------------------------------------------------------------------
+        //  a ring of a thread's most recent spans; the lock is only ever
+        //  contended by writeChromeTrace() and clear()
+        // -------------------------------------------------------------------------
+        struct ThreadBuffer
+        {
+            ThreadBuffer(int tid, size_t capacity)
+            : tid(tid), next(0), dropped(0), spans(capacity)
+            {
+            }
+            
+            void push(const Span &span)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (spans.empty()) {
+                    dropped++;
+                    return;
+                }
+                if (next >= spans.size()) {
+                    dropped++;
+                }
+                spans[next % spans.size()] = span;
+                next++;
+            }
+            
+            int tid;
+            size_t next, dropped;
+            std::vector<Span> spans;
+            std::mutex mutex;
+        };
+        
+        // -------------------------------------------------------------------------
+        //  the recording state and every thread's buffer, including those of
+        //  threads that have exited
+        // -------------------------------------------------------------------------
+        class Registry
+        {
+        public:
+            static Registry & get()
+            {
+                static Registry registry;
+                return registry;
+            }
+            
+            ThreadBuffer * createBuffer()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                buffers.push_back(new ThreadBuffer((int)buffers.size() + 1, bufferSize));
+                return buffers.back();
+            }
+            
+            uint64_t now() const
+            {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+            }
+            
+            std::atomic<int> categories;
+            std::atomic<bool> bHardwareCounters;
+            std::atomic<int> generation;    // bumped by each start()
+            std::mutex mutex;
+            // never freed, as threads may still record after main() returns
+            std::vector<ThreadBuffer *> buffers;
+            size_t bufferSize;
+            
+        private:
+            Registry() : categories(0), bHardwareCounters(false), generation(0), bufferSize(1 << 16),
+            epoch(std::chrono::steady_clock::now())
+            {
+            }
+            
+            std::chrono::steady_clock::time_point epoch;
+        };
+        
+        // the calling thread's buffer and perf_event group
+        class ThreadState
+        {
+        public:
+            static ThreadState & get()
+            {
+                static thread_local ThreadState state;
+                return state;
+            }
+            
+            // whether this thread should read counters, opening them the
+            // first time it is asked to after each start()
+            bool useCounters()
+            {
+                Registry &registry = Registry::get();
+                if (!registry.bHardwareCounters.load(std::memory_order_relaxed)) {
+                    return false;
+                }
+                int current = registry.generation.load(std::memory_order_relaxed);
+                if (generation != current) {
+                    generation = current;
+                    if (!counters.open()) {
+                        static std::atomic<bool> bWarned(false);
+                        if (!bWarned.exchange(true)) {
+                            printf("[WARNING]: pkm::trace hardware counters are unavailable, spans will be recorded without them\n");
+                        }
+                    }
+                }
+                return counters.isOpen();
+            }
+            
+            ThreadBuffer *buffer;
+            HardwareCounters counters;
+            
+        private:
+            ThreadState() : buffer(Registry::get().createBuffer()), generation(-1)
+            {
+            }
+            
+            int generation;
+        };
+        
+        inline bool isRecording(int category)
+        {
+            return (Registry::get().categories.load(std::memory_order_relaxed) & category) != 0;
+        }
+        
+        // -------------------------------------------------------------------------
+        //  records the enclosing scope as a span while recording
+        // -------------------------------------------------------------------------
+        class ScopedSpan
+        {
+        public:
+            ScopedSpan(const char *name, int category)
+            : bActive(isRecording(category))
+            {
+                if (!bActive) {
+                    return;
+                }
+                span.name = name;
+                span.category = category;
+                ThreadState &state = ThreadState::get();
+                span.bCounters = state.useCounters() && state.counters.read(span.counters);
+                span.start = Registry::get().now();
+            }
+            
+            ~ScopedSpan()
+            {
+                if (!bActive) {
+                    return;
+                }
+                span.duration = Registry::get().now() - span.start;
+                ThreadState &state = ThreadState::get();
+                uint64_t end[NUM_COUNTERS];
+                if (span.bCounters && state.counters.read(end)) {
+                    for (int i = 0; i < NUM_COUNTERS; i++) {
+                        span.counters[i] = end[i] - span.counters[i];
+                    }
+                }
+                else {
+                    span.bCounters = false;
+                }
+                state.buffer->push(span);
+            }
+            
+        private:
+            bool bActive;
+            Span span;
+        };
+        
+        // -------------------------------------------------------------------------
+        //  recording control
+        // -------------------------------------------------------------------------
+        
+        // spans kept per thread; applies to threads that record their first
+        // span afterwards
+        inline void setBufferSize(size_t spansPerThread)
+        {
+            Registry &registry = Registry::get();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.bufferSize = spansPerThread;
+        }
+        
+        inline void start(int categories = CATEGORY_ALL, bool bHardwareCounters = false)
+        {
+            Registry &registry = Registry::get();
+            registry.bHardwareCounters.store(bHardwareCounters, std::memory_order_relaxed);
+            registry.generation.fetch_add(1, std::memory_order_relaxed);
+            registry.categories.store(categories, std::memory_order_relaxed);
+        }
+        
+        inline void stop()
+        {
+            Registry::get().categories.store(0, std::memory_order_relaxed);
+        }
+        
+        // forget every recorded span
+        inline void clear()
+        {
+            Registry &registry = Registry::get();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            for (size_t i = 0; i < registry.buffers.size(); i++) {
+                std::lock_guard<std::mutex> bufferLock(registry.buffers[i]->mutex);
+                registry.buffers[i]->next = 0;
+                registry.buffers[i]->dropped = 0;
+            }
+        }
+        
+        // -------------------------------------------------------------------------
+        //  every thread's spans as complete ("X") events, times in microseconds
+        // -------------------------------------------------------------------------
+        inline bool writeChromeTrace(const char *filename)
+        {
+            FILE *fp = fopen(filename, "w");
+            if (fp == NULL) {
+                printf("[ERROR]: pkm::trace::writeChromeTrace() could not open %s\n", filename);
+                return false;
+            }
+            
+            const char *counterNames[NUM_COUNTERS] = { "cycles", "instructions", "llc_misses" };
+            Registry &registry = Registry::get();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            size_t dropped = 0;
+            bool bFirst = true;
+            fprintf(fp, "{\"traceEvents\":[\n");
+            for (size_t b = 0; b < registry.buffers.size(); b++) {
+                ThreadBuffer &buffer = *registry.buffers[b];
+                std::lock_guard<std::mutex> bufferLock(buffer.mutex);
+                dropped += buffer.dropped;
+                size_t count = std::min(buffer.next, buffer.spans.size());
+                if (count == 0) {
+                    continue;
+                }
+                fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                        bFirst ? "" : ",\n", buffer.tid, buffer.tid);
+                bFirst = false;
+                
+                // oldest first
+                size_t first = buffer.next - count;
+                for (size_t i = 0; i < count; i++) {
+                    const Span &span = buffer.spans[(first + i) % buffer.spans.size()];
+                    fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                            span.name, span.category == CATEGORY_STAGE ? "stage" : "kernel", buffer.tid,
+                            span.start * 1e-3, span.duration * 1e-3);
+                    if (span.bCounters) {
+                        fprintf(fp, ",\"args\":{");
+                        for (int c = 0; c < NUM_COUNTERS; c++) {
+                            fprintf(fp, "\"%s\":%llu,", counterNames[c], (unsigned long long)span.counters[c]);
+                        }
+                        fprintf(fp, "\"ipc\":%.3f}", span.counters[COUNTER_CYCLES] ?
+                                (double)span.counters[COUNTER_INSTRUCTIONS] / span.counters[COUNTER_CYCLES] : 0.0);
+                    }
+                    fprintf(fp, "}");
+                }
+            }
+            fprintf(fp, "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped_spans\":%lu}}\n", (unsigned long)dropped);
+            fclose(fp);
+            return true;
+        }
+    }
+}
+
+// records the rest of the enclosing scope as a span named 'name' (a string
+// literal) of the given Category
+#define PKM_TRACE_SPAN(name, category) \
+    pkm::trace::ScopedSpan PKM_TRACE_CONCAT(pkmTraceSpan, __LINE__)(name, category)
+
+#else
+
+#define PKM_TRACE_SPAN(name, category)
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ *  benchmarkApproximateNearestNeighbors.cpp
+ *  
+ 
+ recall and query latency of the IVF+PQ index pkmApproximateNearestNeighbors
+ for a range of probes, against exact search with pkmNearestNeighbors, on a
+ 200k x 64 database of clustered data of intrinsic dimension 16
+ 
+ Copyright (C) 2015 Parag K. Mital
+ 
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ *
+ */
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "pkmMatrix.h"
+#include "pkmNearestNeighbors.h"
+#include "pkmApproximateNearestNeighbors.h"
+
+using namespace std;
+
+static const size_t numRows = 200000;
+static const size_t numDimensions = 64;
+static const size_t numQueries = 500;
+static const size_t numClusters = 1000;
+static const size_t latentDimensions = 16;
+static const size_t k = 10;
+
+// keeps the compiler from discarding the results of the queries
+static volatile size_t sink;
+
+// rows on a random 16 dimensional subspace plus a little noise, around
+// 'numClusters' centers, so that neighbours are not all equally far
+static void makeData(Mat &database, Mat &queries, mt19937 &rng)
+{
+    normal_distribution<float> gaussian;
+    Mat centers(numClusters, latentDimensions), projection(latentDimensions, numDimensions);
+    for (size_t i = 0; i < centers.rows * centers.cols; i++) {
+        centers.data[i] = gaussian(rng) * 4.0f;
+    }
+    for (size_t i = 0; i < projection.rows * projection.cols; i++) {
+        projection.data[i] = gaussian(rng) / sqrtf((float)latentDimensions);
+    }
+    
+    database = Mat(numRows, numDimensions);
+    queries = Mat(numQueries, numDimensions);
+    Mat *targets[2] = {&database, &queries};
+    vector<float> z(latentDimensions);
+    for (int t = 0; t < 2; t++) {
+        Mat &m = *targets[t];
+        for (size_t i = 0; i < m.rows; i++) {
+            size_t c = rng() % centers.rows;
+            for (size_t l = 0; l < latentDimensions; l++) {
+                z[l] = centers.data[c * latentDimensions + l] + gaussian(rng);
+            }
+            for (size_t d = 0; d < numDimensions; d++) {
+                float x = 0.1f * gaussian(rng);
+                for (size_t l = 0; l < latentDimensions; l++) {
+                    x += z[l] * projection.data[l * numDimensions + d];
+                }
+                m.data[i * numDimensions + d] = x;
+            }
+        }
+    }
+}
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// fraction of the exact k nearest found in the approximate k nearest
+static double recall(const vector<size_t> &exact, const vector<size_t> &approximate, size_t n)
+{
+    size_t found = 0;
+    for (size_t q = 0; q < numQueries; q++) {
+        for (size_t i = 0; i < n; i++) {
+            const size_t *begin = &approximate[q * k], *end = begin + n;
+            found += std::find(begin, end, exact[q * k + i]) != end;
+        }
+    }
+    return (double)found / (double)(numQueries * n);
+}
+
+
+int main (int argc, char * const argv[]) {
+    mt19937 rng(1);
+    Mat database, queries;
+    makeData(database, queries, rng);
+    printf("%lu x %lu (%lu clusters), %lu queries, k = %lu\n", numRows, numDimensions, numClusters, numQueries, k);
+    
+    // exact neighbours
+    pkmNearestNeighbors exact;
+    exact.build(database, pkmNearestNeighbors::DISTANCE_L2, pkmNearestNeighbors::INDEX_BRUTE_FORCE);
+    vector<size_t> truth(numQueries * k), indices;
+    vector<float> distances;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t q = 0; q < numQueries; q++) {
+        exact.knn(queries.data + q * numDimensions, k, indices, distances);
+        std::copy(indices.begin(), indices.end(), truth.begin() + q * k);
+    }
+    double exactLatency = seconds(start) / numQueries * 1e6;
+    printf("%-28s %10.1f us/query, %6.1f MB\n", "exact (brute force)", exactLatency,
+           numRows * numDimensions * sizeof(float) / 1048576.0);
+    
+    const size_t subquantizers[] = {8, 16};
+    for (size_t s = 0; s < 2; s++)
+    {
+        pkmApproximateNearestNeighbors index;
+        start = std::chrono::steady_clock::now();
+        index.build(database, 1024, subquantizers[s]);
+        printf("\nIVF1024,PQ%lu: build %.2fs, %6.1f MB\n", subquantizers[s], seconds(start),
+               numRows * index.getCodeSize() / 1048576.0);
+        
+        vector<size_t> approximate(numQueries * k, (size_t)-1);
+        for (size_t probes = 1; probes <= 64; probes *= 2)
+        {
+            index.setNumProbes(probes);
+            start = std::chrono::steady_clock::now();
+            for (size_t q = 0; q < numQueries; q++) {
+                index.knn(queries.data + q * numDimensions, k, indices, distances);
+                std::copy(indices.begin(), indices.end(), approximate.begin() + q * k);
+                sink = indices.size();
+            }
+            double t = seconds(start) / numQueries * 1e6;
+            printf("nprobe = %-3lu %15.1f us/query (%5.1fx)  recall@1 %.3f  recall@%lu %.3f\n",
+                   probes, t, exactLatency / t, recall(truth, approximate, 1), k, recall(truth, approximate, k));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,224 @@
+/*
+ *  benchmarkLinearAlgebra.cpp
+ *  
+ 
+ repeated same-shape calls to Mat::svd, Mat::inv and Mat::solve, against the
+ previous implementations that queried LAPACK for the work size and allocated
+ their workspaces on every call, and the time and accuracy of the top 20
+ components from the full, truncated and randomized svd of an n x 512
+ feature matrix (n = 4000, or the first argument)
+ 
+ Copyright (C) 2015 Parag K. Mital
+ 
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ *
+ */
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <random>
+#include "pkmMatrix.h"
+
+using namespace std;
+using namespace pkm;
+
+// keeps the compiler from discarding the results
+static volatile float sink;
+
+// the previous svd: destroys its input, queries the work size and allocates
+// U, V_t and the workspaces on every call (the workspaces were stack arrays,
+// heap vectors here so that large shapes do not overflow the stack)
+static long svdReference(Mat &A, Mat &U, Mat &S, Mat &V_t)
+{
+    __CLPK_integer m = A.rows, n = A.cols, lda = m, ldu = m, ldv = n;
+    size_t nSVs = m > n ? n : m;
+    U.reset(m, m);
+    V_t.reset(n, n);
+    S.reset(1, nSVs);
+    float workSize;
+    __CLPK_integer lwork = -1, info = 0;
+    vector<__CLPK_integer> iwork(8*nSVs);
+    char job = 'A';
+    sgesdd_(&job, &m, &n, A.data, &lda, S.data, U.data, &ldu, V_t.data, &ldv, &workSize, &lwork, &iwork[0], &info);
+    lwork = (long)workSize;
+    vector<float> work(lwork);
+    sgesdd_(&job, &m, &n, A.data, &lda, S.data, U.data, &ldu, V_t.data, &ldv, &work[0], &lwork, &iwork[0], &info);
+    return info;
+}
+
+// microseconds per call
+template <typename Call>
+static double latency(Call c, size_t n)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        c();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count() / (double)n * 1e6;
+}
+
+static Mat randomMatrix(size_t rows, size_t cols, mt19937 &rng)
+{
+    normal_distribution<float> gaussian;
+    Mat m(rows, cols);
+    for (size_t i = 0; i < rows * cols; i++) {
+        m.data[i] = gaussian(rng);
+    }
+    return m;
+}
+
+// n x d features with a decaying spectrum: 64 latent factors with weights
+// 1 / (1 + i) plus a little noise
+static Mat featureMatrix(size_t n, size_t d, mt19937 &rng)
+{
+    const size_t latent = 64;
+    normal_distribution<float> gaussian;
+    Mat factors = randomMatrix(n, latent, rng), loadings = randomMatrix(latent, d, rng), features(n, d);
+    for (size_t i = 0; i < latent; i++) {
+        cblas_sscal(d, 1.0f / (1.0f + i), loadings.data + i * d, 1);
+    }
+    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, n, d, latent, 1.0f, factors.data, latent,
+                loadings.data, d, 0.0f, features.data, d);
+    for (size_t i = 0; i < n * d; i++) {
+        features.data[i] += 0.01f * gaussian(rng);
+    }
+    return features;
+}
+
+// relative Frobenius error of the rank k reconstruction U S V_t
+static double reconstructionError(const Mat &A, const Mat &U, const Mat &S, const Mat &V_t)
+{
+    size_t k = S.cols;
+    Mat US(A.rows, k), R(A.rows, A.cols);
+    for (size_t i = 0; i < A.rows; i++) {
+        for (size_t c = 0; c < k; c++) {
+            US.data[i * k + c] = U.data[i * U.cols + c] * S.data[c];
+        }
+    }
+    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, A.rows, A.cols, k, 1.0f, US.data, k,
+                V_t.data, A.cols, 0.0f, R.data, A.cols);
+    double error = 0, norm = 0;
+    for (size_t i = 0; i < A.rows * A.cols; i++) {
+        error += (A.data[i] - R.data[i]) * (double)(A.data[i] - R.data[i]);
+        norm += A.data[i] * (double)A.data[i];
+    }
+    return sqrt(error / norm);
+}
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// top 20 components of an n x 512 matrix
+static void topComponents(size_t n, mt19937 &rng)
+{
+    const size_t d = 512, k = 20;
+    Mat A = featureMatrix(n, d, rng), U, S, V_t, reference;
+    printf("\ntop %lu components of %lu x %lu\n", k, n, d);
+    printf("%-26s %10s %16s %16s\n", "", "time", "max |dS| / S0", "rank-k error");
+    
+    // the full decomposition needs an n x n U
+    auto start = std::chrono::steady_clock::now();
+    bool bFull = n <= 10000;
+    if (bFull) {
+        A.svd(U, reference, V_t);
+        printf("%-26s %9.2fs\n", "svd (full U, V_t)", seconds(start));
+    }
+    
+    for (int method = 0; method < 4; method++)
+    {
+        start = std::chrono::steady_clock::now();
+        if (method == 0) {
+            A.svdTruncated(U, S, V_t, k);
+        }
+        else {
+            A.svdRandomized(U, S, V_t, k, method - 1);
+        }
+        double t = seconds(start);
+        
+        if (!bFull && method == 0) {
+            reference = S;
+        }
+        double valueError = 0;
+        for (size_t i = 0; i < k; i++) {
+            valueError = std::max(valueError, (double)fabs(S.data[i] - reference.data[i]) / reference.data[0]);
+        }
+        char name[64];
+        if (method == 0) {
+            snprintf(name, sizeof(name), "svdTruncated");
+        }
+        else {
+            snprintf(name, sizeof(name), "svdRandomized (q = %d)", method - 1);
+        }
+        printf("%-26s %9.2fs %16.2e %16.4f\n", name, t, valueError, reconstructionError(A, U, S, V_t));
+    }
+}
+
+int main (int argc, char * const argv[]) {
+    mt19937 rng(1);
+    const size_t shapes[][2] = {{8, 8}, {32, 32}, {128, 16}, {128, 128}};
+    
+    printf("%-12s %-10s %14s %14s\n", "routine", "shape", "previous", "current");
+    for (size_t s = 0; s < 4; s++)
+    {
+        size_t r = shapes[s][0], c = shapes[s][1];
+        size_t n = r * c < 1000 ? 2000 : 200;
+        Mat A = randomMatrix(r, c, rng), scratch(r, c), U, S, V_t;
+        
+        double previous = latency([&]() {
+            cblas_scopy(r * c, A.data, 1, scratch.data, 1);
+            svdReference(scratch, U, S, V_t);
+            sink = S.data[0];
+        }, n);
+        double current = latency([&]() {
+            A.svd(U, S, V_t);
+            sink = S.data[0];
+        }, n);
+        printf("%-12s %4lux%-5lu %11.1f us %11.1f us  (%.2fx)\n", "svd", r, c, previous, current, previous / current);
+    }
+    
+    for (size_t d = 8; d <= 128; d *= 4)
+    {
+        Mat A = randomMatrix(d, d, rng), B = randomMatrix(d, 1, rng), X;
+        for (size_t i = 0; i < d; i++) {
+            A.data[i * d + i] += (float)d;
+        }
+        size_t n = d < 64 ? 5000 : 500;
+        
+        double inverse = latency([&]() {
+            X = A.getInv();
+            sink = X.data[0];
+        }, n);
+        printf("%-12s %4lux%-5lu %29.1f us\n", "getInv", d, d, inverse);
+        
+        double viaInverse = latency([&]() {
+            Mat Ainv = A.getInv();
+            X = Mat(d, 1, true);
+            cblas_sgemv(CblasRowMajor, CblasNoTrans, d, d, 1.0f, Ainv.data, d, B.data, 1, 0.0f, X.data, 1);
+            sink = X.data[0];
+        }, n);
+        double solve = latency([&]() {
+            A.solve(B, X);
+            sink = X.data[0];
+        }, n);
+        printf("%-12s %4lux%-5lu %11.1f us %11.1f us  (%.2fx, previous = getInv * b)\n", "solve", d, d, viaInverse, solve, viaInverse / solve);
+    }
+    
+    topComponents(argc > 1 ? atoi(argv[1]) : 4000, rng);
+    return 0;
+}
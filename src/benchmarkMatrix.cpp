@@ -0,0 +1,192 @@
+/*
+ *  benchmarkMatrix.cpp
+ *
+
+ time and throughput of the pkm::Mat primitives over a grid of shapes:
+ element-wise arithmetic, unary math, reductions, row normalizations,
+ transposes, GEMM, push_back, save/load, svd, inv and interpolation.
+ See pkmBenchmark.h for the options; e.g.
+
+     benchmarkMatrix --json current.json --baseline previous.json
+
+ Copyright (C) 2015 Parag K. Mital
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *
+ */
+
+#include <random>
+#include <unistd.h>
+#include "pkmMatrix.h"
+#include "pkmParallel.h"
+#include "pkmBenchmark.h"
+
+using namespace std;
+using namespace pkm;
+
+static Mat uniformMatrix(size_t rows, size_t cols, float low, float high, mt19937 &rng)
+{
+    uniform_real_distribution<float> uniform(low, high);
+    Mat m(rows, cols);
+    for (size_t i = 0; i < rows * cols; i++) {
+        m.data[i] = uniform(rng);
+    }
+    return m;
+}
+
+static string shapeName(size_t r, size_t c)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%lux%lu", r, c);
+    return name;
+}
+
+static string shapeName(size_t m, size_t k, size_t n)
+{
+    char name[48];
+    snprintf(name, sizeof(name), "%lux%lux%lu", m, k, n);
+    return name;
+}
+
+// element-wise, unary, reduction, normalization and transpose kernels
+static void elementwise(pkmBenchmark &bench, size_t r, size_t c, mt19937 &rng)
+{
+    const string shape = shapeName(r, c);
+    const double n = (double)(r * c), bytes = 4.0 * n;
+    Mat A = uniformMatrix(r, c, 0.5f, 2.0f, rng), B = uniformMatrix(r, c, 0.5f, 2.0f, rng), C(r, c), X(r, c);
+
+    // binary element-wise ops read two matrices and write a third
+    bench.run("add", shape, 3 * bytes, n, [&]() { A.add(B, C); });
+    bench.run("subtract", shape, 3 * bytes, n, [&]() { A.subtract(B, C); });
+    bench.run("multiply", shape, 3 * bytes, n, [&]() { A.multiply(B, C); });
+    bench.run("divide", shape, 3 * bytes, n, [&]() { A.divide(B, C); });
+    bench.run("multiply scalar", shape, 2 * bytes, n, [&]() { A.multiply(1.5f, C); });
+
+    // unary math is in place, so each call starts from a fresh copy of A
+    auto fresh = [&]() { cblas_scopy(r * c, A.data, 1, X.data, 1); };
+    bench.run("sqr", shape, 2 * bytes, n, fresh, [&]() { X.sqr(); });
+    bench.run("sqrt", shape, 2 * bytes, n, fresh, [&]() { X.sqrt(); });
+    bench.run("abs", shape, 2 * bytes, n, fresh, [&]() { X.abs(); });
+    bench.run("exp", shape, 2 * bytes, n, fresh, [&]() { X.exp(); });
+    bench.run("log", shape, 2 * bytes, n, fresh, [&]() { X.log(); });
+    bench.run("sin", shape, 2 * bytes, n, fresh, [&]() { X.sin(); });
+    bench.run("pow", shape, 2 * bytes, n, fresh, [&]() { X.pow(2.5f); });
+
+    // reductions read once and write one value per row or column
+    bench.run("sumAll", shape, bytes, n, [&]() { sink = Mat::sum(A); });
+    bench.run("sum rows", shape, bytes, n, [&]() { sink = A.sum(true).data[0]; });
+    bench.run("sum cols", shape, bytes, n, [&]() { sink = A.sum(false).data[0]; });
+    bench.run("mean", shape, bytes, n, [&]() { sink = A.mean(true).data[0]; });
+    bench.run("var", shape, bytes, 3 * n, [&]() { sink = A.var(true).data[0]; });
+    bench.run("max", shape, bytes, n, [&]() { float v; unsigned long i; A.max(v, i); sink = v; });
+
+    // row normalizations read twice (statistics, then update) and write once
+    bench.run("setNormalize", shape, 3 * bytes, 4 * n, fresh, [&]() { X.setNormalize(true); });
+    bench.run("divideEachVecBySum", shape, 3 * bytes, 2 * n, fresh, [&]() { X.divideEachVecBySum(true); });
+
+    bench.run("getTranspose", shape, 2 * bytes, 0, [&]() { sink = A.getTranspose().data[0]; });
+    bench.run("setTranspose", shape, 2 * bytes, 0, [&]() { fresh(); X.rows = r; X.cols = c; }, [&]() { X.setTranspose(); });
+
+    // interpolation to twice the rows
+    Mat Y;
+    bench.run("rescale", shape, 3 * bytes, 6 * n, [&]() { A.rescale(2 * r, c, Y); });
+}
+
+// m x k times k x n
+static void gemm(pkmBenchmark &bench, size_t m, size_t k, size_t n, mt19937 &rng)
+{
+    Mat A = uniformMatrix(m, k, -1.0f, 1.0f, rng), B = uniformMatrix(k, n, -1.0f, 1.0f, rng), C(m, n);
+    bench.run("GEMM", shapeName(m, k, n), 4.0 * (m * k + k * n + m * n), 2.0 * m * k * n, [&]() { A.GEMM(B, C); });
+}
+
+// appending r rows of c values, with and without reserving the capacity
+static void appending(pkmBenchmark &bench, size_t r, size_t c)
+{
+    const string shape = shapeName(r, c);
+    vector<float> frame(c, 1.0f);
+    bench.run("push_back", shape, 4.0 * r * c, 0, [&]() {
+        Mat database;
+        for (size_t i = 0; i < r; i++) {
+            database.push_back(frame);
+        }
+        sink = database.data[0];
+    });
+    bench.run("push_back reserved", shape, 4.0 * r * c, 0, [&]() {
+        Mat database;
+        database.reserve(r, c);
+        for (size_t i = 0; i < r; i++) {
+            database.push_back(&frame[0], c);
+        }
+        sink = database.data[0];
+    });
+}
+
+// the text format of save() and load(); bytes are those of the matrix
+static void serialization(pkmBenchmark &bench, size_t r, size_t c, mt19937 &rng)
+{
+    const string shape = shapeName(r, c);
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/tmp/benchmarkMatrix.%d.txt", (int)getpid());
+    Mat A = uniformMatrix(r, c, -1.0f, 1.0f, rng), B;
+    bench.run("save", shape, 4.0 * r * c, 0, [&]() { A.save(filename); });
+    bench.run("load", shape, 4.0 * r * c, 0, [&]() { B.load(filename); sink = B.data[0]; });
+    remove(filename);
+}
+
+// n x n decompositions; FLOPs are the usual dense estimates
+static void decompositions(pkmBenchmark &bench, size_t n, mt19937 &rng)
+{
+    const string shape = shapeName(n, n);
+    Mat A = uniformMatrix(n, n, -1.0f, 1.0f, rng), U, S, V_t, X;
+    for (size_t i = 0; i < n; i++) {
+        A.data[i * n + i] += (float)n;
+    }
+    const double n3 = (double)n * n * n;
+    // reading A and writing U, S and V_t
+    bench.run("svd", shape, 4.0 * (3 * n * n + n), 21.0 * n3, [&]() { A.svd(U, S, V_t); sink = S.data[0]; });
+    bench.run("getInv", shape, 8.0 * n * n, 2.0 * n3, [&]() { X = A.getInv(); sink = X.data[0]; });
+}
+
+int main (int argc, char * const argv[]) {
+    pkmBenchmark bench(argc, argv);
+    char threads[32];
+    snprintf(threads, sizeof(threads), "%lu", getNumThreads());
+    bench.setContext("threads", threads);
+    mt19937 rng(1);
+
+    // small and cache resident, square, the 10000 x 500 of main.cpp, and a
+    // tall, narrow feature database
+    const size_t shapes[][2] = {{64, 64}, {512, 512}, {10000, 500}, {100000, 16}};
+    for (size_t s = 0; s < 4; s++) {
+        elementwise(bench, shapes[s][0], shapes[s][1], rng);
+    }
+
+    const size_t products[][3] = {{64, 64, 64}, {256, 256, 256}, {1024, 1024, 1024}, {10000, 500, 64}, {100000, 16, 16}};
+    for (size_t s = 0; s < 5; s++) {
+        gemm(bench, products[s][0], products[s][1], products[s][2], rng);
+    }
+
+    appending(bench, 1000, 16);
+    appending(bench, 100000, 16);
+    appending(bench, 10000, 500);
+
+    serialization(bench, 64, 64, rng);
+    serialization(bench, 512, 512, rng);
+
+    for (size_t n = 32; n <= 512; n *= 4) {
+        decompositions(bench, n, rng);
+    }
+    return 0;
+}
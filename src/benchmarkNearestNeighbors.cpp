@@ -0,0 +1,145 @@
+/*
+ *  benchmarkNearestNeighbors.cpp
+ *  
+ 
+ query latency of pkmNearestNeighbors (brute force, KD-tree, VP-tree) and of
+ the allocating linear scan getIndexOfClosestRowL2 used to do, on a
+ 100k x 64 database of clustered and of uniform data
+ 
+ Copyright (C) 2015 Parag K. Mital
+ 
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ *
+ */
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <random>
+#include "pkmMatrix.h"
+#include "pkmNearestNeighbors.h"
+
+using namespace std;
+
+static const size_t numRows = 100000;
+static const size_t numDimensions = 64;
+static const size_t numQueries = 200;
+
+// keeps the compiler from discarding the results of inlined scans
+static volatile size_t sink;
+
+
+// the previous implementation: a view, a subtraction and two allocating
+// sums per row
+static void closestRowL2Reference(Mat &database, const Mat &row_vector, float &best_sum, size_t &best_idx)
+{
+    best_sum = HUGE_VALF;
+    best_idx = 0;
+    Mat sub(1, database.cols);
+    for (size_t i = 0; i < database.rows; i++)
+    {
+        database.rowRange(i, i+1, false).subtract(row_vector, sub);
+        sub.sqr();
+        float l2 = sub.sum().sum(false)[0];
+        if (l2 < best_sum) {
+            best_sum = l2;
+            best_idx = i;
+        }
+    }
+}
+
+// rows drawn around 'numClusters' centers (0 for uniform data)
+static void makeData(Mat &database, Mat &queries, size_t numClusters, mt19937 &rng)
+{
+    normal_distribution<float> gaussian;
+    uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    Mat centers(std::max<size_t>(1, numClusters), numDimensions);
+    for (size_t i = 0; i < centers.rows * centers.cols; i++) {
+        centers.data[i] = gaussian(rng) * 10.0f;
+    }
+    
+    database = Mat(numRows, numDimensions);
+    queries = Mat(numQueries, numDimensions);
+    Mat *targets[2] = {&database, &queries};
+    for (int t = 0; t < 2; t++) {
+        Mat &m = *targets[t];
+        for (size_t i = 0; i < m.rows; i++) {
+            size_t c = rng() % centers.rows;
+            for (size_t d = 0; d < numDimensions; d++) {
+                m.data[i * numDimensions + d] = numClusters ? centers.data[c * numDimensions + d] + gaussian(rng) : uniform(rng);
+            }
+        }
+    }
+}
+
+// microseconds per query
+template <typename Query>
+static double latency(Query q, size_t n)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        q(i);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count() / (double)n * 1e6;
+}
+
+static void run(const char *name, size_t numClusters)
+{
+    mt19937 rng(1);
+    Mat database, queries;
+    makeData(database, queries, numClusters, rng);
+    printf("\n%s: %lu x %lu, %lu queries\n", name, numRows, numDimensions, numQueries);
+    
+    float best;
+    size_t idx;
+    double reference = latency([&](size_t i) {
+        closestRowL2Reference(database, queries.rowRange(i, i + 1, false), best, idx);
+        sink = idx;
+    }, 20);
+    printf("%-32s %10.1f us/query\n", "allocating scan (previous)", reference);
+    
+    double scan = latency([&](size_t i) {
+        database.getIndexOfClosestRowL2(queries.rowRange(i, i + 1, false), best, idx);
+        sink = idx;
+    }, numQueries);
+    printf("%-32s %10.1f us/query  (%.1fx)\n", "getIndexOfClosestRowL2", scan, reference / scan);
+    
+    const char *types[] = {"", "brute force index", "KD-tree", "VP-tree"};
+    for (int type = pkmNearestNeighbors::INDEX_BRUTE_FORCE; type <= pkmNearestNeighbors::INDEX_VPTREE; type++)
+    {
+        pkmNearestNeighbors index;
+        auto start = std::chrono::steady_clock::now();
+        index.build(database, pkmNearestNeighbors::DISTANCE_L2, type);
+        double build = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        
+        vector<size_t> indices;
+        vector<float> distances;
+        for (size_t k = 1; k <= 10; k += 9) {
+            double t = latency([&](size_t i) {
+                index.knn(queries.data + i * numDimensions, k, indices, distances);
+                sink = indices[0];
+            }, numQueries);
+            printf("%-20s k = %-2lu %10.1f us/query  (%.1fx, build %.2fs)\n", types[type], k, t, reference / t, build);
+        }
+    }
+}
+
+
+int main (int argc, char * const argv[]) {
+    run("clustered (100 clusters)", 100);
+    run("uniform", 0);
+    return 0;
+}
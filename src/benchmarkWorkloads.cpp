@@ -0,0 +1,344 @@
+/*
+ *  benchmarkWorkloads.cpp
+ *
+
+ end-to-end workloads on seeded synthetic data, for sizing deployments:
+ pkmDTW searches of gesture databases (getNearestCandidate over sequences
+ of varying length, getNearestCandidateEuclidean over fixed-length ones)
+ and pkmGaussianMixtureModel fits of 2-D point clouds (modelData,
+ getLikelihoodMap).  Queries are timed one by one for their latency
+ percentiles.  Every result carries how far the resident memory rose
+ while it ran: the database or model for addToDatabase and modelData,
+ which build one per call, and the working memory of a query for the
+ latency workloads, whose database is built beforehand.
+ Compile with -DWITH_GVF to add pkmGVF, which needs Eigen and the
+ GestureVariationFollower sources.
+
+ Options are those of pkmBenchmark.h, and
+
+     --queries n     queries per search workload (default 30)
+     --seed n        seed of the generators (default 1)
+
+ Copyright (C) 2015 Parag K. Mital
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *
+ */
+
+#include <random>
+#include <fstream>
+#include "pkmMatrix.h"
+#include "pkmParallel.h"
+#include "pkmDTW.h"
+#include "pkmGaussianMixtureModel.h"
+#ifdef WITH_GVF
+#include "pkmGVF.h"
+#endif
+#include "pkmBenchmark.h"
+
+using namespace std;
+using namespace pkm;
+
+// -----------------------------------------------------------------------------
+//  Gestures: each dimension is a sum of three sinusoids with random
+//  frequency, phase and amplitude, so one set of parameters can be sampled
+//  at any length and with any (monotonic) time warp.  A parameter row holds
+//  frequency, phase and amplitude of each of the three components.
+// -----------------------------------------------------------------------------
+static Mat gestureParameters(size_t dims, mt19937 &rng)
+{
+    uniform_real_distribution<float> frequency(0.5f, 3.0f), phase(0.0f, 2.0f * (float)M_PI), amplitude(0.2f, 1.0f);
+    Mat parameters(dims, 9);
+    for (size_t d = 0; d < dims; d++) {
+        for (size_t c = 0; c < 3; c++) {
+            parameters.data[d * 9 + c * 3 + 0] = frequency(rng);
+            parameters.data[d * 9 + c * 3 + 1] = phase(rng);
+            parameters.data[d * 9 + c * 3 + 2] = amplitude(rng) / (1.0f + c);
+        }
+    }
+    return parameters;
+}
+
+// length x dims frames; 'warp' in (-0.3, 0.3) bends time by warp * sin(pi t)
+static Mat sampleGesture(const Mat &parameters, size_t length, float warp, float noise, mt19937 &rng)
+{
+    normal_distribution<float> gaussian(0.0f, noise);
+    const size_t dims = parameters.rows;
+    Mat frames(length, dims);
+    for (size_t i = 0; i < length; i++) {
+        float t = length > 1 ? (float)i / (float)(length - 1) : 0.0f;
+        t += warp * sinf((float)M_PI * t);
+        for (size_t d = 0; d < dims; d++) {
+            const float *p = parameters.data + d * 9;
+            float value = 0;
+            for (size_t c = 0; c < 3; c++) {
+                value += p[c * 3 + 2] * sinf(2.0f * (float)M_PI * p[c * 3] * t + p[c * 3 + 1]);
+            }
+            frames.data[i * dims + d] = value + (noise > 0 ? gaussian(rng) : 0.0f);
+        }
+    }
+    return frames;
+}
+
+struct GestureDatabase
+{
+    vector<Mat> parameters, gestures;
+};
+
+// numGestures gestures of minLength to maxLength frames
+static GestureDatabase gestureDatabase(size_t numGestures, size_t dims, size_t minLength, size_t maxLength, mt19937 &rng)
+{
+    uniform_int_distribution<size_t> length(minLength, maxLength);
+    GestureDatabase database;
+    for (size_t i = 0; i < numGestures; i++) {
+        database.parameters.push_back(gestureParameters(dims, rng));
+        database.gestures.push_back(sampleGesture(database.parameters.back(), length(rng), 0.0f, 0.0f, rng));
+    }
+    return database;
+}
+
+// a noisy, time-warped performance of a random database gesture, whose
+// index is returned in 'source'; bStretch also changes its length by up to 20%
+static Mat gestureQuery(const GestureDatabase &database, bool bStretch, size_t &source, mt19937 &rng)
+{
+    uniform_int_distribution<size_t> pick(0, database.gestures.size() - 1);
+    uniform_real_distribution<float> stretch(0.8f, 1.2f), warp(-0.2f, 0.2f);
+    source = pick(rng);
+    size_t length = database.gestures[source].rows;
+    if (bStretch) {
+        return sampleGesture(database.parameters[source], std::max<size_t>(2, (size_t)(length * stretch(rng))), warp(rng), 0.05f, rng);
+    }
+    return sampleGesture(database.parameters[source], length, 0.0f, 0.05f, rng);
+}
+
+static string workloadName(size_t numGestures, size_t dims)
+{
+    char name[48];
+    snprintf(name, sizeof(name), "%lu x %lud", numGestures, dims);
+    return name;
+}
+
+// -----------------------------------------------------------------------------
+//  pkmDTW over gestures of 30 to 120 frames
+// -----------------------------------------------------------------------------
+static void dtwSearch(pkmBenchmark &bench, size_t numGestures, size_t dims, size_t numQueries, mt19937 &rng)
+{
+    if (!bench.isSelected("dtw addToDatabase") && !bench.isSelected("dtw getNearestCandidate")) {
+        return;
+    }
+    const string shape = workloadName(numGestures, dims);
+    GestureDatabase database = gestureDatabase(numGestures, dims, 30, 120, rng);
+    double bytes = 0;
+    for (size_t i = 0; i < numGestures; i++) {
+        bytes += 4.0 * database.gestures[i].rows * dims;
+    }
+
+    bench.run("dtw addToDatabase", shape, bytes, 0, [&]() {
+        pkmDTW dtw;
+        for (size_t i = 0; i < numGestures; i++) {
+            dtw.addToDatabase(database.gestures[i]);
+        }
+    });
+
+    pkmDTW dtw;
+    for (size_t i = 0; i < numGestures; i++) {
+        dtw.addToDatabase(database.gestures[i]);
+    }
+    vector<Mat> queries(numQueries);
+    vector<size_t> sources(numQueries);
+    for (size_t q = 0; q < numQueries; q++) {
+        queries[q] = gestureQuery(database, true, sources[q], rng);
+    }
+    size_t numCorrect = 0;
+    bench.runLatency("dtw getNearestCandidate", shape, numQueries, [&](size_t q) {
+        float distance;
+        int subscript = -1;
+        vector<int> pathI, pathJ;
+        dtw.getNearestCandidate(queries[q], distance, subscript, pathI, pathJ);
+        numCorrect += (size_t)subscript == sources[q];
+    });
+    if (bench.isSelected("dtw getNearestCandidate")) {
+        printf("    %lu of %lu queries matched their source gesture\n", numCorrect, numQueries);
+    }
+}
+
+// -----------------------------------------------------------------------------
+//  pkmDTW::getNearestCandidateEuclidean over gestures of 64 frames (it
+//  compares frame by frame, so queries have the database's length)
+// -----------------------------------------------------------------------------
+static void euclideanSearch(pkmBenchmark &bench, size_t numGestures, size_t dims, size_t numQueries, mt19937 &rng)
+{
+    if (!bench.isSelected("dtw euclidean")) {
+        return;
+    }
+    const string shape = workloadName(numGestures, dims);
+    GestureDatabase database = gestureDatabase(numGestures, dims, 64, 64, rng);
+    pkmDTW dtw;
+    for (size_t i = 0; i < numGestures; i++) {
+        dtw.addToDatabase(database.gestures[i]);
+    }
+    vector<Mat> queries(numQueries);
+    vector<size_t> sources(numQueries);
+    for (size_t q = 0; q < numQueries; q++) {
+        queries[q] = gestureQuery(database, false, sources[q], rng);
+    }
+    size_t numCorrect = 0;
+    bench.runLatency("dtw euclidean", shape, numQueries, [&](size_t q) {
+        float distance;
+        int subscript = -1;
+        dtw.getNearestCandidateEuclidean(queries[q], distance, subscript);
+        numCorrect += (size_t)subscript == sources[q];
+    });
+    if (bench.isSelected("dtw euclidean")) {
+        printf("    %lu of %lu queries matched their source gesture\n", numCorrect, numQueries);
+    }
+}
+
+#ifdef WITH_GVF
+// -----------------------------------------------------------------------------
+//  pkmGVF follows a performance frame by frame, so its latency is per frame
+// -----------------------------------------------------------------------------
+static void gvfFollowing(pkmBenchmark &bench, size_t numGestures, size_t dims, mt19937 &rng)
+{
+    if (!bench.isSelected("gvf frame")) {
+        return;
+    }
+    const string shape = workloadName(numGestures, dims);
+    GestureDatabase database = gestureDatabase(numGestures, dims, 30, 120, rng);
+    pkmGVF gvf;
+    for (size_t i = 0; i < numGestures; i++) {
+        gvf.addToDatabase(database.gestures[i]);
+    }
+    gvf.normalizeDatabase();
+    gvf.buildDatabase();
+
+    size_t source;
+    Mat performance = gestureQuery(database, true, source, rng);
+    vector<float> frame(dims);
+    bench.runLatency("gvf frame", shape, performance.rows, [&](size_t f) {
+        float distance;
+        int subscript = -1;
+        vector<int> pathI, pathJ;
+        std::copy(performance.row(f), performance.row(f) + dims, frame.begin());
+        gvf.getNearestCandidate(&frame[0], (int)dims, distance, subscript, pathI, pathJ);
+    });
+}
+#endif
+
+// -----------------------------------------------------------------------------
+//  2-D point clouds: numClusters anisotropic, rotated Gaussian clusters
+//  inside a width x height image, as (x, y) rows
+// -----------------------------------------------------------------------------
+static vector<double> pointCloud(size_t numPoints, size_t numClusters, double width, double height, mt19937 &rng)
+{
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    normal_distribution<double> gaussian;
+    vector<double> centers(2 * numClusters), axes(2 * numClusters), angles(numClusters);
+    for (size_t k = 0; k < numClusters; k++) {
+        centers[2 * k] = width * (0.1 + 0.8 * uniform(rng));
+        centers[2 * k + 1] = height * (0.1 + 0.8 * uniform(rng));
+        axes[2 * k] = width * (0.02 + 0.06 * uniform(rng));
+        axes[2 * k + 1] = height * (0.01 + 0.03 * uniform(rng));
+        angles[k] = M_PI * uniform(rng);
+    }
+    vector<double> points(2 * numPoints);
+    for (size_t n = 0; n < numPoints; n++) {
+        size_t k = n % numClusters;
+        double u = axes[2 * k] * gaussian(rng), v = axes[2 * k + 1] * gaussian(rng);
+        points[2 * n] = centers[2 * k] + cos(angles[k]) * u - sin(angles[k]) * v;
+        points[2 * n + 1] = centers[2 * k + 1] + sin(angles[k]) * u + cos(angles[k]) * v;
+    }
+    return points;
+}
+
+// -----------------------------------------------------------------------------
+//  pkmGaussianMixtureModel with full covariances, searching 1 to 8
+//  components, then a likelihood map per frame
+// -----------------------------------------------------------------------------
+static void mixtureModel(pkmBenchmark &bench, size_t numPoints, size_t numFrames, mt19937 &rng)
+{
+    if (!bench.isSelected("gmm modelData") && !bench.isSelected("gmm getLikelihoodMap")) {
+        return;
+    }
+    const int width = 640, height = 480, genericCovariance = 2;
+    char shape[48];
+    snprintf(shape, sizeof(shape), "%lu x 2d", numPoints);
+    vector<double> points = pointCloud(numPoints, 5, width, height, rng);
+
+    bench.run("gmm modelData", shape, 0, 0, [&]() {
+        pkmGaussianMixtureModel gmm(&points[0], (int)numPoints, 2, 1, genericCovariance);
+        gmm.modelData(1, 8, 1e-3, 1e-4);
+    });
+
+    pkmGaussianMixtureModel gmm(&points[0], (int)numPoints, 2, 1, genericCovariance);
+    gmm.modelData(1, 8, 1e-3, 1e-4);
+    snprintf(shape, sizeof(shape), "%dx%d n%lu", width, height, numPoints);
+    vector<unsigned char> map(width * height);
+    // an unopened stream discards the per-cluster text getLikelihoodMap writes
+    std::ofstream discard;
+    bench.runLatency("gmm getLikelihoodMap", shape, numFrames, [&](size_t) {
+        std::fill(map.begin(), map.end(), 0);
+        gmm.getLikelihoodMap(height, width, &map[0], discard);
+        sink = map[0];
+    });
+}
+
+int main (int argc, char * const argv[]) {
+    pkmBenchmark bench(argc, argv);
+    size_t numQueries = 30;
+    unsigned seed = 1;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (!strcmp(argv[i], "--queries")) {
+            numQueries = std::max(1, atoi(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--seed")) {
+            seed = (unsigned)atoi(argv[++i]);
+        }
+    }
+    char text[32];
+    snprintf(text, sizeof(text), "%lu", getNumThreads());
+    bench.setContext("threads", text);
+    snprintf(text, sizeof(text), "%u", seed);
+    bench.setContext("seed", text);
+
+    // each workload has its own generator, so its data does not depend on
+    // which other workloads --filter selects
+    unsigned workload = 0;
+    const size_t databases[][2] = {{100, 12}, {1000, 12}, {100, 40}, {1000, 40}};
+    for (size_t s = 0; s < 4; s++) {
+        mt19937 rng(seed + workload++);
+        dtwSearch(bench, databases[s][0], databases[s][1], numQueries, rng);
+    }
+
+    const size_t fixedLength[][2] = {{1000, 12}, {10000, 12}, {1000, 40}};
+    for (size_t s = 0; s < 3; s++) {
+        mt19937 rng(seed + workload++);
+        euclideanSearch(bench, fixedLength[s][0], fixedLength[s][1], numQueries, rng);
+    }
+
+#ifdef WITH_GVF
+    {
+        mt19937 rng(seed + workload++);
+        gvfFollowing(bench, 100, 12, rng);
+    }
+#endif
+
+    const size_t clouds[] = {2000, 20000};
+    for (size_t s = 0; s < 2; s++) {
+        mt19937 rng(seed + workload++);
+        mixtureModel(bench, clouds[s], numQueries, rng);
+    }
+    return 0;
+}
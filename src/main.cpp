@@ -25,6 +25,7 @@
  */
 
 #include <iostream>
+#include <chrono>
 #include "pkmMatrix.h"
 #include <vector>
 
@@ -47,6 +48,32 @@ int main (int argc, char * const argv[]) {
         auto end = std::chrono::steady_clock::now();
         std::cout << "Mean calculated in " << double((end-start).count())/double(std::chrono::steady_clock::period::den) << "s" << std::endl;
     }
+    
+    // build a database row by row, as pkmDTW/pkmGVF::addToDatabase do
+    size_t n_rows = 1000000;
+    size_t n_dims = 16;
+    std::vector<float> frame(n_dims, 1.0f);
+    {
+        auto start = std::chrono::steady_clock::now();
+        pkm::Mat database;
+        for (size_t i = 0; i < n_rows; i++)
+        {
+            database.push_back(frame);
+        }
+        auto end = std::chrono::steady_clock::now();
+        std::cout << "Appended " << database.rows << " rows (capacity " << database.capacityRows() << ") in " << double((end-start).count())/double(std::chrono::steady_clock::period::den) << "s" << std::endl;
+    }
+    {
+        auto start = std::chrono::steady_clock::now();
+        pkm::Mat database;
+        database.reserve(n_rows, n_dims);
+        for (size_t i = 0; i < n_rows; i++)
+        {
+            database.push_back(&(frame[0]), n_dims);
+        }
+        auto end = std::chrono::steady_clock::now();
+        std::cout << "Appended " << database.rows << " reserved rows in " << double((end-start).count())/double(std::chrono::steady_clock::period::den) << "s" << std::endl;
+    }
 
     
 	return 0;
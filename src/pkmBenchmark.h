@@ -0,0 +1,483 @@
+/*
+ *  pkmBenchmark.h
+ *
+
+ timing harness shared by the benchmarks: repeats a kernel until a minimum
+ time is reached, reports the median, minimum and spread of the time per
+ call with the throughput in GB/s and GFLOP/s, and writes the results as
+ JSON (--json file) so that runs can be compared between commits
+ (--baseline file); workloads whose cost varies from call to call are
+ timed call by call for their latency percentiles
+
+ Copyright (C) 2015 Parag K. Mital
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *
+ */
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <sys/resource.h>
+
+// keeps the compiler from discarding the results
+static volatile float sink;
+
+// -----------------------------------------------------------------------------
+//  Command line options understood by every benchmark:
+//
+//      --filter text       only run benchmarks whose name contains text
+//      --repetitions n     timed repetitions per benchmark (default 10)
+//      --min-time s        minimum total seconds per benchmark (default 0.2)
+//      --json file         write the results as JSON
+//      --baseline file     JSON from an earlier run; prints the speedup
+//
+//  Each repetition runs the kernel enough times to last min-time /
+//  repetitions, so the time per call of even the smallest shapes is above
+//  the clock's resolution.  Bytes and FLOPs are per call and are nominal:
+//  the data a kernel must read and write once, and its arithmetic with a
+//  transcendental function counted as one operation.  Every result also
+//  records how far the resident memory rose above its level when the
+//  benchmark started, so benchmarks are measured on their own rather than
+//  by the process's high-water mark; on Linux the peak is reset before each
+//  benchmark, elsewhere only growth past the process's earlier peak shows.
+// -----------------------------------------------------------------------------
+class pkmBenchmark
+{
+public:
+    struct Result
+    {
+        std::string name, shape;
+        size_t repetitions, iterations;
+        double median, minimum, mean, stddev;       // seconds per call
+        double p90, p99, maximum;                   // runLatency() only
+        double bytes, flops;                        // per call
+        long peakResidentKB;                        // above the start
+        bool bLatency;
+
+        double gigabytesPerSecond() const
+        {
+            return bytes / median / 1e9;
+        }
+
+        double gigaflopsPerSecond() const
+        {
+            return flops / median / 1e9;
+        }
+    };
+
+    pkmBenchmark(int argc, char * const argv[])
+    {
+        repetitions = 10;
+        minTime = 0.2;
+        for (int i = 1; i + 1 < argc; i++) {
+            if (!strcmp(argv[i], "--filter")) {
+                filter = argv[++i];
+            }
+            else if (!strcmp(argv[i], "--repetitions")) {
+                repetitions = std::max(1, atoi(argv[++i]));
+            }
+            else if (!strcmp(argv[i], "--min-time")) {
+                minTime = atof(argv[++i]);
+            }
+            else if (!strcmp(argv[i], "--json")) {
+                jsonFile = argv[++i];
+            }
+            else if (!strcmp(argv[i], "--baseline")) {
+                loadBaseline(argv[++i]);
+            }
+        }
+        bHeaderPrinted = false;
+    }
+
+    ~pkmBenchmark()
+    {
+        if (!jsonFile.empty()) {
+            writeJSON(jsonFile);
+        }
+    }
+
+    // key/value pairs written to the JSON "context", e.g. the thread count
+    void setContext(const std::string &key, const std::string &value)
+    {
+        context.push_back(std::make_pair(key, value));
+    }
+
+    bool isSelected(const std::string &name) const
+    {
+        return filter.empty() || name.find(filter) != std::string::npos;
+    }
+
+    // -------------------------------------------------------------------------
+    //  time kernel(), which performs bytes of traffic and flops of arithmetic
+    // -------------------------------------------------------------------------
+    template <typename Kernel>
+    void run(const std::string &name, const std::string &shape, double bytes, double flops, Kernel kernel)
+    {
+        run(name, shape, bytes, flops, []() {}, kernel, false);
+    }
+
+    // -------------------------------------------------------------------------
+    //  as run(), with an untimed setup() before every call, for in-place
+    //  kernels that would otherwise be applied to their own output; each
+    //  call is timed separately
+    // -------------------------------------------------------------------------
+    template <typename Setup, typename Kernel>
+    void run(const std::string &name, const std::string &shape, double bytes, double flops, Setup setup, Kernel kernel)
+    {
+        run(name, shape, bytes, flops, setup, kernel, true);
+    }
+
+    // -------------------------------------------------------------------------
+    //  time each of numCalls calls of kernel(i), i = 0 .. numCalls - 1,
+    //  separately and report the latency percentiles and calls per second
+    //  (1 / mean), e.g. for queries of different lengths
+    // -------------------------------------------------------------------------
+    template <typename Kernel>
+    void runLatency(const std::string &name, const std::string &shape, size_t numCalls, Kernel kernel)
+    {
+        if (!isSelected(name) || numCalls == 0) {
+            return;
+        }
+        long startKB = startMemory();
+        std::vector<double> times(numCalls);
+        for (size_t i = 0; i < numCalls; i++) {
+            Clock::time_point start = Clock::now();
+            kernel(i);
+            times[i] = seconds(start, Clock::now());
+        }
+        Result result = summarize(name, shape, times, 1, 0, 0, startKB);
+        result.bLatency = true;
+        results.push_back(result);
+        print(result);
+    }
+
+    // -------------------------------------------------------------------------
+    //  resident memory of the process in kilobytes: now, and its peak since
+    //  the last resetPeakResident() (or the process start if it cannot reset)
+    // -------------------------------------------------------------------------
+    static long residentKB()
+    {
+#ifdef __linux__
+        long pages = 0, resident = 0;
+        FILE *fp = fopen("/proc/self/statm", "r");
+        if (fp) {
+            if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) {
+                resident = 0;
+            }
+            fclose(fp);
+        }
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+        return peakResidentKB();
+#endif
+    }
+
+    static long peakResidentKB()
+    {
+#ifdef __linux__
+        char line[256];
+        long peak = 0;
+        FILE *fp = fopen("/proc/self/status", "r");
+        if (fp) {
+            while (fgets(line, sizeof(line), fp)) {
+                if (sscanf(line, "VmHWM: %ld kB", &peak) == 1) {
+                    break;
+                }
+            }
+            fclose(fp);
+        }
+        if (peak > 0) {
+            return peak;
+        }
+#endif
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0;
+        }
+#ifdef __APPLE__
+        return (long)(usage.ru_maxrss / 1024);     // bytes on macOS
+#else
+        return (long)usage.ru_maxrss;
+#endif
+    }
+
+    // sets the peak to the current resident memory (Linux 4.0 and later)
+    static bool resetPeakResident()
+    {
+#ifdef __linux__
+        FILE *fp = fopen("/proc/self/clear_refs", "w");
+        if (fp) {
+            bool bReset = fputs("5", fp) >= 0;
+            return fclose(fp) == 0 && bReset;
+        }
+#endif
+        return false;
+    }
+
+    const std::vector<Result> & getResults() const
+    {
+        return results;
+    }
+
+    bool writeJSON(const std::string &filename) const
+    {
+        FILE *fp = fopen(filename.c_str(), "w");
+        if (!fp) {
+            printf("[ERROR]: pkmBenchmark::writeJSON() could not open %s\n", filename.c_str());
+            return false;
+        }
+        char date[64];
+        time_t now = time(NULL);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+        fprintf(fp, "{\n  \"context\": {\n    \"date\": \"%s\",\n", date);
+#ifdef __VERSION__
+        fprintf(fp, "    \"compiler\": \"%s\",\n", __VERSION__);
+#endif
+        for (size_t i = 0; i < context.size(); i++) {
+            fprintf(fp, "    \"%s\": \"%s\",\n", context[i].first.c_str(), context[i].second.c_str());
+        }
+        fprintf(fp, "    \"repetitions\": %d,\n    \"min_time\": %g\n  },\n  \"benchmarks\": [\n", repetitions, minTime);
+        // one benchmark per line, which is what loadBaseline() reads
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result &r = results[i];
+            fprintf(fp, "    {\"name\": \"%s\", \"shape\": \"%s\", \"repetitions\": %lu, \"iterations\": %lu, "
+                    "\"median_ns\": %.1f, \"min_ns\": %.1f, \"mean_ns\": %.1f, \"stddev_ns\": %.1f, ",
+                    r.name.c_str(), r.shape.c_str(), r.repetitions, r.iterations,
+                    r.median * 1e9, r.minimum * 1e9, r.mean * 1e9, r.stddev * 1e9);
+            if (r.bLatency) {
+                fprintf(fp, "\"p90_ns\": %.1f, \"p99_ns\": %.1f, \"max_ns\": %.1f, \"calls_per_s\": %.3f, ",
+                        r.p90 * 1e9, r.p99 * 1e9, r.maximum * 1e9, 1.0 / r.mean);
+            }
+            fprintf(fp, "\"bytes\": %.0f, \"flops\": %.0f, \"gb_per_s\": %.3f, \"gflop_per_s\": %.3f, \"peak_rss_kb\": %ld}%s\n",
+                    r.bytes, r.flops, r.gigabytesPerSecond(), r.gigaflopsPerSecond(), r.peakResidentKB,
+                    i + 1 < results.size() ? "," : "");
+        }
+        fprintf(fp, "  ]\n}\n");
+        fclose(fp);
+        return true;
+    }
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    static double seconds(Clock::time_point start, Clock::time_point end)
+    {
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    template <typename Setup, typename Kernel>
+    void run(const std::string &name, const std::string &shape, double bytes, double flops, Setup setup, Kernel kernel, bool bSetupEachCall)
+    {
+        if (!isSelected(name)) {
+            return;
+        }
+
+        // the first call warms the caches and sizes the repetitions; slow
+        // kernels get fewer repetitions, but at least 3
+        long startKB = startMemory();
+        setup();
+        Clock::time_point start = Clock::now();
+        kernel();
+        double first = std::max(seconds(start, Clock::now()), 1e-9);
+
+        size_t numRepetitions = repetitions;
+        if (first * repetitions > 10.0 * minTime) {
+            numRepetitions = std::max<size_t>(3, (size_t)(10.0 * minTime / first));
+        }
+        size_t iterations = std::max<size_t>(1, (size_t)(minTime / numRepetitions / first));
+
+        std::vector<double> times(numRepetitions);
+        for (size_t r = 0; r < numRepetitions; r++) {
+            double total = 0;
+            if (bSetupEachCall) {
+                for (size_t i = 0; i < iterations; i++) {
+                    setup();
+                    start = Clock::now();
+                    kernel();
+                    total += seconds(start, Clock::now());
+                }
+            }
+            else {
+                start = Clock::now();
+                for (size_t i = 0; i < iterations; i++) {
+                    kernel();
+                }
+                total = seconds(start, Clock::now());
+            }
+            times[r] = total / iterations;
+        }
+
+        Result result = summarize(name, shape, times, iterations, bytes, flops, startKB);
+        results.push_back(result);
+        print(result);
+    }
+
+    // resident memory a benchmark's growth is measured from, after returning
+    // the heap that earlier benchmarks freed, which would otherwise be reused
+    // without showing as growth
+    static long startMemory()
+    {
+#ifdef __GLIBC__
+        malloc_trim(0);
+#endif
+        return resetPeakResident() ? residentKB() : peakResidentKB();
+    }
+
+    static Result summarize(const std::string &name, const std::string &shape, std::vector<double> &times,
+                            size_t iterations, double bytes, double flops, long startKB)
+    {
+        Result result;
+        result.name = name;
+        result.shape = shape;
+        result.repetitions = times.size();
+        result.iterations = iterations;
+        result.bytes = bytes;
+        result.flops = flops;
+        result.bLatency = false;
+        std::sort(times.begin(), times.end());
+        size_t n = times.size();
+        result.median = (n % 2) ? times[n / 2] : 0.5 * (times[n / 2 - 1] + times[n / 2]);
+        result.minimum = times[0];
+        result.maximum = times[n - 1];
+        // nearest rank percentiles
+        result.p90 = times[std::min(n - 1, (size_t)ceil(0.90 * n) - 1)];
+        result.p99 = times[std::min(n - 1, (size_t)ceil(0.99 * n) - 1)];
+        result.mean = 0;
+        for (size_t i = 0; i < n; i++) {
+            result.mean += times[i] / n;
+        }
+        result.stddev = 0;
+        for (size_t i = 0; i < n; i++) {
+            result.stddev += (times[i] - result.mean) * (times[i] - result.mean) / n;
+        }
+        result.stddev = sqrt(result.stddev);
+        result.peakResidentKB = std::max(0L, peakResidentKB() - startKB);
+        return result;
+    }
+
+    static std::string formatTime(double t)
+    {
+        char text[32];
+        if (t < 1e-3) {
+            snprintf(text, sizeof(text), "%.2f us", t * 1e6);
+        }
+        else if (t < 1.0) {
+            snprintf(text, sizeof(text), "%.2f ms", t * 1e3);
+        }
+        else {
+            snprintf(text, sizeof(text), "%.3f s", t);
+        }
+        return text;
+    }
+
+    void print(const Result &r)
+    {
+        if (!bHeaderPrinted) {
+            printf("%-24s %-14s %12s %8s %10s %10s%s\n", "benchmark", "shape", "median", "+/-", "GB/s", "GFLOP/s",
+                   baseline.empty() ? "" : "   speedup");
+            bHeaderPrinted = true;
+        }
+        printf("%-24s %-14s %12s %7.1f%% ", r.name.c_str(), r.shape.c_str(), formatTime(r.median).c_str(), 100.0 * r.stddev / r.mean);
+        if (r.bLatency) {
+            // percentiles in place of the throughput columns
+            printf("p90 %s  p99 %s  max %s  %.1f/s  +%.1f MB", formatTime(r.p90).c_str(), formatTime(r.p99).c_str(),
+                   formatTime(r.maximum).c_str(), 1.0 / r.mean, r.peakResidentKB / 1024.0);
+        }
+        else {
+            if (r.bytes > 0) {
+                printf("%10.2f ", r.gigabytesPerSecond());
+            }
+            else {
+                printf("%10s ", "-");
+            }
+            if (r.flops > 0) {
+                printf("%10.2f", r.gigaflopsPerSecond());
+            }
+            else {
+                printf("%10s", "-");
+            }
+        }
+        for (size_t i = 0; i < baseline.size(); i++) {
+            if (baseline[i].name == r.name && baseline[i].shape == r.shape) {
+                printf("   %6.2fx", baseline[i].median / r.median);
+                break;
+            }
+        }
+        printf("\n");
+    }
+
+    // reads the name, shape and median of each benchmark line of writeJSON()
+    static bool field(const char *line, const char *key, char *value, size_t size)
+    {
+        char pattern[64];
+        snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+        const char *p = strstr(line, pattern);
+        if (!p) {
+            return false;
+        }
+        p += strlen(pattern);
+        if (*p == '"') {
+            p++;
+        }
+        size_t n = 0;
+        while (*p && *p != '"' && *p != ',' && *p != '}' && n + 1 < size) {
+            value[n++] = *p++;
+        }
+        value[n] = 0;
+        return true;
+    }
+
+    void loadBaseline(const char *filename)
+    {
+        FILE *fp = fopen(filename, "r");
+        if (!fp) {
+            printf("[ERROR]: pkmBenchmark::loadBaseline() could not open %s\n", filename);
+            return;
+        }
+        char line[1024], name[256], shape[256], median[64];
+        while (fgets(line, sizeof(line), fp)) {
+            if (field(line, "name", name, sizeof(name)) && field(line, "shape", shape, sizeof(shape)) &&
+                field(line, "median_ns", median, sizeof(median))) {
+                Result r;
+                r.name = name;
+                r.shape = shape;
+                r.median = atof(median) * 1e-9;
+                baseline.push_back(r);
+            }
+        }
+        fclose(fp);
+    }
+
+    std::vector<Result> results, baseline;
+    std::vector<std::pair<std::string, std::string> > context;
+    std::string filter, jsonFile;
+    int repetitions;
+    double minTime;
+    bool bHeaderPrinted;
+};